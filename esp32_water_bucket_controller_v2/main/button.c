@@ -0,0 +1,164 @@
+/*
+ * button.c - Switch debounce and short/long/double/repeat press detection; rules in button.h.
+ */
+
+#include <string.h>
+#include "button.h"
+
+/* True once `at` is reached; wrap-safe for deadlines within 2^31 ms. */
+static bool due(uint32_t now, uint32_t at)
+{
+    return (int32_t)(now - at) >= 0;
+}
+
+/* A raw change to `level` before `at` is still debouncing; its deadline comes first. */
+static bool pending_before(const btn_t *b, bool level, uint32_t at)
+{
+    return b->raw == level && b->raw != b->stable && !due(b->raw_since, at);
+}
+
+void btn_init(btn_t *b, const btn_config_t *cfg, bool pressed, uint32_t now_ms)
+{
+    memset(b, 0, sizeof(*b));
+    b->cfg = *cfg;
+    b->raw = pressed;
+    b->stable = pressed;
+    b->raw_since = now_ms;
+    b->state = pressed ? BTN_ST_IGNORE : BTN_ST_UP;
+}
+
+/* Debounced edge at b->raw_since. */
+static btn_event_t on_edge(btn_t *b)
+{
+    if (b->stable) {
+        if (b->state == BTN_ST_UP) {
+            b->state = BTN_ST_DOWN;
+            b->press_ms = b->raw_since;
+        } else if (b->state == BTN_ST_WAIT2) {
+            b->state = BTN_ST_DOWN2;
+            b->press_ms = b->raw_since;
+        }
+        return BTN_NONE;
+    }
+    switch (b->state) {
+    case BTN_ST_DOWN:
+        if (b->cfg.double_ms > 0) {
+            b->state = BTN_ST_WAIT2;
+            b->release_ms = b->raw_since;
+            return BTN_NONE;
+        }
+        b->state = BTN_ST_UP;
+        return BTN_SHORT;
+    case BTN_ST_DOWN2:
+        b->state = BTN_ST_UP;
+        return BTN_DOUBLE;
+    case BTN_ST_HELD:
+    case BTN_ST_IGNORE:
+        b->state = BTN_ST_UP;
+        return BTN_NONE;
+    default:
+        return BTN_NONE;
+    }
+}
+
+static btn_event_t on_time(btn_t *b, uint32_t now)
+{
+    switch (b->state) {
+    case BTN_ST_DOWN:
+        if (!due(now, b->press_ms + b->cfg.long_ms) || pending_before(b, false, b->press_ms + b->cfg.long_ms)) {
+            return BTN_NONE;
+        }
+        b->state = BTN_ST_HELD;
+        b->repeat_at = b->press_ms + b->cfg.long_ms + b->cfg.repeat_ms;
+        return BTN_LONG;
+    case BTN_ST_HELD:
+        if (b->cfg.repeat_ms == 0 || !b->stable || !due(now, b->repeat_at) ||
+            pending_before(b, false, b->repeat_at)) {
+            return BTN_NONE;
+        }
+        b->repeat_at += b->cfg.repeat_ms;
+        return BTN_REPEAT;
+    case BTN_ST_WAIT2:
+        if (!due(now, b->release_ms + b->cfg.double_ms) ||
+            pending_before(b, true, b->release_ms + b->cfg.double_ms)) {
+            return BTN_NONE;
+        }
+        b->state = BTN_ST_UP;
+        return BTN_SHORT;
+    case BTN_ST_DOWN2:
+        if (!due(now, b->press_ms + b->cfg.long_ms) || pending_before(b, false, b->press_ms + b->cfg.long_ms)) {
+            return BTN_NONE;
+        }
+        /* Click then hold: the click, then (next call) the long press. */
+        b->state = BTN_ST_DOWN;
+        return BTN_SHORT;
+    default:
+        return BTN_NONE;
+    }
+}
+
+btn_event_t btn_update(btn_t *b, bool pressed, uint32_t now_ms)
+{
+    if (pressed != b->raw) {
+        b->raw = pressed;
+        b->raw_since = now_ms;
+    }
+    if (b->raw != b->stable && due(now_ms, b->raw_since + b->cfg.debounce_ms)) {
+        b->stable = b->raw;
+        btn_event_t ev = on_edge(b);
+        if (ev != BTN_NONE) {
+            return ev;
+        }
+    }
+    return on_time(b, now_ms);
+}
+
+static void earliest(uint32_t *best, bool *have, uint32_t now, uint32_t at)
+{
+    uint32_t in = due(now, at) ? 0 : at - now;
+    if (!*have || in < *best) {
+        *best = in;
+        *have = true;
+    }
+}
+
+uint32_t btn_next_ms(const btn_t *b, uint32_t now_ms)
+{
+    uint32_t best = 0;
+    bool have = false;
+    if (b->raw != b->stable) {
+        earliest(&best, &have, now_ms, b->raw_since + b->cfg.debounce_ms);
+    }
+    switch (b->state) {
+    case BTN_ST_DOWN:
+    case BTN_ST_DOWN2:
+        if (!pending_before(b, false, b->press_ms + b->cfg.long_ms)) {
+            earliest(&best, &have, now_ms, b->press_ms + b->cfg.long_ms);
+        }
+        break;
+    case BTN_ST_HELD:
+        if (b->cfg.repeat_ms > 0 && b->stable && !pending_before(b, false, b->repeat_at)) {
+            earliest(&best, &have, now_ms, b->repeat_at);
+        }
+        break;
+    case BTN_ST_WAIT2:
+        if (!pending_before(b, true, b->release_ms + b->cfg.double_ms)) {
+            earliest(&best, &have, now_ms, b->release_ms + b->cfg.double_ms);
+        }
+        break;
+    default:
+        break;
+    }
+    return have ? best : BTN_IDLE;
+}
+
+const char *btn_event_name(btn_event_t ev)
+{
+    switch (ev) {
+    case BTN_SHORT: return "SHORT";
+    case BTN_LONG: return "LONG";
+    case BTN_DOUBLE: return "DOUBLE";
+    case BTN_REPEAT: return "REPEAT";
+    default: return "NONE";
+    }
+}
@@ -0,0 +1,77 @@
+/*
+ * button.h - Debounce and press state machine for a push switch (the encoder's SW).
+ *
+ * The caller feeds the raw switch level with btn_update() whenever it changes and again when
+ * btn_next_ms() says a deadline is due; it never waits on the switch. A level is accepted once it has
+ * held for debounce_ms, and press/release times are those of the accepted edges, so bounce does not
+ * stretch or split a press. Events:
+ *   BTN_SHORT   released before long_ms (after double_ms without a second press, if double_ms)
+ *   BTN_LONG    held for long_ms; fired at the threshold while still held
+ *   BTN_REPEAT  every repeat_ms after BTN_LONG while still held (repeat_ms 0: none)
+ *   BTN_DOUBLE  second press within double_ms of the first release, on its release (double_ms 0: off)
+ * A second press held for long_ms gives BTN_SHORT (the first click) and then BTN_LONG. A switch already
+ * pressed at btn_init() gives nothing at all until it has been released.
+ *
+ * btn_update() returns at most one event per call; call it again with the same arguments until it
+ * returns BTN_NONE. Times are milliseconds from any wrapping 32-bit clock. Pure C: the device runs it
+ * from enc_task (rotary_encoder.c), the host against recorded traces (tools/button_test.c).
+ */
+
+#ifndef WB_BUTTON_H
+#define WB_BUTTON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define BTN_IDLE UINT32_MAX     /* btn_next_ms(): nothing pending until the level changes */
+
+typedef enum {
+    BTN_NONE = 0,
+    BTN_SHORT,
+    BTN_LONG,
+    BTN_DOUBLE,
+    BTN_REPEAT,
+} btn_event_t;
+
+typedef struct {
+    uint16_t debounce_ms;
+    uint16_t long_ms;
+    uint16_t double_ms;
+    uint16_t repeat_ms;
+} btn_config_t;
+
+typedef enum {
+    BTN_ST_UP = 0,
+    BTN_ST_DOWN,            /* pressed, long_ms not reached */
+    BTN_ST_HELD,            /* BTN_LONG sent, waiting for release */
+    BTN_ST_WAIT2,           /* short click released, waiting double_ms for a second press */
+    BTN_ST_DOWN2,           /* second press down */
+    BTN_ST_IGNORE,          /* pressed at btn_init(); nothing counts until the release */
+} btn_state_t;
+
+typedef struct {
+    btn_config_t cfg;
+    btn_state_t state;
+    bool raw;               /* last level fed in */
+    bool stable;            /* debounced level */
+    uint32_t raw_since;     /* time of the last raw change */
+    uint32_t press_ms;
+    uint32_t release_ms;
+    uint32_t repeat_at;
+} btn_t;
+
+void btn_init(btn_t *b, const btn_config_t *cfg, bool pressed, uint32_t now_ms);
+btn_event_t btn_update(btn_t *b, bool pressed, uint32_t now_ms);
+/* Milliseconds until btn_update() has something to do without a level change (0: now), or BTN_IDLE. */
+uint32_t btn_next_ms(const btn_t *b, uint32_t now_ms);
+const char *btn_event_name(btn_event_t ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
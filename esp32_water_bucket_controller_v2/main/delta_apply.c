@@ -0,0 +1,192 @@
+/*
+ * delta_apply.c - See delta_apply.h. Plain C with no ESP-IDF dependency; also built on the host by
+ * `make delta-tool` (tools/wb_delta_apply.c).
+ */
+
+#include <string.h>
+#include "delta_apply.h"
+
+enum {
+    ST_OP = 0,
+    ST_VARINT,
+    ST_DATA,
+    ST_END,
+    ST_ERR,
+};
+
+static uint32_t rd32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool delta_hdr_parse(const uint8_t raw[DELTA_HDR_SIZE], delta_hdr_t *out)
+{
+    if (memcmp(raw, "WBD1", 4) != 0) {
+        return false;
+    }
+    out->src_size = rd32(raw + 4);
+    out->dst_size = rd32(raw + 8);
+    memcpy(out->src_sha, raw + 16, 32);
+    memcpy(out->dst_sha, raw + 48, 32);
+    return out->dst_size > 0;
+}
+
+void delta_init(delta_t *d, const delta_hdr_t *hdr, delta_read_fn read_src, delta_write_fn write_dst, void *ctx)
+{
+    memset(d, 0, sizeof(*d));
+    d->read_src = read_src;
+    d->write_dst = write_dst;
+    d->ctx = ctx;
+    d->src_size = hdr->src_size;
+    d->dst_size = hdr->dst_size;
+    d->state = ST_OP;
+}
+
+static uint8_t op_fields(uint8_t op)
+{
+    return op == 'I' ? 1 : 2;
+}
+
+static delta_status_t fail(delta_t *d, delta_status_t st)
+{
+    d->state = ST_ERR;
+    return st;
+}
+
+static bool src_range_ok(const delta_t *d, uint32_t off, uint32_t len)
+{
+    return off <= d->src_size && len <= d->src_size - off;
+}
+
+/* Runs a 'C' op: needs no input, copies through d->buf. */
+static delta_status_t do_copy(delta_t *d, uint32_t off, uint32_t len)
+{
+    while (len > 0) {
+        size_t n = len < DELTA_CHUNK ? len : DELTA_CHUNK;
+        if (d->read_src(d->ctx, off, d->buf, n) != 0 || d->write_dst(d->ctx, d->buf, n) != 0) {
+            return DELTA_ERR_IO;
+        }
+        off += (uint32_t)n;
+        len -= (uint32_t)n;
+        d->written += (uint32_t)n;
+    }
+    return DELTA_OK;
+}
+
+/* All fields of the current op are parsed: validate and start it. */
+static delta_status_t op_start(delta_t *d)
+{
+    uint32_t len = d->op == 'I' ? d->val[0] : d->val[1];
+    if (len > d->dst_size - d->written) {
+        return DELTA_ERR_RANGE;
+    }
+    if (d->op != 'I' && !src_range_ok(d, d->val[0], len)) {
+        return DELTA_ERR_RANGE;
+    }
+    if (d->op == 'C') {
+        d->state = ST_OP;
+        return do_copy(d, d->val[0], len);
+    }
+    d->src_off = d->op == 'A' ? d->val[0] : 0;
+    d->remaining = len;
+    d->state = len > 0 ? ST_DATA : ST_OP;
+    return DELTA_OK;
+}
+
+/* Consumes payload bytes of an 'A' or 'I' op; returns bytes used or a negative status. */
+static int op_data(delta_t *d, const uint8_t *data, size_t len)
+{
+    size_t n = len < d->remaining ? len : d->remaining;
+    if (d->op == 'I') {
+        if (d->write_dst(d->ctx, data, n) != 0) {
+            return DELTA_ERR_IO;
+        }
+    } else {
+        if (n > DELTA_CHUNK) {
+            n = DELTA_CHUNK;
+        }
+        if (d->read_src(d->ctx, d->src_off, d->buf, n) != 0) {
+            return DELTA_ERR_IO;
+        }
+        for (size_t i = 0; i < n; i++) {
+            d->buf[i] = (uint8_t)(d->buf[i] + data[i]);
+        }
+        if (d->write_dst(d->ctx, d->buf, n) != 0) {
+            return DELTA_ERR_IO;
+        }
+        d->src_off += (uint32_t)n;
+    }
+    d->written += (uint32_t)n;
+    d->remaining -= (uint32_t)n;
+    if (d->remaining == 0) {
+        d->state = ST_OP;
+    }
+    return (int)n;
+}
+
+delta_status_t delta_feed(delta_t *d, const uint8_t *data, size_t len)
+{
+    size_t i = 0;
+    while (i < len) {
+        switch (d->state) {
+        case ST_OP: {
+            uint8_t op = data[i++];
+            if (op == 'E') {
+                d->state = ST_END;
+                d->done = d->written == d->dst_size;
+                if (!d->done) {
+                    return fail(d, DELTA_ERR_RANGE);
+                }
+            } else if (op == 'C' || op == 'A' || op == 'I') {
+                d->op = op;
+                d->field = 0;
+                d->shift = 0;
+                d->val[0] = 0;
+                d->val[1] = 0;
+                d->state = ST_VARINT;
+            } else {
+                return fail(d, DELTA_ERR_FORMAT);
+            }
+            break;
+        }
+        case ST_VARINT: {
+            uint8_t b = data[i++];
+            if (d->shift > 28) {
+                return fail(d, DELTA_ERR_FORMAT);
+            }
+            d->val[d->field] |= (uint32_t)(b & 0x7Fu) << d->shift;
+            d->shift += 7;
+            if (b & 0x80u) {
+                break;
+            }
+            d->shift = 0;
+            if (++d->field < op_fields(d->op)) {
+                break;
+            }
+            delta_status_t st = op_start(d);
+            if (st != DELTA_OK) {
+                return fail(d, st);
+            }
+            break;
+        }
+        case ST_DATA: {
+            int used = op_data(d, data + i, len - i);
+            if (used < 0) {
+                return fail(d, (delta_status_t)used);
+            }
+            i += (size_t)used;
+            break;
+        }
+        case ST_END:
+            return fail(d, DELTA_ERR_FORMAT);  /* bytes after 'E' */
+        default:
+            return DELTA_ERR_FORMAT;
+        }
+    }
+    return d->state == ST_ERR ? DELTA_ERR_FORMAT : DELTA_OK;
+}
+
+bool delta_done(const delta_t *d)
+{
+    return d->done;
+}
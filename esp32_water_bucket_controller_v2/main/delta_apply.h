@@ -0,0 +1,77 @@
+/*
+ * delta_apply.h - Streaming applier for WBD1 delta patches (tools/wb_delta.py).
+ *
+ * Patch file: a DELTA_HDR_SIZE header (magic "WBD1", source and target sizes, SHA-256 of both images,
+ * little endian) followed by a zlib stream. Inflated, that stream is a sequence of ops, lengths and
+ * offsets as LEB128 varints:
+ *   'C' src_off len          copy len bytes from the source image
+ *   'A' src_off len bytes    len bytes, each added (mod 256) to the source byte at the same position
+ *   'I' len bytes            insert literal bytes
+ *   'E'                      end; the output must be exactly dst_size bytes
+ *
+ * The applier is fed inflated bytes in any split and keeps no more than DELTA_CHUNK bytes of state. The
+ * source and target images are reached only through callbacks, so the same code runs on the device
+ * (partitions) and on the host (files).
+ */
+
+#ifndef WB_DELTA_APPLY_H
+#define WB_DELTA_APPLY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DELTA_HDR_SIZE 80
+#define DELTA_CHUNK    256
+
+typedef enum {
+    DELTA_OK = 0,
+    DELTA_ERR_FORMAT = -1,   /* bad magic, unknown op, overlong varint */
+    DELTA_ERR_RANGE = -2,    /* op outside the source, or output past dst_size */
+    DELTA_ERR_IO = -3,       /* a callback failed */
+} delta_status_t;
+
+typedef struct {
+    uint32_t src_size;
+    uint32_t dst_size;
+    uint8_t src_sha[32];
+    uint8_t dst_sha[32];
+} delta_hdr_t;
+
+typedef int (*delta_read_fn)(void *ctx, uint32_t off, void *buf, size_t len);   /* 0 on success */
+typedef int (*delta_write_fn)(void *ctx, const void *buf, size_t len);           /* 0 on success */
+
+typedef struct {
+    delta_read_fn read_src;
+    delta_write_fn write_dst;
+    void *ctx;
+    uint32_t src_size;
+    uint32_t dst_size;
+    uint32_t written;
+    uint8_t state;
+    uint8_t op;
+    uint8_t field;       /* index of the varint being parsed */
+    uint8_t shift;
+    uint32_t val[2];
+    uint32_t src_off;
+    uint32_t remaining;
+    bool done;
+    uint8_t buf[DELTA_CHUNK];
+} delta_t;
+
+bool delta_hdr_parse(const uint8_t raw[DELTA_HDR_SIZE], delta_hdr_t *out);
+void delta_init(delta_t *d, const delta_hdr_t *hdr, delta_read_fn read_src, delta_write_fn write_dst, void *ctx);
+/* Feeds inflated op-stream bytes. After an error the applier stays failed. */
+delta_status_t delta_feed(delta_t *d, const uint8_t *data, size_t len);
+/* True once 'E' was seen and exactly dst_size bytes were written. */
+bool delta_done(const delta_t *d);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
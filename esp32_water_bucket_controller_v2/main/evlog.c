@@ -0,0 +1,326 @@
+/*
+ * evlog.c - Event journal in a ring of flash sectors; format and recovery rules in evlog.h.
+ */
+
+#include <string.h>
+#include "evlog.h"
+
+#define EVLOG_MAGIC     0x31454257u   /* "WBE1" */
+#define EVLOG_ERASED    0xFFu
+#define EVLOG_SECT_RECS ((EVLOG_SECTOR_MAX - EVLOG_HDR_SIZE) / EVLOG_REC_MIN)
+
+static uint32_t crc32_le(const uint8_t *p, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len--) {
+        crc ^= *p++;
+        for (int i = 0; i < 8; i++) {
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1u)));
+        }
+    }
+    return ~crc;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t)v;
+    p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);
+    p[3] = (uint8_t)(v >> 24);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static uint32_t sect_off(const evlog_t *ev, uint32_t s)
+{
+    return s * ev->fl.sector;
+}
+
+/* Sector in chain position k (0 = head). */
+static uint32_t chain_sector(const evlog_t *ev, uint32_t k)
+{
+    return (ev->head + ev->nsect - k) % ev->nsect;
+}
+
+static bool hdr_read(const evlog_t *ev, uint32_t s, uint32_t *seq)
+{
+    uint8_t h[EVLOG_HDR_SIZE];
+    if (ev->fl.read(ev->fl.ctx, sect_off(ev, s), h, sizeof(h)) != 0) {
+        return false;
+    }
+    if (get32(h) != EVLOG_MAGIC || get32(h + 12) != crc32_le(h, 12)) {
+        return false;
+    }
+    *seq = get32(h + 4);
+    return true;
+}
+
+static int hdr_write(const evlog_t *ev, uint32_t s, uint32_t seq)
+{
+    uint8_t h[EVLOG_HDR_SIZE];
+    put32(h, EVLOG_MAGIC);
+    put32(h + 4, seq);
+    put32(h + 8, 0xFFFFFFFFu);
+    put32(h + 12, crc32_le(h, 12));
+    return ev->fl.write(ev->fl.ctx, sect_off(ev, s), h, sizeof(h));
+}
+
+static size_t rec_encode(const evlog_rec_t *r, uint16_t boot, uint8_t *out)
+{
+    size_t tl = strnlen(r->text, EVLOG_TEXT_MAX - 1);
+    size_t len = EVLOG_REC_MIN + ((tl + 3u) & ~3u);
+    memset(out, 0, len);
+    out[0] = (uint8_t)len;
+    out[1] = r->code;
+    out[2] = (uint8_t)boot;
+    out[3] = (uint8_t)(boot >> 8);
+    put32(out + 4, r->up_s);
+    put32(out + 8, r->wall);
+    put32(out + 12, (uint32_t)r->a);
+    put32(out + 16, (uint32_t)r->b);
+    memcpy(out + 20, r->text, tl);
+    put32(out + len - 4, crc32_le(out, len - 4));
+    return len;
+}
+
+/* True if raw[0..len) is a whole record whose CRC matches. */
+static bool rec_valid(const uint8_t *raw, size_t len)
+{
+    return len >= EVLOG_REC_MIN && len <= EVLOG_REC_MAX && len % 4 == 0 &&
+           get32(raw + len - 4) == crc32_le(raw, len - 4);
+}
+
+static void rec_decode(const uint8_t *raw, evlog_rec_t *r)
+{
+    size_t len = raw[0];
+    r->code = raw[1];
+    r->boot = (uint16_t)(raw[2] | raw[3] << 8);
+    r->up_s = get32(raw + 4);
+    r->wall = get32(raw + 8);
+    r->a = (int32_t)get32(raw + 12);
+    r->b = (int32_t)get32(raw + 16);
+    size_t tl = len - EVLOG_REC_MIN;   /* text and its zero padding */
+    if (tl > EVLOG_TEXT_MAX - 1u) {
+        tl = EVLOG_TEXT_MAX - 1u;
+    }
+    memcpy(r->text, raw + 20, tl);
+    r->text[tl] = '\0';
+}
+
+/*
+ * Walks the records of sector s. offs (if not NULL) gets each record's offset. *end is where the
+ * next record would go, *damaged is set if the walk stopped on something that is neither a valid
+ * record nor erased flash.
+ */
+static uint32_t sector_scan(const evlog_t *ev, uint32_t s, uint16_t *offs, uint32_t *end, bool *damaged)
+{
+    uint32_t n = 0;
+    uint32_t off = EVLOG_HDR_SIZE;
+    *damaged = false;
+    while (off < ev->fl.sector) {
+        uint8_t raw[EVLOG_REC_MAX];
+        size_t want = ev->fl.sector - off < sizeof(raw) ? ev->fl.sector - off : sizeof(raw);
+        if (ev->fl.read(ev->fl.ctx, sect_off(ev, s) + off, raw, want) != 0) {
+            *damaged = true;
+            break;
+        }
+        if (raw[0] == EVLOG_ERASED) {
+            break;
+        }
+        if (raw[0] > want || !rec_valid(raw, raw[0])) {
+            *damaged = true;
+            break;
+        }
+        if (offs != NULL && n < EVLOG_SECT_RECS) {
+            offs[n] = (uint16_t)off;
+        }
+        n++;
+        off += raw[0];
+    }
+    *end = off;
+    return n;
+}
+
+/* True if the head sector is erased from head_off on, so appends can go there. */
+static bool head_tail_erased(const evlog_t *ev)
+{
+    uint8_t buf[64];
+    for (uint32_t off = ev->head_off; off < ev->fl.sector; off += sizeof(buf)) {
+        size_t n = ev->fl.sector - off < sizeof(buf) ? ev->fl.sector - off : sizeof(buf);
+        if (ev->fl.read(ev->fl.ctx, sect_off(ev, ev->head) + off, buf, n) != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < n; i++) {
+            if (buf[i] != EVLOG_ERASED) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/* Erases the sector after the head and makes it the head; drops the oldest sector if the ring is full. */
+static evlog_status_t rotate(evlog_t *ev)
+{
+    uint32_t next = (ev->head + 1u) % ev->nsect;
+    if (ev->chain == ev->nsect) {
+        ev->total -= ev->counts[next];
+        ev->chain--;
+    }
+    ev->counts[next] = 0;
+    ev->erases++;
+    if (ev->fl.erase(ev->fl.ctx, sect_off(ev, next), ev->fl.sector) != 0 || hdr_write(ev, next, ev->head_seq + 1u) != 0) {
+        /* The ring now ends before `next`; the next append tries the sector after it again. */
+        ev->sealed = true;
+        return EVLOG_ERR_IO;
+    }
+    ev->head = next;
+    ev->head_seq++;
+    ev->head_off = EVLOG_HDR_SIZE;
+    ev->chain++;
+    ev->sealed = false;
+    return EVLOG_OK;
+}
+
+evlog_status_t evlog_open(evlog_t *ev, const evlog_flash_t *fl)
+{
+    memset(ev, 0, sizeof(*ev));
+    ev->fl = *fl;
+    if (fl->sector == 0 || fl->sector > EVLOG_SECTOR_MAX || fl->sector <= EVLOG_HDR_SIZE + EVLOG_REC_MAX ||
+        fl->size % fl->sector != 0) {
+        return EVLOG_ERR_GEOMETRY;
+    }
+    ev->nsect = fl->size / fl->sector;
+    if (ev->nsect < 2 || ev->nsect > EVLOG_MAX_SECTORS) {
+        return EVLOG_ERR_GEOMETRY;
+    }
+    bool found = false;
+    for (uint32_t s = 0; s < ev->nsect; s++) {
+        uint32_t seq;
+        if (hdr_read(ev, s, &seq) && (!found || (int32_t)(seq - ev->head_seq) > 0)) {
+            found = true;
+            ev->head = s;
+            ev->head_seq = seq;
+        }
+    }
+    ev->boot = 1;
+    if (!found) {
+        /* Blank or foreign region: start the ring at sector 0. */
+        ev->head = ev->nsect - 1u;
+        ev->head_seq = 0;
+        return rotate(ev);
+    }
+    for (uint32_t k = 0; k < ev->nsect; k++) {
+        uint32_t s = chain_sector(ev, k);
+        uint32_t seq;
+        if (!hdr_read(ev, s, &seq) || seq != ev->head_seq - k) {
+            break;
+        }
+        uint32_t end;
+        bool damaged;
+        ev->counts[s] = (uint16_t)sector_scan(ev, s, NULL, &end, &damaged);
+        ev->total += ev->counts[s];
+        ev->chain++;
+        if (k == 0) {
+            ev->head_off = end;
+            ev->sealed = damaged || !head_tail_erased(ev);
+        }
+    }
+    evlog_rec_t last;
+    if (evlog_read(ev, 0, &last, 1) == 1) {
+        ev->boot = (uint16_t)(last.boot + 1u);
+        if (ev->boot == 0) {
+            ev->boot = 1;
+        }
+    }
+    return EVLOG_OK;
+}
+
+static evlog_status_t batch_write(evlog_t *ev, const uint8_t *buf, size_t len, uint32_t nrec)
+{
+    if (len == 0) {
+        return EVLOG_OK;
+    }
+    if (ev->fl.write(ev->fl.ctx, sect_off(ev, ev->head) + ev->head_off, buf, len) != 0) {
+        /* Part of the batch may be on flash; recovery would stop there too. */
+        ev->sealed = true;
+        return EVLOG_ERR_IO;
+    }
+    ev->head_off += (uint32_t)len;
+    ev->counts[ev->head] = (uint16_t)(ev->counts[ev->head] + nrec);
+    ev->total += nrec;
+    return EVLOG_OK;
+}
+
+evlog_status_t evlog_append(evlog_t *ev, const evlog_rec_t *recs, size_t n)
+{
+    uint8_t batch[EVLOG_BATCH_BYTES];
+    size_t blen = 0;
+    uint32_t bn = 0;
+    for (size_t i = 0; i < n; i++) {
+        uint8_t raw[EVLOG_REC_MAX];
+        size_t len = rec_encode(&recs[i], ev->boot, raw);
+        if (ev->sealed || ev->head_off + blen + len > ev->fl.sector) {
+            evlog_status_t st = batch_write(ev, batch, blen, bn);
+            blen = 0;
+            bn = 0;
+            if (st != EVLOG_OK || (st = rotate(ev)) != EVLOG_OK) {
+                return st;
+            }
+        } else if (blen + len > sizeof(batch)) {
+            evlog_status_t st = batch_write(ev, batch, blen, bn);
+            blen = 0;
+            bn = 0;
+            if (st != EVLOG_OK) {
+                return st;
+            }
+        }
+        memcpy(batch + blen, raw, len);
+        blen += len;
+        bn++;
+    }
+    return batch_write(ev, batch, blen, bn);
+}
+
+size_t evlog_read(evlog_t *ev, size_t from_newest, evlog_rec_t *out, size_t max)
+{
+    size_t n = 0;
+    size_t skip = from_newest;
+    for (uint32_t k = 0; k < ev->chain && n < max; k++) {
+        uint32_t s = chain_sector(ev, k);
+        if (skip >= ev->counts[s]) {
+            skip -= ev->counts[s];
+            continue;
+        }
+        uint16_t offs[EVLOG_SECT_RECS];
+        uint32_t end;
+        bool damaged;
+        uint32_t c = sector_scan(ev, s, offs, &end, &damaged);
+        if (c > ev->counts[s]) {
+            c = ev->counts[s];
+        }
+        for (int32_t i = (int32_t)c - 1 - (int32_t)skip; i >= 0 && n < max; i--) {
+            uint8_t raw[EVLOG_REC_MAX];
+            if (ev->fl.read(ev->fl.ctx, sect_off(ev, s) + offs[i], raw, 1) != 0 ||
+                ev->fl.read(ev->fl.ctx, sect_off(ev, s) + offs[i], raw, raw[0]) != 0) {
+                return n;
+            }
+            rec_decode(raw, &out[n++]);
+        }
+        skip = 0;
+    }
+    return n;
+}
+
+uint32_t evlog_count(const evlog_t *ev)
+{
+    return ev->total;
+}
+
+uint16_t evlog_boot(const evlog_t *ev)
+{
+    return ev->boot;
+}
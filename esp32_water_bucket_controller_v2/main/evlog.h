@@ -0,0 +1,93 @@
+/*
+ * evlog.h - Append-only event journal in a raw flash region (the "evlog" partition).
+ *
+ * The region is a ring of erase sectors. Each sector in use starts with a 16-byte header (magic
+ * "WBE1", sequence number, CRC-32); sequence numbers go up by one from sector to sector around the
+ * ring, so the newest sector is the one with the highest number and the history is every sector
+ * before it whose number is one less. Records are packed after the header (little endian):
+ *   len u8 (total bytes, multiple of 4), code u8, boot u16, up_s u32, wall u32, a i32, b i32,
+ *   text (0..EVLOG_TEXT_MAX-1 bytes, zero padded), CRC-32 of everything before it
+ * An erased byte (0xFF) where a length should be ends the sector. When the newest sector is full the
+ * next one round the ring is erased, which drops the oldest, so every sector is erased in turn.
+ *
+ * evlog_open() recovers the tail after a reset: a record that fails its CRC (a write cut short)
+ * ends its sector, and the next append starts a fresh one. Flash is reached only through callbacks,
+ * so the same code runs on the device (evlog_task.c) and on the host (tools/evlog_test.c).
+ */
+
+#ifndef WB_EVLOG_H
+#define WB_EVLOG_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define EVLOG_TEXT_MAX     24      /* including the NUL */
+#define EVLOG_MAX_SECTORS  64
+#define EVLOG_SECTOR_MAX   4096
+#define EVLOG_HDR_SIZE     16
+#define EVLOG_REC_MIN      24      /* record with no text */
+#define EVLOG_REC_MAX      (EVLOG_REC_MIN + EVLOG_TEXT_MAX)
+#define EVLOG_BATCH_BYTES  512     /* records encoded per flash write */
+
+typedef enum {
+    EVLOG_OK = 0,
+    EVLOG_ERR_GEOMETRY = -1,   /* region not a whole number of sectors, too small or too big */
+    EVLOG_ERR_IO = -2,         /* a callback failed */
+} evlog_status_t;
+
+typedef struct {
+    uint16_t boot;             /* evlog_boot() of the boot that wrote it */
+    uint8_t code;
+    uint32_t up_s;
+    uint32_t wall;             /* unix time, 0 if the clock was not set */
+    int32_t a;
+    int32_t b;
+    char text[EVLOG_TEXT_MAX];
+} evlog_rec_t;
+
+typedef int (*evlog_read_fn)(void *ctx, uint32_t off, void *buf, size_t len);    /* 0 on success */
+typedef int (*evlog_write_fn)(void *ctx, uint32_t off, const void *buf, size_t len);
+typedef int (*evlog_erase_fn)(void *ctx, uint32_t off, size_t len);             /* whole sectors */
+
+typedef struct {
+    evlog_read_fn read;
+    evlog_write_fn write;
+    evlog_erase_fn erase;
+    void *ctx;
+    uint32_t size;
+    uint32_t sector;
+} evlog_flash_t;
+
+typedef struct {
+    evlog_flash_t fl;
+    uint32_t nsect;
+    uint32_t head;                       /* sector being appended to */
+    uint32_t chain;                      /* sectors of history, head included */
+    uint32_t head_seq;
+    uint32_t head_off;                   /* next write offset in the head sector */
+    bool sealed;                         /* head ends in a damaged record; append starts a new sector */
+    uint16_t boot;
+    uint16_t counts[EVLOG_MAX_SECTORS];  /* records in each sector of the chain */
+    uint32_t total;
+    uint32_t erases;                     /* sector erases since evlog_open() */
+} evlog_t;
+
+/* Recovers the journal (formats the region if it holds none) and starts a new boot number. */
+evlog_status_t evlog_open(evlog_t *ev, const evlog_flash_t *fl);
+/* Appends n records (their boot field is ignored), with as few flash writes as fit. */
+evlog_status_t evlog_append(evlog_t *ev, const evlog_rec_t *recs, size_t n);
+/* Copies up to max records into out, newest first, starting `from_newest` records back. */
+size_t evlog_read(evlog_t *ev, size_t from_newest, evlog_rec_t *out, size_t max);
+uint32_t evlog_count(const evlog_t *ev);
+uint16_t evlog_boot(const evlog_t *ev);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
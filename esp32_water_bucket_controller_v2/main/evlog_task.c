@@ -0,0 +1,213 @@
+/*
+ * evlog_task.c - Keeps the UI event log across resets and OTA updates in the "evlog" flash partition
+ * (format in evlog.h). ui_log hands each entry to evlog_put(), which only queues it; the "evlog" task
+ * collects up to EVLOG_TASK_BATCH entries, or whatever arrived within WB_EVLOG_FLUSH_MS of the first,
+ * and writes them with one evlog_append(). A full queue is counted and written as a UI_LOG_LOST entry.
+ *
+ * Readers (the logs page history, water_bucket/cmd/evlog) share the journal with the writer under
+ * s_ev_mux; only they wait on it. water_bucket/cmd/evlog takes "[FROM] [COUNT]" (entries back from the
+ * newest, default 0 and WB_EVLOG_DUMP_MAX) and publishes them newest first to water_bucket/state/evlog:
+ *   {"total":N,"boot":N,"from":N,"events":[[boot,uptime_s,unix_or_0,"text"],...]}
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "json_wr.h"
+#include "priv.h"
+#include "wb_config.h"
+
+#ifndef WB_EVLOG_FLUSH_MS
+#define WB_EVLOG_FLUSH_MS 5000
+#endif
+#ifndef WB_EVLOG_QUEUE
+#define WB_EVLOG_QUEUE 32
+#endif
+#ifndef WB_EVLOG_DUMP_MAX
+#define WB_EVLOG_DUMP_MAX 20
+#endif
+
+#define EVLOG_PART_SUBTYPE 0x40
+#define EVLOG_TASK_BATCH   16
+
+static const char *TAG = "wb";
+static const char *s_topic_cmd_evlog = "water_bucket/cmd/evlog";
+static const char *s_topic_state_evlog = "water_bucket/state/evlog";
+
+static const esp_partition_t *s_part;
+static evlog_t s_ev;
+static SemaphoreHandle_t s_ev_mux;
+static QueueHandle_t s_ev_q;
+static uint32_t s_ev_lost;          /* evlog_put() calls that found the queue full; __atomic */
+
+static int part_read(void *ctx, uint32_t off, void *buf, size_t len)
+{
+    return esp_partition_read((const esp_partition_t *)ctx, off, buf, len) == ESP_OK ? 0 : -1;
+}
+
+static int part_write(void *ctx, uint32_t off, const void *buf, size_t len)
+{
+    return esp_partition_write((const esp_partition_t *)ctx, off, buf, len) == ESP_OK ? 0 : -1;
+}
+
+static int part_erase(void *ctx, uint32_t off, size_t len)
+{
+    return esp_partition_erase_range((const esp_partition_t *)ctx, off, len) == ESP_OK ? 0 : -1;
+}
+
+void evlog_put(const evlog_rec_t *rec)
+{
+    if (s_ev_q == NULL) {
+        return;
+    }
+    if (xQueueSend(s_ev_q, rec, 0) != pdTRUE) {
+        __atomic_fetch_add(&s_ev_lost, 1u, __ATOMIC_RELAXED);
+    }
+}
+
+size_t evlog_history(size_t from_newest, evlog_rec_t *out, size_t max)
+{
+    if (s_ev_mux == NULL || xSemaphoreTake(s_ev_mux, pdMS_TO_TICKS(500)) != pdTRUE) {
+        return 0;
+    }
+    size_t n = evlog_read(&s_ev, from_newest, out, max);
+    xSemaphoreGive(s_ev_mux);
+    return n;
+}
+
+uint32_t evlog_total(void)
+{
+    return s_ev_mux != NULL ? evlog_count(&s_ev) : 0;
+}
+
+static void evlog_write(evlog_rec_t *batch, size_t n)
+{
+    xSemaphoreTake(s_ev_mux, portMAX_DELAY);
+    evlog_status_t st = evlog_append(&s_ev, batch, n);
+    xSemaphoreGive(s_ev_mux);
+    if (st != EVLOG_OK) {
+        ESP_LOGW(TAG, "evlog: write of %u entries failed (%d)", (unsigned)n, (int)st);
+    }
+}
+
+static void evlog_task(void *arg)
+{
+    (void)arg;
+    static evlog_rec_t batch[EVLOG_TASK_BATCH];
+    size_t n = 0;
+    TickType_t first = 0;
+    for (;;) {
+        TickType_t wait = portMAX_DELAY;
+        if (n > 0) {
+            TickType_t age = xTaskGetTickCount() - first;
+            wait = age < pdMS_TO_TICKS(WB_EVLOG_FLUSH_MS) ? pdMS_TO_TICKS(WB_EVLOG_FLUSH_MS) - age : 0;
+        }
+        if (xQueueReceive(s_ev_q, &batch[n], wait) == pdTRUE) {
+            if (n++ == 0) {
+                first = xTaskGetTickCount();
+            }
+            if (n < EVLOG_TASK_BATCH - 1) {
+                continue;
+            }
+        }
+        uint32_t lost = __atomic_exchange_n(&s_ev_lost, 0u, __ATOMIC_RELAXED);
+        if (lost > 0) {
+            evlog_rec_t *r = &batch[n++];
+            memset(r, 0, sizeof(*r));
+            r->code = UI_LOG_LOST;
+            r->a = (int32_t)lost;
+            r->up_s = (uint32_t)(esp_timer_get_time() / 1000000LL);
+        }
+        if (n > 0) {
+            evlog_write(batch, n);
+            n = 0;
+        }
+    }
+}
+
+static void on_cmd_evlog(esp_mqtt_event_handle_t event, void *ctx)
+{
+    (void)ctx;
+    char arg[24];
+    size_t len = event->data_len < (int)sizeof(arg) - 1 ? (size_t)event->data_len : sizeof(arg) - 1;
+    memcpy(arg, event->data, len);
+    arg[len] = '\0';
+    char *p = arg;
+    unsigned long from = strtoul(p, &p, 10);
+    unsigned long count = strtoul(p, &p, 10);
+    if (count == 0 || count > WB_EVLOG_DUMP_MAX) {
+        count = WB_EVLOG_DUMP_MAX;
+    }
+    static evlog_rec_t recs[WB_EVLOG_DUMP_MAX];
+    static char json[96 * WB_EVLOG_DUMP_MAX + 96];
+    size_t n = evlog_history(from, recs, count);
+    jw_t w;
+    jw_init(&w, json, sizeof(json));
+    jw_obj_begin(&w);
+    jw_key(&w, "total");
+    jw_uint(&w, evlog_total());
+    jw_key(&w, "boot");
+    jw_uint(&w, evlog_boot(&s_ev));
+    jw_key(&w, "from");
+    jw_uint(&w, (uint32_t)from);
+    jw_key(&w, "events");
+    jw_arr_begin(&w);
+    for (size_t i = 0; i < n; i++) {
+        char msg[64];
+        ui_log_describe(recs[i].code, recs[i].a, recs[i].b, recs[i].text, msg, sizeof(msg));
+        jw_arr_begin(&w);
+        jw_uint(&w, recs[i].boot);
+        jw_uint(&w, recs[i].up_s);
+        jw_uint(&w, recs[i].wall);
+        jw_str(&w, msg);
+        jw_arr_end(&w);
+    }
+    jw_arr_end(&w);
+    jw_obj_end(&w);
+    int out = jw_finish(&w);
+    if (out > 0 && s_mqtt_client != NULL) {
+        esp_mqtt_client_publish(s_mqtt_client, s_topic_state_evlog, json, out, 0, 0);
+    }
+}
+
+void evlog_start(void)
+{
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)EVLOG_PART_SUBTYPE, "evlog");
+    if (s_part == NULL) {
+        ESP_LOGW(TAG, "evlog: no evlog partition, UI events are not kept across resets");
+        return;
+    }
+    const evlog_flash_t fl = {
+        .read = part_read,
+        .write = part_write,
+        .erase = part_erase,
+        .ctx = (void *)s_part,
+        .size = s_part->size,
+        .sector = s_part->erase_size,
+    };
+    evlog_status_t st = evlog_open(&s_ev, &fl);
+    if (st != EVLOG_OK) {
+        ESP_LOGE(TAG, "evlog: open failed (%d), partition %lu bytes", (int)st, (unsigned long)s_part->size);
+        return;
+    }
+    s_ev_mux = xSemaphoreCreateMutex();
+    s_ev_q = xQueueCreate(WB_EVLOG_QUEUE, sizeof(evlog_rec_t));
+    if (s_ev_mux == NULL || s_ev_q == NULL ||
+        xTaskCreate(evlog_task, "evlog", 3072, NULL, 2, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "evlog: task create failed");
+        s_ev_q = NULL;
+        return;
+    }
+    mqtt_topic_register(s_topic_cmd_evlog, 1, on_cmd_evlog, NULL);
+    ESP_LOGI(TAG, "evlog: boot %u, %lu entries in %lu sectors", (unsigned)evlog_boot(&s_ev),
+             (unsigned long)evlog_count(&s_ev), (unsigned long)s_ev.chain);
+    ui_log_post(UI_LOG_BOOT, evlog_boot(&s_ev), (int32_t)esp_reset_reason());
+}
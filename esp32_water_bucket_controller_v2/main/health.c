@@ -0,0 +1,233 @@
+/*
+ * health.c - Boot health gate. health_start() runs on every boot; the boot is healthy once each stage
+ * in WB_HEALTH_STAGES has been reported: WiFi got an IP, MQTT connected, a UI frame reached the
+ * panel, and the level timer ran WB_HEALTH_LOOP_CYCLES times.
+ *
+ * After an OTA the image stays ESP_OTA_IMG_PENDING_VERIFY until then; if the stages are not all in
+ * within WB_HEALTH_DEADLINE_S the app is marked invalid and the bootloader rolls back. On other boots a
+ * missed deadline is only logged. Once the image is marked valid, an OTA job ota.c deferred while it
+ * was pending (the update slot was the rollback image) is started.
+ *
+ * Boot-to-healthy time is kept in NVS namespace "wb_health" for the last HEALTH_HIST firmware versions
+ * and published (retained) to water_bucket/state/boot:
+ *   {"version":"..","healthy_ms":N,"ip_ms":N,"mqtt_ms":N,"ui_ms":N,"loop_ms":N,"level_ms":N,"wifi":"fast","ota":b,
+ *    "best_ms":N,"boots":N,"prev_version":"..","prev_ms":N}
+ * with prev_* from the version that ran before, so a slower startup shows up next to the old figure.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "json_wr.h"
+#include "nvs.h"
+#include "priv.h"
+#include "wb_config.h"
+
+#ifndef WB_HEALTH_DEADLINE_S
+#define WB_HEALTH_DEADLINE_S 180
+#endif
+#ifndef WB_HEALTH_LOOP_CYCLES
+#define WB_HEALTH_LOOP_CYCLES 25
+#endif
+#ifndef WB_HEALTH_STAGES
+#define WB_HEALTH_STAGES HEALTH_ALL
+#endif
+
+#define HEALTH_ALL     ((1u << HEALTH_STAGE_COUNT) - 1u)
+#define HEALTH_HIST    4
+#define HEALTH_NVS_NS  "wb_health"
+
+static const char *TAG = "wb";
+static const char *s_topic_state_boot = "water_bucket/state/boot";
+static const char *s_stage_names[HEALTH_STAGE_COUNT] = { "ip", "mqtt", "ui", "loop" };
+
+typedef struct {
+    char version[32];
+    uint32_t last_ms;
+    uint32_t best_ms;
+    uint32_t boots;
+} health_rec_t;
+
+static TaskHandle_t s_health_task;
+static uint32_t s_stages;                          /* bits of health_stage_t; __atomic */
+static uint32_t s_stage_ms[HEALTH_STAGE_COUNT];    /* written before the bit is set */
+static int s_loop_left = WB_HEALTH_LOOP_CYCLES;   /* level timer task only */
+static bool s_pending_verify;
+
+void health_mark(health_stage_t stage)
+{
+    uint32_t bit = 1u << stage;
+    if ((__atomic_load_n(&s_stages, __ATOMIC_ACQUIRE) & bit) != 0) {
+        return;
+    }
+    s_stage_ms[stage] = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t old = __atomic_fetch_or(&s_stages, bit, __ATOMIC_ACQ_REL);
+    if ((old & bit) == 0) {
+        ESP_LOGI(TAG, "boot: stage %s at %lu ms", s_stage_names[stage], (unsigned long)s_stage_ms[stage]);
+        TaskHandle_t task = s_health_task;
+        if (task != NULL) {
+            xTaskNotifyGive(task);
+        }
+    }
+}
+
+void health_loop_tick(void)
+{
+    if (s_loop_left > 0 && --s_loop_left == 0) {
+        health_mark(HEALTH_STAGE_LOOP);
+    }
+}
+
+/* Moves this version's record to the front of the history and updates it; returns the count kept. */
+static size_t health_record(health_rec_t hist[HEALTH_HIST], const char *version, uint32_t ms)
+{
+    nvs_handle_t h;
+    size_t n = 0;
+    if (nvs_open(HEALTH_NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
+        return 0;
+    }
+    size_t len = sizeof(health_rec_t) * HEALTH_HIST;
+    if (nvs_get_blob(h, "hist", hist, &len) == ESP_OK && len % sizeof(health_rec_t) == 0) {
+        n = len / sizeof(health_rec_t);
+    }
+    health_rec_t cur = {0};
+    size_t at = n;
+    for (size_t i = 0; i < n; i++) {
+        if (strncmp(hist[i].version, version, sizeof(hist[i].version)) == 0) {
+            cur = hist[i];
+            at = i;
+            break;
+        }
+    }
+    if (at == n) {
+        strncpy(cur.version, version, sizeof(cur.version) - 1);
+        n = n < HEALTH_HIST ? n + 1 : HEALTH_HIST;
+        at = n - 1;
+    }
+    memmove(&hist[1], &hist[0], at * sizeof(health_rec_t));
+    cur.last_ms = ms;
+    cur.best_ms = cur.boots == 0 || ms < cur.best_ms ? ms : cur.best_ms;
+    cur.boots++;
+    hist[0] = cur;
+    nvs_set_blob(h, "hist", hist, n * sizeof(health_rec_t));
+    nvs_commit(h);
+    nvs_close(h);
+    return n;
+}
+
+static void health_publish(const health_rec_t *hist, size_t n, uint32_t ms)
+{
+    static char json[320];
+    jw_t w;
+    jw_init(&w, json, sizeof(json));
+    jw_obj_begin(&w);
+    jw_key(&w, "version");
+    jw_str(&w, esp_app_get_description()->version);
+    jw_key(&w, "healthy_ms");
+    jw_uint(&w, ms);
+    for (int i = 0; i < HEALTH_STAGE_COUNT; i++) {
+        char key[12];
+        strcpy(key, s_stage_names[i]);
+        strcat(key, "_ms");
+        jw_key(&w, key);
+        jw_uint(&w, s_stage_ms[i]);
+    }
+    jw_key(&w, "level_ms");
+    jw_uint(&w, level_first_read_ms());
+    jw_key(&w, "wifi");
+    jw_str(&w, wifi_connect_path());
+    jw_key(&w, "ota");
+    jw_bool(&w, s_pending_verify);
+    if (n > 0) {
+        jw_key(&w, "best_ms");
+        jw_uint(&w, hist[0].best_ms);
+        jw_key(&w, "boots");
+        jw_uint(&w, hist[0].boots);
+    }
+    if (n > 1) {
+        jw_key(&w, "prev_version");
+        jw_str(&w, hist[1].version);
+        jw_key(&w, "prev_ms");
+        jw_uint(&w, hist[1].last_ms);
+    }
+    jw_obj_end(&w);
+    int len = jw_finish(&w);
+    if (len > 0 && s_mqtt_client != NULL && s_mqtt_connected_state) {
+        esp_mqtt_client_publish(s_mqtt_client, s_topic_state_boot, json, len, 1, 1);
+    }
+}
+
+static void health_missing_log(uint32_t have)
+{
+    for (int i = 0; i < HEALTH_STAGE_COUNT; i++) {
+        if ((WB_HEALTH_STAGES & ~have & (1u << i)) != 0) {
+            ESP_LOGE(TAG, "boot: stage %s missing", s_stage_names[i]);
+        }
+    }
+}
+
+static void health_task(void *arg)
+{
+    (void)arg;
+    const int64_t deadline_us = (int64_t)WB_HEALTH_DEADLINE_S * 1000000;
+    bool late = false;
+    for (;;) {
+        uint32_t have = __atomic_load_n(&s_stages, __ATOMIC_ACQUIRE);
+        if ((have & WB_HEALTH_STAGES) == WB_HEALTH_STAGES) {
+            break;
+        }
+        int64_t left_us = deadline_us - esp_timer_get_time();
+        if (left_us <= 0 && !late) {
+            late = true;
+            health_missing_log(have);
+            if (s_pending_verify) {
+                ESP_LOGE(TAG, "boot: new image not healthy after %d s, rolling back", WB_HEALTH_DEADLINE_S);
+                esp_ota_mark_app_invalid_rollback_and_reboot();
+            }
+            ESP_LOGW(TAG, "boot: not healthy after %d s", WB_HEALTH_DEADLINE_S);
+        }
+        ulTaskNotifyTake(pdTRUE, late ? portMAX_DELAY : pdMS_TO_TICKS(left_us / 1000) + 1);
+    }
+    uint32_t ms = 0;
+    for (int i = 0; i < HEALTH_STAGE_COUNT; i++) {
+        if ((WB_HEALTH_STAGES & (1u << i)) != 0 && s_stage_ms[i] > ms) {
+            ms = s_stage_ms[i];
+        }
+    }
+    if (s_pending_verify) {
+        ESP_LOGI(TAG, "boot: new image healthy, mark valid");
+        if (esp_ota_mark_app_valid_cancel_rollback() == ESP_OK) {
+            ota_resume_pending();  // an OTA command that came in meanwhile was only saved
+        }
+    }
+    const char *version = esp_app_get_description()->version;
+    health_rec_t hist[HEALTH_HIST];
+    size_t n = health_record(hist, version, ms);
+    if (n > 1) {
+        ESP_LOGI(TAG, "boot: healthy in %lu ms (%s; %s took %lu ms)", (unsigned long)ms, version, hist[1].version,
+                 (unsigned long)hist[1].last_ms);
+    } else {
+        ESP_LOGI(TAG, "boot: healthy in %lu ms (%s)", (unsigned long)ms, version);
+    }
+    health_publish(hist, n, ms);
+    s_health_task = NULL;
+    vTaskDelete(NULL);
+}
+
+void health_start(void)
+{
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    esp_ota_img_states_t state;
+    s_pending_verify = running != NULL && esp_ota_get_state_partition(running, &state) == ESP_OK &&
+                       state == ESP_OTA_IMG_PENDING_VERIFY;
+    if (s_pending_verify) {
+        ESP_LOGI(TAG, "boot: first boot after OTA, %d s to become healthy", WB_HEALTH_DEADLINE_S);
+    }
+    if (xTaskCreate(health_task, "health", 3072, NULL, 3, &s_health_task) != pdPASS) {
+        ESP_LOGE(TAG, "boot: health task create");
+        s_health_task = NULL;
+    }
+}
@@ -0,0 +1,310 @@
+/*
+ * journal.c - Offline telemetry journal. While MQTT is down, mqtt_pub_set() records each state
+ * transition here (timestamp, topic, value) in a fixed RAM ring of WB_JOURNAL_CAP records. With
+ * WB_JOURNAL_FLASH_SPILL, a ring 3/4 full moves its oldest half into NVS blobs (up to
+ * WB_JOURNAL_SPILL_CHUNKS) from journal_service(); anything beyond that is dropped and counted.
+ *
+ * On MQTT_EVENT_CONNECTED, journal_replay() sends spilled chunks then the RAM ring, oldest first, as
+ * batched JSON documents on water_bucket/history:
+ *   {"dropped":N,"events":[[ts,clock,"level_1","1"],...]}   clock: 1 = unix time, 0 = seconds since boot
+ * Replay (MQTT task) and spill (mqtt_pub task) each hold s_jr_lock for their whole run, so a chunk is
+ * never spilled to NVS behind or in the middle of a replay and published out of order on the next one.
+ * Replay stops at the first batch the client refuses: a chunk is erased (or shortened) only after its
+ * batches went out, RAM records go back to the front of the ring, and the dropped count is restored,
+ * so the rest is sent on the next connect.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "nvs.h"
+#include "priv.h"
+#include "wb_config.h"
+
+#ifndef WB_JOURNAL_CAP
+#define WB_JOURNAL_CAP 128
+#endif
+#ifndef WB_JOURNAL_FLASH_SPILL
+#define WB_JOURNAL_FLASH_SPILL 0
+#endif
+#ifndef WB_JOURNAL_SPILL_CHUNKS
+#define WB_JOURNAL_SPILL_CHUNKS 8
+#endif
+
+#define JOURNAL_BATCH      32
+#define JOURNAL_SPILL_RECS (WB_JOURNAL_CAP / 2)
+#define JOURNAL_SPILL_AT   (WB_JOURNAL_CAP * 3 / 4)
+#define JOURNAL_VALUE_MAX  6
+#define JOURNAL_NVS_NS     "wb_jrnl"
+#define JOURNAL_TS_UNIX    0x01u
+
+static const char *TAG = "wb";
+
+typedef struct {
+    uint32_t ts;
+    uint8_t topic;
+    uint8_t flags;
+    uint8_t value_len;
+    char value[JOURNAL_VALUE_MAX];
+} journal_rec_t;
+
+static journal_rec_t s_ring[WB_JOURNAL_CAP];
+static size_t s_head;   /* next write */
+static size_t s_count;
+static uint32_t s_dropped;
+static bool s_spill_kicked;  /* journal_record() asked for journal_service(), which has not run yet */
+static portMUX_TYPE s_jr_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t s_jr_lock;  /* serializes journal_service() and journal_replay() */
+static char s_batch_buf[64 + JOURNAL_BATCH * 48];  /* MQTT task only */
+
+void journal_stamp(journal_stamp_t *out)
+{
+    time_t now = time(NULL);
+    out->unix_time = now > 1700000000;
+    out->ts = out->unix_time ? (uint32_t)now : (uint32_t)(esp_timer_get_time() / 1000000LL);
+}
+
+bool journal_record(wb_pub_topic_t topic, const char *value, size_t len, const journal_stamp_t *stamp)
+{
+    journal_rec_t r = {0};
+    r.ts = stamp->ts;
+    r.flags = stamp->unix_time ? JOURNAL_TS_UNIX : 0;
+    r.topic = (uint8_t)topic;
+    if (len > JOURNAL_VALUE_MAX) {
+        len = JOURNAL_VALUE_MAX;
+    }
+    memcpy(r.value, value, len);
+    r.value_len = (uint8_t)len;
+    taskENTER_CRITICAL(&s_jr_mux);
+    if (s_count == WB_JOURNAL_CAP) {
+        s_dropped++;  /* overwrite oldest */
+        s_count--;
+    }
+    s_ring[s_head] = r;
+    s_head = (s_head + 1U) % WB_JOURNAL_CAP;
+    s_count++;
+    bool spill = WB_JOURNAL_FLASH_SPILL && s_count >= JOURNAL_SPILL_AT && !s_spill_kicked;
+    if (spill) {
+        s_spill_kicked = true;
+    }
+    taskEXIT_CRITICAL(&s_jr_mux);
+    return spill;  /* journal_service runs on the mqtt_pub task */
+}
+
+/* Pops up to max oldest records; returns how many. */
+static size_t journal_pop(journal_rec_t *out, size_t max)
+{
+    taskENTER_CRITICAL(&s_jr_mux);
+    size_t n = s_count < max ? s_count : max;
+    size_t tail = (s_head + WB_JOURNAL_CAP - s_count) % WB_JOURNAL_CAP;
+    for (size_t i = 0; i < n; i++) {
+        out[i] = s_ring[(tail + i) % WB_JOURNAL_CAP];
+    }
+    s_count -= n;
+    taskEXIT_CRITICAL(&s_jr_mux);
+    return n;
+}
+
+/* Puts records popped for a replay that failed back in front of the ring; what no longer fits (newer
+ * records arrived meanwhile) is counted as dropped. */
+static void journal_unpop(const journal_rec_t *recs, size_t n)
+{
+    taskENTER_CRITICAL(&s_jr_mux);
+    size_t room = WB_JOURNAL_CAP - s_count;
+    size_t keep = n < room ? n : room;
+    s_dropped += (uint32_t)(n - keep);
+    size_t tail = (s_head + WB_JOURNAL_CAP - s_count) % WB_JOURNAL_CAP;
+    for (size_t i = 0; i < keep; i++) {
+        tail = (tail + WB_JOURNAL_CAP - 1U) % WB_JOURNAL_CAP;
+        s_ring[tail] = recs[n - 1U - i];   // newest of the batch first, so the oldest ends up at the tail
+    }
+    s_count += keep;
+    taskEXIT_CRITICAL(&s_jr_mux);
+}
+
+static uint32_t journal_take_dropped(void)
+{
+    taskENTER_CRITICAL(&s_jr_mux);
+    uint32_t d = s_dropped;
+    s_dropped = 0;
+    taskEXIT_CRITICAL(&s_jr_mux);
+    return d;
+}
+
+static void journal_put_dropped(uint32_t d)
+{
+    taskENTER_CRITICAL(&s_jr_mux);
+    s_dropped += d;
+    taskEXIT_CRITICAL(&s_jr_mux);
+}
+
+/* One document; a batch that does not fit in s_batch_buf is sent as two halves. True once all of it
+ * was accepted by the client. */
+static bool journal_publish_recs(esp_mqtt_client_handle_t client, const journal_rec_t *recs, size_t n,
+                                 uint32_t dropped)
+{
+    size_t cap = sizeof(s_batch_buf);
+    int len = snprintf(s_batch_buf, cap, "{\"dropped\":%lu,\"events\":[", (unsigned long)dropped);
+    for (size_t i = 0; i < n && len > 0 && (size_t)len < cap; i++) {
+        const char *name = mqtt_pub_topic_name((wb_pub_topic_t)recs[i].topic);
+        len += snprintf(s_batch_buf + len, cap - (size_t)len, "%s[%lu,%d,\"%s\",\"%.*s\"]",
+                        i ? "," : "", (unsigned long)recs[i].ts, (recs[i].flags & JOURNAL_TS_UNIX) ? 1 : 0,
+                        name, (int)recs[i].value_len, recs[i].value);
+    }
+    if (len <= 0 || (size_t)len + 3 > cap) {
+        if (n < 2) {
+            ESP_LOGW(TAG, "journal: event does not fit a batch, skipped");
+            return true;    // cannot happen with JOURNAL_VALUE_MAX; do not stall the replay on it
+        }
+        return journal_publish_recs(client, recs, n / 2, dropped) &&
+               journal_publish_recs(client, recs + n / 2, n - n / 2, 0);
+    }
+    len += snprintf(s_batch_buf + len, cap - (size_t)len, "]}");
+    return esp_mqtt_client_publish(client, "water_bucket/history", s_batch_buf, len, 1, 0) >= 0;
+}
+
+/* Sends recs with the dropped count; on failure the count is put back for the next attempt. */
+static bool journal_publish_batch(esp_mqtt_client_handle_t client, const journal_rec_t *recs, size_t n)
+{
+    uint32_t dropped = journal_take_dropped();
+    if (journal_publish_recs(client, recs, n, dropped)) {
+        return true;
+    }
+    journal_put_dropped(dropped);
+    return false;
+}
+
+#if WB_JOURNAL_FLASH_SPILL
+
+static void spill_key(char key[8], int i)
+{
+    snprintf(key, 8, "jr%d", i);
+}
+
+static void journal_spill(void)
+{
+    taskENTER_CRITICAL(&s_jr_mux);
+    bool full = s_count >= JOURNAL_SPILL_AT;
+    s_spill_kicked = false;  /* a record arriving from here on kicks again */
+    taskEXIT_CRITICAL(&s_jr_mux);
+    if (!full) {
+        return;
+    }
+    nvs_handle_t h;
+    if (nvs_open(JOURNAL_NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
+        return;
+    }
+    for (int i = 0; i < WB_JOURNAL_SPILL_CHUNKS; i++) {
+        char key[8];
+        size_t sz = 0;
+        spill_key(key, i);
+        if (nvs_get_blob(h, key, NULL, &sz) == ESP_OK) {
+            continue;
+        }
+        static journal_rec_t chunk[JOURNAL_SPILL_RECS];
+        size_t n = journal_pop(chunk, JOURNAL_SPILL_RECS);
+        if (n > 0 && nvs_set_blob(h, key, chunk, n * sizeof(chunk[0])) == ESP_OK) {
+            nvs_commit(h);
+            ESP_LOGI(TAG, "journal: spilled %u events to %s", (unsigned)n, key);
+        }
+        break;
+    }
+    nvs_close(h);
+}
+
+void journal_service(void)
+{
+    if (s_jr_lock == NULL) {
+        return;
+    }
+    xSemaphoreTake(s_jr_lock, portMAX_DELAY);
+    journal_spill();
+    xSemaphoreGive(s_jr_lock);
+}
+
+/* False if a batch failed; its chunk then keeps the events not yet sent. */
+static bool journal_replay_spill(esp_mqtt_client_handle_t client)
+{
+    nvs_handle_t h;
+    if (nvs_open(JOURNAL_NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
+        return true;
+    }
+    static journal_rec_t chunk[JOURNAL_SPILL_RECS];
+    bool ok = true;
+    for (int i = 0; i < WB_JOURNAL_SPILL_CHUNKS && ok; i++) {
+        char key[8];
+        size_t sz = sizeof(chunk);
+        spill_key(key, i);
+        if (nvs_get_blob(h, key, chunk, &sz) != ESP_OK) {
+            continue;
+        }
+        size_t n = sz / sizeof(chunk[0]);
+        size_t off = 0;
+        while (off < n) {
+            size_t m = n - off < JOURNAL_BATCH ? n - off : JOURNAL_BATCH;
+            if (!journal_publish_batch(client, chunk + off, m)) {
+                ok = false;
+                break;
+            }
+            off += m;
+        }
+        if (off == n) {
+            nvs_erase_key(h, key);
+        } else if (off > 0) {
+            nvs_set_blob(h, key, chunk + off, (n - off) * sizeof(chunk[0]));  // sent part not sent again
+        }
+    }
+    nvs_commit(h);
+    nvs_close(h);
+    return ok;
+}
+
+#else
+
+void journal_service(void)
+{
+}
+
+static bool journal_replay_spill(esp_mqtt_client_handle_t client)
+{
+    (void)client;
+    return true;
+}
+
+#endif
+
+void journal_init(void)
+{
+    if (s_jr_lock == NULL) {
+        s_jr_lock = xSemaphoreCreateMutex();
+    }
+}
+
+void journal_replay(esp_mqtt_client_handle_t client)
+{
+    if (s_jr_lock != NULL) {
+        xSemaphoreTake(s_jr_lock, portMAX_DELAY);
+    }
+    bool ok = journal_replay_spill(client);  /* older than anything in RAM: stop here if it failed */
+    journal_rec_t batch[JOURNAL_BATCH];
+    size_t total = 0;
+    size_t n;
+    while (ok && (n = journal_pop(batch, JOURNAL_BATCH)) > 0) {
+        ok = journal_publish_batch(client, batch, n);
+        if (ok) {
+            total += n;
+        } else {
+            journal_unpop(batch, n);
+        }
+    }
+    if (s_jr_lock != NULL) {
+        xSemaphoreGive(s_jr_lock);
+    }
+    if (total > 0 || !ok) {
+        ESP_LOGI(TAG, "journal: replayed %u events%s", (unsigned)total, ok ? "" : ", rest kept for the next connect");
+    }
+}
@@ -0,0 +1,147 @@
+/*
+ * json_wr.c - See json_wr.h. No snprintf: integers are converted by hand, strings are escaped
+ * for '"', '\\' and control characters only.
+ */
+
+#include <string.h>
+#include "json_wr.h"
+
+static void jw_putc(jw_t *w, char c)
+{
+    if (w->len + 1 >= w->cap) {
+        w->overflow = true;
+        return;
+    }
+    w->buf[w->len++] = c;
+}
+
+static void jw_puts(jw_t *w, const char *s, size_t n)
+{
+    if (w->len + n >= w->cap) {
+        w->overflow = true;
+        return;
+    }
+    memcpy(w->buf + w->len, s, n);
+    w->len += n;
+}
+
+static void jw_sep(jw_t *w)
+{
+    if (w->need_comma) {
+        jw_putc(w, ',');
+    }
+    w->need_comma = true;
+}
+
+void jw_init(jw_t *w, char *buf, size_t cap)
+{
+    w->buf = buf;
+    w->cap = cap;
+    w->len = 0;
+    w->need_comma = false;
+    w->overflow = cap == 0;
+}
+
+void jw_obj_begin(jw_t *w)
+{
+    jw_sep(w);
+    jw_putc(w, '{');
+    w->need_comma = false;
+}
+
+void jw_obj_end(jw_t *w)
+{
+    jw_putc(w, '}');
+    w->need_comma = true;
+}
+
+void jw_arr_begin(jw_t *w)
+{
+    jw_sep(w);
+    jw_putc(w, '[');
+    w->need_comma = false;
+}
+
+void jw_arr_end(jw_t *w)
+{
+    jw_putc(w, ']');
+    w->need_comma = true;
+}
+
+static void jw_quoted(jw_t *w, const char *s)
+{
+    static const char hex[] = "0123456789abcdef";
+    jw_putc(w, '"');
+    for (; *s != '\0'; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            jw_putc(w, '\\');
+            jw_putc(w, (char)c);
+        } else if (c < 0x20) {
+            char esc[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            jw_puts(w, esc, sizeof(esc));
+        } else {
+            jw_putc(w, (char)c);
+        }
+    }
+    jw_putc(w, '"');
+}
+
+void jw_key(jw_t *w, const char *key)
+{
+    jw_sep(w);
+    jw_quoted(w, key);
+    jw_putc(w, ':');
+    w->need_comma = false;
+}
+
+void jw_uint(jw_t *w, uint32_t v)
+{
+    char tmp[10];
+    size_t n = 0;
+    do {
+        tmp[n++] = (char)('0' + v % 10U);
+        v /= 10U;
+    } while (v != 0);
+    jw_sep(w);
+    while (n > 0) {
+        jw_putc(w, tmp[--n]);
+    }
+}
+
+void jw_int(jw_t *w, int32_t v)
+{
+    if (v < 0) {
+        jw_sep(w);
+        jw_putc(w, '-');
+        w->need_comma = false;
+        jw_uint(w, (uint32_t)(-(int64_t)v));
+        return;
+    }
+    jw_uint(w, (uint32_t)v);
+}
+
+void jw_bool(jw_t *w, bool v)
+{
+    jw_sep(w);
+    if (v) {
+        jw_puts(w, "true", 4);
+    } else {
+        jw_puts(w, "false", 5);
+    }
+}
+
+void jw_str(jw_t *w, const char *s)
+{
+    jw_sep(w);
+    jw_quoted(w, s != NULL ? s : "");
+}
+
+int jw_finish(jw_t *w)
+{
+    if (w->overflow) {
+        return -1;
+    }
+    w->buf[w->len] = '\0';
+    return (int)w->len;
+}
@@ -0,0 +1,35 @@
+/*
+ * json_wr.h - Minimal allocation-free JSON writer into a caller-owned buffer.
+ *
+ * Commas are inserted automatically; jw_finish() returns the length, or -1 if the
+ * document did not fit (the buffer content is then undefined).
+ */
+
+#ifndef WB_JSON_WR_H
+#define WB_JSON_WR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    char *buf;
+    size_t cap;
+    size_t len;
+    bool need_comma;
+    bool overflow;
+} jw_t;
+
+void jw_init(jw_t *w, char *buf, size_t cap);
+void jw_obj_begin(jw_t *w);
+void jw_obj_end(jw_t *w);
+void jw_arr_begin(jw_t *w);
+void jw_arr_end(jw_t *w);
+void jw_key(jw_t *w, const char *key);
+void jw_int(jw_t *w, int32_t v);
+void jw_uint(jw_t *w, uint32_t v);
+void jw_bool(jw_t *w, bool v);
+void jw_str(jw_t *w, const char *s);
+int jw_finish(jw_t *w);
+
+#endif
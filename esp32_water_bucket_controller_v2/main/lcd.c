@@ -1,17 +1,86 @@
+/*
+ * lcd.c - SSD1306 128x64 OLED, 8 text rows of 16 characters, drawn through a local framebuffer.
+ *
+ * lcd_draw_rows() runs on the UI task and never touches the bus: it compares each row with the text
+ * already rendered, draws the changed character span into s_fb with the glyphs from lcd_font.c and
+ * widens that page's dirty column range, then wakes the "lcd" flush task. The flush task copies the
+ * dirty spans out under s_fb_mux and queues them as asynchronous I2C master transactions (a command
+ * and a data transfer per page), so the next frame is built while the bus is busy. Frames arriving
+ * during a transfer merge into the next flush. A failed transfer marks its pages dirty again; after a
+ * timeout nothing new is queued (and the transfer buffers are left alone) until the bus has finished
+ * what it still holds. The first flush that reaches the panel reports HEALTH_STAGE_UI.
+ *
+ * The esp_ssd1306 component only initialises and clears the panel; after that the flush task is the
+ * only bus user (contrast changes go through it too). Traffic, draw time and frame-to-glass latency
+ * (first frame handed over until its flush completes) are counted (lcd_get_stats) and logged every
+ * WB_LCD_STATS_S seconds next to what full redraws would have cost.
+ */
+
 #include <string.h>
 #include "driver/gpio.h"
 #include "driver/i2c_master.h"
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lcd_font.h"
+#include "priv.h"
 #include "ssd1306.h"
+#include "wb_config.h"
+
+#ifndef WB_LCD_STATS_S
+#define WB_LCD_STATS_S 60
+#endif
 
 #define OLED_SDA GPIO_NUM_22
 #define OLED_SCL GPIO_NUM_32
 #define OLED_ADDR 0x3C
+#define OLED_HZ 400000
+#define OLED_FLIP true
+#define LCD_ROWS 8
+#define LCD_COLS 16
+#define LCD_WIDTH (LCD_COLS * 8)
+#define LCD_XFER_QUEUE (2 * LCD_ROWS + 1)
+#define LCD_XFER_TIMEOUT_MS 100
+/* Address bytes and the page/column command transfer around each data run. */
+#define LCD_XFER_OVERHEAD 7
 
 static const char *TAG = "wb_ui";
 
 static ssd1306_handle_t s_lcd;
 static i2c_master_bus_handle_t s_i2c_bus;
+static i2c_master_dev_handle_t s_dev;
+static TaskHandle_t s_flush_task;
+static SemaphoreHandle_t s_xfer_done;
+static volatile bool s_xfer_failed;
+/* Last flush, reported by lcd_draw_rows(); nothing has reached the panel before the first one. */
+static volatile esp_err_t s_flush_err = ESP_ERR_INVALID_STATE;
+
+/* UI task only: the text drawn into s_fb. */
+static char s_shown[LCD_ROWS][LCD_COLS];
+static bool s_shown_inv[LCD_ROWS];
+
+/* Shared with the flush task under s_fb_mux. */
+static portMUX_TYPE s_fb_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint8_t s_fb[LCD_ROWS][LCD_WIDTH];
+static int16_t s_dirty_lo[LCD_ROWS];
+static int16_t s_dirty_hi[LCD_ROWS];   /* < s_dirty_lo when clean */
+static int64_t s_pending_since_us;     /* first frame not yet picked up by a flush; 0 if none */
+static int s_contrast_req = -1;
+
+/* Flush task only: transfer buffers, which must live until the transaction completes. */
+static uint8_t s_tx_cmd[LCD_ROWS][4];
+static uint8_t s_tx_data[LCD_ROWS][1 + LCD_WIDTH];
+static uint8_t s_tx_contrast[3];
+static bool s_bus_busy;   /* a wait timed out with transfers still queued on s_tx_* */
+
+/* Under s_fb_mux: the UI task counts frames and draw time, the flush task the rest and resets the maxima. */
+static lcd_stats_t s_stats;
+/* Flush task only. */
+static lcd_stats_t s_stats_logged;
+static int64_t s_stats_log_us;
 
 static void line16(char out[17], const char *text)
 {
@@ -24,6 +93,218 @@ static void line16(char out[17], const char *text)
     out[16] = '\0';
 }
 
+static uint8_t rev8(uint8_t b)
+{
+    b = (uint8_t)((b & 0xF0) >> 4 | (b & 0x0F) << 4);
+    b = (uint8_t)((b & 0xCC) >> 2 | (b & 0x33) << 2);
+    return (uint8_t)((b & 0xAA) >> 1 | (b & 0x55) << 1);
+}
+
+/* Columns of text[first..last] as panel bytes. With flip the page order is mirrored in lcd_flush()
+ * and, as in ssd1306_display_text(), the bits of each column are reversed. */
+static uint8_t lcd_render_span(uint8_t *img, const char *text, int first, int last, bool invert)
+{
+    uint8_t *p = img;
+    for (int c = first; c <= last; c++) {
+        const uint8_t *g = lcd_glyph(text[c]);
+        for (int x = 0; x < 8; x++) {
+            uint8_t b = invert ? (uint8_t)~g[x] : g[x];
+            *p++ = OLED_FLIP ? rev8(b) : b;
+        }
+    }
+    return (uint8_t)(p - img);
+}
+
+/* Caller holds s_fb_mux. */
+static void lcd_mark_dirty(int page, int lo, int hi)
+{
+    if (s_dirty_hi[page] < s_dirty_lo[page]) {
+        s_dirty_lo[page] = (int16_t)lo;
+        s_dirty_hi[page] = (int16_t)hi;
+        return;
+    }
+    if (lo < s_dirty_lo[page]) {
+        s_dirty_lo[page] = (int16_t)lo;
+    }
+    if (hi > s_dirty_hi[page]) {
+        s_dirty_hi[page] = (int16_t)hi;
+    }
+}
+
+/* Snapshots and resets the maxima under s_fb_mux, then logs the interval outside it. */
+static void lcd_stats_log(int64_t now)
+{
+    portENTER_CRITICAL(&s_fb_mux);
+    lcd_stats_t cur = s_stats;
+    s_stats.max_us = 0;
+    s_stats.glass_max_us = 0;
+    portEXIT_CRITICAL(&s_fb_mux);
+    lcd_stats_t d = {
+        .frames = cur.frames - s_stats_logged.frames,
+        .rows_sent = cur.rows_sent - s_stats_logged.rows_sent,
+        .flushes = cur.flushes - s_stats_logged.flushes,
+        .bytes = cur.bytes - s_stats_logged.bytes,
+        .total_us = cur.total_us - s_stats_logged.total_us,
+        .glass_total_us = cur.glass_total_us - s_stats_logged.glass_total_us,
+    };
+    if (d.frames > 0 && d.flushes > 0) {
+        uint64_t full = (uint64_t)d.frames * LCD_ROWS * (LCD_WIDTH + LCD_XFER_OVERHEAD);
+        ESP_LOGI(TAG, "lcd: %lu frames, %lu flushes, %lu rows sent, %llu B (full redraw %llu B), draw avg %lu us "
+                 "max %lu us, to glass avg %lu us max %lu us",
+                 (unsigned long)d.frames, (unsigned long)d.flushes, (unsigned long)d.rows_sent,
+                 (unsigned long long)d.bytes, (unsigned long long)full, (unsigned long)(d.total_us / d.frames),
+                 (unsigned long)cur.max_us, (unsigned long)(d.glass_total_us / d.flushes),
+                 (unsigned long)cur.glass_max_us);
+    }
+    s_stats_logged = cur;
+    s_stats_log_us = now;
+}
+
+static bool IRAM_ATTR lcd_xfer_done(i2c_master_dev_handle_t dev, const i2c_master_event_data_t *ev, void *arg)
+{
+    (void)dev;
+    (void)arg;
+    BaseType_t woken = pdFALSE;
+    if (ev->event != I2C_EVENT_DONE) {
+        s_xfer_failed = true;
+    }
+    xSemaphoreGiveFromISR(s_xfer_done, &woken);
+    return woken == pdTRUE;
+}
+
+static bool lcd_queue(const uint8_t *buf, size_t len, int *queued)
+{
+    if (i2c_master_transmit(s_dev, buf, len, LCD_XFER_TIMEOUT_MS) != ESP_OK) {
+        return false;
+    }
+    (*queued)++;
+    return true;
+}
+
+/* Waits out the transfers left queued by a timeout and drops their late completions. */
+static bool lcd_bus_idle(void)
+{
+    if (i2c_master_bus_wait_all_done(s_i2c_bus, LCD_XFER_TIMEOUT_MS) != ESP_OK) {
+        return false;
+    }
+    while (xSemaphoreTake(s_xfer_done, 0) == pdTRUE) {
+    }
+    s_bus_busy = false;
+    return true;
+}
+
+/* One pass: snapshot the dirty spans, queue them, wait for the bus. Returns false to retry later. */
+static bool lcd_flush(void)
+{
+    if (s_bus_busy && !lcd_bus_idle()) {
+        s_flush_err = ESP_ERR_TIMEOUT;
+        return false;
+    }
+    int16_t lo[LCD_ROWS];
+    int16_t hi[LCD_ROWS];
+    portENTER_CRITICAL(&s_fb_mux);
+    for (int p = 0; p < LCD_ROWS; p++) {
+        lo[p] = s_dirty_lo[p];
+        hi[p] = s_dirty_hi[p];
+        if (hi[p] >= lo[p]) {
+            memcpy(&s_tx_data[p][1], &s_fb[p][lo[p]], (size_t)(hi[p] - lo[p] + 1));
+            s_dirty_lo[p] = LCD_WIDTH;
+            s_dirty_hi[p] = -1;
+        }
+    }
+    int64_t since = s_pending_since_us;
+    s_pending_since_us = 0;
+    int contrast = s_contrast_req;
+    s_contrast_req = -1;
+    portEXIT_CRITICAL(&s_fb_mux);
+
+    s_xfer_failed = false;
+    int queued = 0;
+    bool ok = true;
+    uint32_t bytes = 0;
+    uint32_t rows = 0;
+    if (contrast >= 0) {
+        s_tx_contrast[0] = 0x00;
+        s_tx_contrast[1] = 0x81;
+        s_tx_contrast[2] = (uint8_t)contrast;
+        ok = lcd_queue(s_tx_contrast, sizeof(s_tx_contrast), &queued);
+    }
+    for (int p = 0; p < LCD_ROWS && ok; p++) {
+        if (hi[p] < lo[p]) {
+            continue;
+        }
+        size_t width = (size_t)(hi[p] - lo[p] + 1);
+        s_tx_cmd[p][0] = 0x00;
+        s_tx_cmd[p][1] = (uint8_t)(0xB0 | (OLED_FLIP ? LCD_ROWS - 1 - p : p));
+        s_tx_cmd[p][2] = (uint8_t)(lo[p] & 0x0F);
+        s_tx_cmd[p][3] = (uint8_t)(0x10 | (lo[p] >> 4));
+        s_tx_data[p][0] = 0x40;
+        ok = lcd_queue(s_tx_cmd[p], sizeof(s_tx_cmd[p]), &queued) &&
+             lcd_queue(s_tx_data[p], 1 + width, &queued);
+        bytes += (uint32_t)width + LCD_XFER_OVERHEAD;
+        rows++;
+    }
+    for (int i = 0; i < queued; i++) {
+        if (xSemaphoreTake(s_xfer_done, pdMS_TO_TICKS(LCD_XFER_TIMEOUT_MS)) != pdTRUE) {
+            ok = false;
+            s_bus_busy = true;
+            lcd_bus_idle();
+            break;
+        }
+    }
+    int64_t now = esp_timer_get_time();
+    if (!ok || s_xfer_failed) {
+        portENTER_CRITICAL(&s_fb_mux);
+        for (int p = 0; p < LCD_ROWS; p++) {
+            if (hi[p] >= lo[p]) {
+                lcd_mark_dirty(p, lo[p], hi[p]);
+            }
+        }
+        if (s_pending_since_us == 0) {
+            s_pending_since_us = since;
+        }
+        if (contrast >= 0 && s_contrast_req < 0) {
+            s_contrast_req = contrast;
+        }
+        portEXIT_CRITICAL(&s_fb_mux);
+        s_flush_err = ESP_ERR_TIMEOUT;
+        return false;
+    }
+    s_flush_err = ESP_OK;
+    portENTER_CRITICAL(&s_fb_mux);
+    s_stats.flushes++;
+    s_stats.rows_sent += rows;
+    s_stats.bytes += bytes;
+    if (since != 0) {
+        uint32_t us = (uint32_t)(now - since);
+        s_stats.glass_total_us += us;
+        if (us > s_stats.glass_max_us) {
+            s_stats.glass_max_us = us;
+        }
+    }
+    portEXIT_CRITICAL(&s_fb_mux);
+    if (rows > 0) {
+        health_mark(HEALTH_STAGE_UI);
+    }
+    if (WB_LCD_STATS_S > 0 && now - s_stats_log_us >= (int64_t)WB_LCD_STATS_S * 1000000) {
+        lcd_stats_log(now);
+    }
+    return true;
+}
+
+static void lcd_flush_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (!lcd_flush()) {
+            ESP_LOGW(TAG, "lcd: transfer failed, retrying");
+            vTaskDelay(pdMS_TO_TICKS(LCD_XFER_TIMEOUT_MS));
+            xTaskNotifyGive(s_flush_task);
+        }
+    }
+}
+
 esp_err_t lcd_init(void)
 {
     if (s_lcd != NULL) {
@@ -35,6 +316,7 @@ esp_err_t lcd_init(void)
         .i2c_port = I2C_NUM_0,
         .sda_io_num = OLED_SDA,
         .scl_io_num = OLED_SCL,
+        .trans_queue_depth = LCD_XFER_QUEUE,
         .flags.enable_internal_pullup = true,
     };
     esp_err_t e = i2c_new_master_bus(&bus_cfg, &s_i2c_bus);
@@ -43,8 +325,8 @@ esp_err_t lcd_init(void)
     }
     ssd1306_config_t cfg = I2C_SSD1306_128x64_CONFIG_DEFAULT;
     cfg.i2c_address = OLED_ADDR;
-    cfg.i2c_clock_speed = 400000;
-    cfg.flip_enabled = true;
+    cfg.i2c_clock_speed = OLED_HZ;
+    cfg.flip_enabled = OLED_FLIP;
     e = ssd1306_init(s_i2c_bus, &cfg, &s_lcd);
     if (e != ESP_OK) {
         return e;
@@ -57,30 +339,107 @@ esp_err_t lcd_init(void)
     if (e != ESP_OK) {
         return e;
     }
+    /* The panel is blank: s_fb (zeroed) and s_shown (spaces) already match it. */
+    memset(s_shown, ' ', sizeof(s_shown));
+    for (int p = 0; p < LCD_ROWS; p++) {
+        s_dirty_lo[p] = LCD_WIDTH;
+        s_dirty_hi[p] = -1;
+    }
+    /* From here on the flush task owns the bus; the transfers it queues are asynchronous. */
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = OLED_ADDR,
+        .scl_speed_hz = OLED_HZ,
+    };
+    e = i2c_master_bus_add_device(s_i2c_bus, &dev_cfg, &s_dev);
+    if (e != ESP_OK) {
+        return e;
+    }
+    s_xfer_done = xSemaphoreCreateCounting(LCD_XFER_QUEUE, 0);
+    if (s_xfer_done == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    i2c_master_event_callbacks_t cbs = {
+        .on_trans_done = lcd_xfer_done,
+    };
+    e = i2c_master_register_event_callbacks(s_dev, &cbs, NULL);
+    if (e != ESP_OK) {
+        return e;
+    }
+    if (xTaskCreate(lcd_flush_task, "lcd", 3072, NULL, 4, &s_flush_task) != pdPASS) {
+        return ESP_ERR_NO_MEM;
+    }
+    s_stats_log_us = esp_timer_get_time();
     ESP_LOGI(TAG, "lcd: ready");
     return ESP_OK;
 }
 
 esp_err_t lcd_draw_rows(const char rows[8][17], int invert_row)
 {
-    if (s_lcd == NULL) {
+    if (s_flush_task == NULL) {
         return ESP_ERR_INVALID_STATE;
     }
-    for (int i = 0; i < 8; i++) {
+    int64_t t0 = esp_timer_get_time();
+    bool changed = false;
+    for (int i = 0; i < LCD_ROWS; i++) {
         char buf[17];
         line16(buf, rows[i]);
-        esp_err_t e = ssd1306_display_text(s_lcd, (uint8_t)i, buf, i == invert_row);
-        if (e != ESP_OK) {
-            return e;
+        bool inv = i == invert_row;
+        int first = 0;
+        int last = LCD_COLS - 1;
+        if (s_shown_inv[i] == inv) {
+            while (first < LCD_COLS && buf[first] == s_shown[i][first]) {
+                first++;
+            }
+            if (first == LCD_COLS) {
+                continue;
+            }
+            while (buf[last] == s_shown[i][last]) {
+                last--;
+            }
+        }
+        uint8_t img[LCD_WIDTH];
+        uint8_t width = lcd_render_span(img, buf, first, last, inv);
+        portENTER_CRITICAL(&s_fb_mux);
+        memcpy(&s_fb[i][first * 8], img, width);
+        lcd_mark_dirty(i, first * 8, first * 8 + width - 1);
+        if (s_pending_since_us == 0) {
+            s_pending_since_us = t0;
         }
+        portEXIT_CRITICAL(&s_fb_mux);
+        memcpy(s_shown[i], buf, LCD_COLS);
+        s_shown_inv[i] = inv;
+        changed = true;
     }
-    return ESP_OK;
+    if (changed) {
+        xTaskNotifyGive(s_flush_task);
+    }
+    uint32_t us = (uint32_t)(esp_timer_get_time() - t0);
+    portENTER_CRITICAL(&s_fb_mux);
+    s_stats.frames++;
+    s_stats.total_us += us;
+    if (us > s_stats.max_us) {
+        s_stats.max_us = us;
+    }
+    portEXIT_CRITICAL(&s_fb_mux);
+    return s_flush_err;
+}
+
+void lcd_get_stats(lcd_stats_t *out)
+{
+    portENTER_CRITICAL(&s_fb_mux);
+    *out = s_stats;
+    portEXIT_CRITICAL(&s_fb_mux);
 }
 
 esp_err_t lcd_set_contrast(uint8_t contrast)
 {
-    if (s_lcd == NULL) {
+    if (s_flush_task == NULL) {
         return ESP_ERR_INVALID_STATE;
     }
-    return ssd1306_set_contrast(s_lcd, contrast);
+    portENTER_CRITICAL(&s_fb_mux);
+    s_contrast_req = contrast;
+    portEXIT_CRITICAL(&s_fb_mux);
+    xTaskNotifyGive(s_flush_task);
+    return ESP_OK;
 }
@@ -0,0 +1,21 @@
+/*
+ * lcd_font.h - 8x8 OLED font (lcd_font.c). Glyph i is character LCD_FONT_FIRST + i.
+ */
+
+#ifndef WB_LCD_FONT_H
+#define WB_LCD_FONT_H
+
+#include <stdint.h>
+
+#define LCD_FONT_FIRST 0x20
+#define LCD_FONT_COUNT 95
+
+extern const uint8_t lcd_font8x8[LCD_FONT_COUNT][8];
+
+static inline const uint8_t *lcd_glyph(char c)
+{
+    unsigned i = (unsigned char)c - LCD_FONT_FIRST;
+    return lcd_font8x8[i < LCD_FONT_COUNT ? i : 0];
+}
+
+#endif
@@ -4,6 +4,8 @@
  */
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "log_bin.h"
 #include "priv.h"
 
 static const char *TAG = "wb";
@@ -12,6 +14,7 @@ int s_level[WB_NUM_LEVELS] = {0, 0, 0};
 int s_last_level[WB_NUM_LEVELS] = {-1, -1, -1};
 bool s_pumps_disabled = true;
 bool s_last_pumps_disabled = true;
+static uint32_t s_first_read_ms;
 
 void read_levels(void)
 {
@@ -19,7 +22,7 @@ void read_levels(void)
     for (size_t i = 0; i < WB_NUM_LEVELS; i++) {
         int v = level_gpio_get((int)i);
         if (v != s_last_level[i]) {
-            ESP_LOGI(TAG, "state: level[%u] %d -> %d (%s)", (unsigned)i, s_last_level[i], v,
+            WB_BLOGI(TAG, "state: level[%u] %d -> %d (%s)", (unsigned)i, s_last_level[i], v,
                      v ? "dry" : "water");
             s_last_level[i] = v;
             s_level[i] = v;
@@ -38,16 +41,27 @@ void read_levels(void)
                  s_level[0], s_level[1], s_level[2]);
     }
     if (s_pumps_disabled && !prev_disabled) {
-        ESP_LOGI(TAG, "levels: all-dry -> pump off");
+        WB_BLOGI(TAG, "levels: all-dry -> pump off");
         set_pump(WB_PUMP_OFF);
     }
     if (any_change) {
         publish_levels();
+        ui_notify(UI_NOTIFY_LEVELS);
     }
+    if (s_first_read_ms == 0) {
+        s_first_read_ms = (uint32_t)(esp_timer_get_time() / 1000) | 1u;
+        ESP_LOGI(TAG, "levels: first read %lu ms after boot", (unsigned long)s_first_read_ms);
+    }
+}
+
+uint32_t level_first_read_ms(void)
+{
+    return s_first_read_ms;
 }
 
 void level_timer_cb(void *arg)
 {
     (void)arg;
     read_levels();
+    health_loop_tick();
 }
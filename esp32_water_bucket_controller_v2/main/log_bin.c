@@ -0,0 +1,337 @@
+/*
+ * log_bin.c - Binary (deferred-formatting) log records; see log_bin.h.
+ *
+ * A record is log_bin_rec_t trimmed to its nargs, written whole into a log_ring.c ring, so a call costs
+ * one timestamp read, one CAS and a copy of at most 33 bytes. In the shared stream it is preceded by
+ * WB_LOG_BIN_FRAME, which no text line starts with. The consumer applies the tag's runtime
+ * level (esp_log_level_get), then formats "I (ts) tag: msg" with a small printf subset (flags, width,
+ * precision, h/l modifiers; d i u x X o c s p %) for the sink and the serial console. With
+ * WB_LOG_BINARY_RAW the sink instead gets WB_LOG_BIN_FRAME + the record bytes, and
+ * tools/wb_logdecode.py resolves fmt/tag addresses against the firmware ELF.
+ *
+ * Records pass the same per-tag rate limit as text lines (log_ctl.c) before they are formatted.
+ * The consumer is the log_tx task (log_tcp.c), which reads text lines and records from one ring in
+ * the order they were written, when WB_LOG_TCP_PORT > 0; otherwise the log_bin task here.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "log_bin.h"
+#include "log_ring.h"
+#include "priv.h"
+#include "wb_config.h"
+
+#if WB_LOG_BINARY
+
+#ifndef WB_LOG_BINARY_RAW
+#define WB_LOG_BINARY_RAW 0
+#endif
+#ifndef WB_LOG_BIN_RING_SIZE
+#define WB_LOG_BIN_RING_SIZE 4096  /* bytes, power of two */
+#endif
+#ifndef WB_LOG_BIN_BENCH
+#define WB_LOG_BIN_BENCH 0
+#endif
+
+#define LOG_BIN_HDR_SIZE  offsetof(log_bin_rec_t, args)
+#define LOG_BIN_POLL_MS   50
+#define LOG_BIN_LINE_MAX  256
+#define LOG_BIN_BENCH_N   32
+
+_Static_assert((WB_LOG_BIN_RING_SIZE & (WB_LOG_BIN_RING_SIZE - 1)) == 0, "WB_LOG_BIN_RING_SIZE must be a power of two");
+_Static_assert(sizeof(log_bin_rec_t) == 32, "log_bin_rec_t layout is read by tools/wb_logdecode.py");
+
+static uint32_t s_bin_words[WB_LOG_BIN_RING_SIZE / 4];
+static log_ring_t s_bin_ring = { .words = s_bin_words, .cap = WB_LOG_BIN_RING_SIZE };
+static vprintf_like_t s_console = vprintf;
+static log_ring_t *s_stream;        /* log_tcp's ring once attached; __atomic */
+static void (*s_wake)(void);
+
+void log_bin_write(esp_log_level_t level, const char *tag, const char *fmt, size_t nargs, const uint32_t *args)
+{
+    if (level > LOG_LOCAL_LEVEL) {
+        return;
+    }
+    log_bin_rec_t r;
+    if (nargs > WB_LOG_BIN_MAX_ARGS) {
+        nargs = WB_LOG_BIN_MAX_ARGS;
+    }
+    r.fmt = (uint32_t)(uintptr_t)fmt;
+    r.tag = (uint32_t)(uintptr_t)tag;
+    r.ts_ms = esp_log_timestamp();
+    r.level = (uint8_t)level;
+    r.nargs = (uint8_t)nargs;
+    r.reserved = 0;
+    memcpy(r.args, args, nargs * sizeof(uint32_t));
+    size_t len = LOG_BIN_HDR_SIZE + nargs * sizeof(uint32_t);
+    log_ring_t *stream = __atomic_load_n(&s_stream, __ATOMIC_ACQUIRE);
+    if (stream == NULL) {
+        (void)log_ring_write(&s_bin_ring, &r, len, NULL);
+        return;
+    }
+    uint8_t frame[1 + sizeof(log_bin_rec_t)];
+    frame[0] = WB_LOG_BIN_FRAME;
+    memcpy(frame + 1, &r, len);
+    bool was_empty = false;
+    if (log_ring_write(stream, frame, 1 + len, &was_empty) && was_empty && s_wake != NULL) {
+        s_wake();
+    }
+}
+
+void log_bin_set_console(vprintf_like_t out)
+{
+    s_console = out != NULL ? out : vprintf;
+}
+
+void log_bin_set_stream(log_ring_t *ring, void (*wake)(void))
+{
+    s_wake = wake;
+    __atomic_store_n(&s_stream, ring, __ATOMIC_RELEASE);
+    /* Records logged before the switch; this caller is the only consumer of s_bin_ring now. */
+    static uint32_t batch[64];
+    size_t n;
+    while ((n = log_ring_read(&s_bin_ring, batch, sizeof(batch))) > 0) {
+        size_t off = 0;
+        while (off + LOG_BIN_HDR_SIZE <= n) {
+            log_bin_rec_t r;
+            memcpy(&r, (const uint8_t *)batch + off, LOG_BIN_HDR_SIZE);
+            size_t len = LOG_BIN_HDR_SIZE + r.nargs * sizeof(uint32_t);
+            uint8_t frame[1 + sizeof(log_bin_rec_t)];
+            frame[0] = WB_LOG_BIN_FRAME;
+            memcpy(frame + 1, (const uint8_t *)batch + off, len);
+            (void)log_ring_write(ring, frame, 1 + len, NULL);
+            off += len;
+        }
+    }
+}
+
+static void console_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    s_console(fmt, ap);
+    va_end(ap);
+}
+
+static char level_letter(uint8_t level)
+{
+    static const char letters[] = "NEWIDV";
+    return level < sizeof(letters) - 1 ? letters[level] : '?';
+}
+
+/* Formats one record's message into out; each conversion is re-issued to snprintf on its own with the
+ * length modifier dropped, since every argument was widened to 32 bits by the macro. */
+static size_t format_rec(const log_bin_rec_t *r, char *out, size_t cap)
+{
+    const char *f = (const char *)(uintptr_t)r->fmt;
+    size_t len = 0;
+    size_t ai = 0;
+    while (*f != '\0' && len + 1 < cap) {
+        if (*f != '%') {
+            out[len++] = *f++;
+            continue;
+        }
+        char spec[16];
+        size_t si = 0;
+        spec[si++] = *f++;
+        while (*f != '\0' && strchr("-+ #0123456789.", *f) != NULL && si < sizeof(spec) - 2) {
+            spec[si++] = *f++;
+        }
+        while (*f == 'h' || *f == 'l' || *f == 'z' || *f == 'j' || *f == 't') {
+            f++;
+        }
+        char conv = *f;
+        if (conv == '\0') {
+            break;
+        }
+        f++;
+        spec[si++] = conv;
+        spec[si] = '\0';
+        if (conv == '%') {
+            out[len++] = '%';
+            continue;
+        }
+        uint32_t a = ai < r->nargs ? r->args[ai] : 0;
+        ai++;
+        int n;
+        switch (conv) {
+        case 'd':
+        case 'i':
+        case 'c':
+            n = snprintf(out + len, cap - len, spec, (int)(int32_t)a);
+            break;
+        case 's':
+            n = snprintf(out + len, cap - len, spec, a != 0 ? (const char *)(uintptr_t)a : "(null)");
+            break;
+        case 'p':
+            n = snprintf(out + len, cap - len, spec, (void *)(uintptr_t)a);
+            break;
+        default:
+            n = snprintf(out + len, cap - len, spec, (unsigned)a);
+            break;
+        }
+        if (n < 0) {
+            break;
+        }
+        len += (size_t)n < cap - len ? (size_t)n : cap - len - 1;
+    }
+    out[len] = '\0';
+    return len;
+}
+
+static void drain_rec(const log_bin_rec_t *r, log_bin_sink_t sink, void *ctx)
+{
+    const char *tag = (const char *)(uintptr_t)r->tag;
+    if (r->level > esp_log_level_get(tag) || !log_ctl_allow(tag, strlen(tag), (esp_log_level_t)r->level)) {
+        return;
+    }
+    char msg[LOG_BIN_LINE_MAX];
+    format_rec(r, msg, sizeof(msg));
+    char c = level_letter(r->level);
+    console_printf("%c (%lu) %s: %s\n", c, (unsigned long)r->ts_ms, tag, msg);
+    if (sink == NULL) {
+        return;
+    }
+#if WB_LOG_BINARY_RAW
+    char frame[1 + sizeof(log_bin_rec_t)];
+    size_t n = LOG_BIN_HDR_SIZE + r->nargs * sizeof(uint32_t);
+    frame[0] = WB_LOG_BIN_FRAME;
+    memcpy(frame + 1, r, n);
+    sink(frame, 1 + n, ctx);
+#else
+    char line[LOG_BIN_LINE_MAX + 48];
+    int n = snprintf(line, sizeof(line), "%c (%lu) %s: %s\n", c, (unsigned long)r->ts_ms, tag, msg);
+    if (n > (int)sizeof(line) - 1) {
+        n = (int)sizeof(line) - 1;
+    }
+    if (n > 0) {
+        sink(line, (size_t)n, ctx);
+    }
+#endif
+}
+
+void log_bin_emit(const void *rec, size_t len, log_bin_sink_t sink, void *ctx)
+{
+    log_bin_rec_t r;
+    if (len < LOG_BIN_HDR_SIZE || len > sizeof(r)) {
+        return;
+    }
+    memset(&r, 0, sizeof(r));
+    memcpy(&r, rec, len);
+    if (r.nargs > WB_LOG_BIN_MAX_ARGS || LOG_BIN_HDR_SIZE + r.nargs * sizeof(uint32_t) != len) {
+        return;
+    }
+    drain_rec(&r, sink, ctx);
+}
+
+void log_bin_drain(log_bin_sink_t sink, void *ctx)
+{
+    static uint32_t batch[256];  /* consumer only */
+    uint32_t dropped = log_ring_take_dropped(&s_bin_ring);
+    if (dropped > 0 && sink != NULL) {
+        char note[48];
+        int m = snprintf(note, sizeof(note), "*** dropped %lu binary log bytes ***\n", (unsigned long)dropped);
+        sink(note, (size_t)m, ctx);
+    }
+    size_t n;
+    while ((n = log_ring_read(&s_bin_ring, batch, sizeof(batch))) > 0) {
+        size_t off = 0;
+        while (off + LOG_BIN_HDR_SIZE <= n) {
+            log_bin_rec_t r;
+            memcpy(&r, (const uint8_t *)batch + off, LOG_BIN_HDR_SIZE);
+            size_t args = r.nargs * sizeof(uint32_t);
+            memcpy(r.args, (const uint8_t *)batch + off + LOG_BIN_HDR_SIZE, args);
+            off += LOG_BIN_HDR_SIZE + args;
+            drain_rec(&r, sink, ctx);
+        }
+    }
+}
+
+#if WB_LOG_TCP_PORT <= 0
+static void log_bin_task(void *arg)
+{
+    (void)arg;
+    for (;;) {
+        log_bin_drain(NULL, NULL);
+        vTaskDelay(pdMS_TO_TICKS(LOG_BIN_POLL_MS));
+    }
+}
+#endif
+
+#if WB_LOG_BIN_BENCH
+/* Per-call cost at the call site, same message both ways. This runs from log_bin_init(), before
+ * log_tcp_init() and log_ctl_init() install their hooks, so the ESP_LOGI figure is its vsnprintf and the
+ * plain UART console only: the TCP ring copy and rate limiter of a running device come on top. The
+ * binary path's formatting happens later on the consumer. */
+void log_bin_benchmark(void)
+{
+    static const char *BTAG = "wb_bench";
+    int64_t t0 = esp_timer_get_time();
+    for (int i = 0; i < LOG_BIN_BENCH_N; i++) {
+        ESP_LOGI(BTAG, "state: level[%u] %d -> %d (%s)", (unsigned)(i % 3), i & 1, (i + 1) & 1, "dry");
+    }
+    int64_t t1 = esp_timer_get_time();
+    for (int i = 0; i < LOG_BIN_BENCH_N; i++) {
+        WB_BLOG_LEVEL(ESP_LOG_INFO, BTAG, "state: level[%u] %d -> %d (%s)", (unsigned)(i % 3), i & 1, (i + 1) & 1, "dry");
+    }
+    int64_t t2 = esp_timer_get_time();
+    ESP_LOGI(BTAG, "log_bin bench: ESP_LOGI %lu ns/call, binary %lu ns/call (n=%d)",
+             (unsigned long)((t1 - t0) * 1000 / LOG_BIN_BENCH_N),
+             (unsigned long)((t2 - t1) * 1000 / LOG_BIN_BENCH_N), LOG_BIN_BENCH_N);
+}
+#else
+void log_bin_benchmark(void)
+{
+}
+#endif
+
+void log_bin_init(void)
+{
+#if WB_LOG_TCP_PORT <= 0
+    xTaskCreate(log_bin_task, "log_bin", 3072, NULL, 2, NULL);
+#endif
+    log_bin_benchmark();
+}
+
+#else
+
+void log_bin_drain(log_bin_sink_t sink, void *ctx)
+{
+    (void)sink;
+    (void)ctx;
+}
+
+void log_bin_set_console(vprintf_like_t out)
+{
+    (void)out;
+}
+
+void log_bin_set_stream(log_ring_t *ring, void (*wake)(void))
+{
+    (void)ring;
+    (void)wake;
+}
+
+void log_bin_emit(const void *rec, size_t len, log_bin_sink_t sink, void *ctx)
+{
+    (void)rec;
+    (void)len;
+    (void)sink;
+    (void)ctx;
+}
+
+void log_bin_benchmark(void)
+{
+}
+
+void log_bin_init(void)
+{
+}
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * log_bin.h - Deferred-formatting log macros for hot paths.
+ *
+ * With WB_LOG_BINARY=1, WB_BLOGI/WB_BLOGW store the format string's address, the tag's address, a
+ * timestamp and up to WB_LOG_BIN_MAX_ARGS raw 32-bit arguments in a lock-free ring; no vsnprintf runs
+ * on the caller's stack. With TCP logging the ring is log_tcp's text ring (log_bin_set_stream), so
+ * records and text lines stay in the order they were logged; the log_tx task formats each record as it
+ * reaches it (log_bin_emit), or with WB_LOG_BINARY_RAW=1 ships it raw for tools/wb_logdecode.py.
+ * Without TCP logging, log_bin's own task drains a private ring.
+ *
+ * Arguments must be integers, pointers, or %s strings with static lifetime (literals): they are read
+ * long after the call. No floats and no 64-bit values. With WB_LOG_BINARY=0 the macros are ESP_LOGx.
+ */
+
+#ifndef WB_LOG_BIN_H
+#define WB_LOG_BIN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_log.h"
+#include "log_ring.h"
+#include "wb_config.h"
+
+#ifndef WB_LOG_BINARY
+#define WB_LOG_BINARY 0
+#endif
+
+#define WB_LOG_BIN_MAX_ARGS 4
+#define WB_LOG_BIN_FRAME    0x1E  /* precedes each raw record in the TCP stream */
+
+typedef struct {
+    uint32_t fmt;      /* address of the format string */
+    uint32_t tag;      /* address of the tag string */
+    uint32_t ts_ms;    /* esp_log_timestamp() */
+    uint8_t level;     /* esp_log_level_t */
+    uint8_t nargs;
+    uint16_t reserved;
+    uint32_t args[WB_LOG_BIN_MAX_ARGS];
+} log_bin_rec_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef void (*log_bin_sink_t)(const char *data, size_t len, void *ctx);
+
+void log_bin_init(void);
+void log_bin_write(esp_log_level_t level, const char *tag, const char *fmt, size_t nargs, const uint32_t *args);
+/* Consumer side: formats (or frames, in raw mode) every pending record into sink. */
+void log_bin_drain(log_bin_sink_t sink, void *ctx);
+/* Where formatted lines are echoed for the serial console; default vprintf. */
+void log_bin_set_console(vprintf_like_t out);
+/* From then on, records go into ring as WB_LOG_BIN_FRAME + record, and wake() runs when the ring was
+ * empty. Records still in the private ring are moved over first. */
+void log_bin_set_stream(log_ring_t *ring, void (*wake)(void));
+/* One record read from the stream, after its WB_LOG_BIN_FRAME byte: formats (or frames) it into sink. */
+void log_bin_emit(const void *rec, size_t len, log_bin_sink_t sink, void *ctx);
+void log_bin_benchmark(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define WB_BLOG_CAT_(a, b) a##b
+#define WB_BLOG_CAT(a, b) WB_BLOG_CAT_(a, b)
+#define WB_BLOG_NARGS_(_0, _1, _2, _3, _4, n, ...) n
+#define WB_BLOG_NARGS(...) WB_BLOG_NARGS_(_, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define WB_BLOG_U32(x) ((uint32_t)(uintptr_t)(x))
+#define WB_BLOG_A0()
+#define WB_BLOG_A1(a) , WB_BLOG_U32(a)
+#define WB_BLOG_A2(a, b) , WB_BLOG_U32(a), WB_BLOG_U32(b)
+#define WB_BLOG_A3(a, b, c) , WB_BLOG_U32(a), WB_BLOG_U32(b), WB_BLOG_U32(c)
+#define WB_BLOG_A4(a, b, c, d) , WB_BLOG_U32(a), WB_BLOG_U32(b), WB_BLOG_U32(c), WB_BLOG_U32(d)
+
+/* args[0] is padding so the zero-argument form is still a valid initializer. */
+#define WB_BLOG_LEVEL(level, tag, fmt, ...)                                                     \
+    log_bin_write(level, tag, fmt, WB_BLOG_NARGS(__VA_ARGS__),                               \
+                  (const uint32_t[]){ 0 WB_BLOG_CAT(WB_BLOG_A, WB_BLOG_NARGS(__VA_ARGS__))(__VA_ARGS__) } + 1)
+
+#if WB_LOG_BINARY
+#define WB_BLOGW(tag, fmt, ...) WB_BLOG_LEVEL(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define WB_BLOGI(tag, fmt, ...) WB_BLOG_LEVEL(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#else
+#define WB_BLOGW(tag, fmt, ...) ESP_LOGW(tag, fmt, ##__VA_ARGS__)
+#define WB_BLOGI(tag, fmt, ...) ESP_LOGI(tag, fmt, ##__VA_ARGS__)
+#endif
+
+#endif
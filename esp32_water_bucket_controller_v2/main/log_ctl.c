@@ -0,0 +1,288 @@
+/*
+ * log_ctl.c - Runtime log control. water_bucket/cmd/log takes "tag=level" pairs (separated by ',' or
+ * spaces; level none/error/warn/info/debug/verbose or 0..5; tag "*" is the default for every tag) and
+ * applies them with esp_log_level_set.
+ *
+ * The outermost esp_log vprintf hook (installed after log_tcp) rate-limits each tag with a token bucket:
+ * WB_LOG_RATE_BURST lines at once, refilled at WB_LOG_RATE_PER_S. Errors always pass. Lines over the
+ * limit are dropped before they reach UART or TCP and counted per tag; an esp_timer sends a
+ * "log: suppressed" line with the counts every WB_LOG_RATE_REPORT_S if anything was dropped. Binary
+ * records (log_bin.c) use the same buckets.
+ *
+ * Each line is formatted once, here: a line that passes goes to log_tcp as formatted text
+ * (log_ctl_set_line_out), or straight to stdout when the next hook is plain vprintf.
+ */
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "priv.h"
+#include "wb_config.h"
+
+#ifndef WB_LOG_RATE_PER_S
+#define WB_LOG_RATE_PER_S 20
+#endif
+#ifndef WB_LOG_RATE_BURST
+#define WB_LOG_RATE_BURST 40
+#endif
+#ifndef WB_LOG_RATE_REPORT_S
+#define WB_LOG_RATE_REPORT_S 60
+#endif
+
+#define LOG_CTL_TAGS     16
+#define LOG_CTL_TAG_MAX  16
+#define LOG_CTL_LINE_MAX 256
+#define LOG_CTL_MILLI    1000u  /* tokens are kept in thousandths of a line */
+
+static const char *TAG = "wb";
+static const char *s_topic_cmd_log = "water_bucket/cmd/log";
+
+typedef struct {
+    char tag[LOG_CTL_TAG_MAX];
+    uint32_t tokens;      /* milli-lines */
+    int64_t refill_us;
+    uint32_t suppressed;
+} log_bucket_t;
+
+static log_bucket_t s_buckets[LOG_CTL_TAGS];  /* last slot is shared once the table is full */
+static size_t s_bucket_count;
+static portMUX_TYPE s_ctl_mux = portMUX_INITIALIZER_UNLOCKED;
+static vprintf_like_t s_next;
+static log_line_out_t s_line_out;
+static esp_timer_handle_t s_report_timer;
+
+static log_bucket_t *bucket_find(const char *tag, size_t len)
+{
+    for (size_t i = 0; i < s_bucket_count; i++) {
+        if (strncmp(s_buckets[i].tag, tag, len) == 0 && s_buckets[i].tag[len] == '\0') {
+            return &s_buckets[i];
+        }
+    }
+    if (s_bucket_count == LOG_CTL_TAGS) {
+        return &s_buckets[LOG_CTL_TAGS - 1];
+    }
+    log_bucket_t *b = &s_buckets[s_bucket_count++];
+    if (s_bucket_count == LOG_CTL_TAGS) {
+        len = 1;
+        tag = "*";
+    }
+    memcpy(b->tag, tag, len);
+    b->tag[len] = '\0';
+    b->tokens = WB_LOG_RATE_BURST * LOG_CTL_MILLI;
+    b->refill_us = esp_timer_get_time();
+    return b;
+}
+
+bool log_ctl_allow(const char *tag, size_t len, esp_log_level_t level)
+{
+    if (level <= ESP_LOG_ERROR || WB_LOG_RATE_PER_S <= 0) {
+        return true;
+    }
+    if (len >= LOG_CTL_TAG_MAX) {
+        len = LOG_CTL_TAG_MAX - 1;
+    }
+    int64_t now = esp_timer_get_time();
+    bool ok;
+    taskENTER_CRITICAL(&s_ctl_mux);
+    log_bucket_t *b = bucket_find(tag, len);
+    uint64_t add = (uint64_t)(now - b->refill_us) * WB_LOG_RATE_PER_S / 1000u;  /* us * lines/s -> milli-lines */
+    b->refill_us = now;
+    uint64_t t = b->tokens + add;
+    b->tokens = t > WB_LOG_RATE_BURST * LOG_CTL_MILLI ? WB_LOG_RATE_BURST * LOG_CTL_MILLI : (uint32_t)t;
+    ok = b->tokens >= LOG_CTL_MILLI;
+    if (ok) {
+        b->tokens -= LOG_CTL_MILLI;
+    } else {
+        b->suppressed++;
+    }
+    taskEXIT_CRITICAL(&s_ctl_mux);
+    return ok;
+}
+
+static int next_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = s_next(fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+/* A formatted line to the next stage, without formatting it again. */
+static int next_line(const char *line, size_t len)
+{
+    if (s_line_out != NULL) {
+        return s_line_out(line, len);
+    }
+    if (s_next == vprintf) {
+        return (int)fwrite(line, 1, len, stdout);
+    }
+    return next_printf("%.*s", (int)len, line);
+}
+
+void log_ctl_set_line_out(log_line_out_t out)
+{
+    s_line_out = out;
+}
+
+/* Builds "W (ts) wb: log: suppressed tag=N ..." if anything was dropped since the last report. */
+static size_t take_report(char *out, size_t cap)
+{
+    uint32_t counts[LOG_CTL_TAGS];
+    taskENTER_CRITICAL(&s_ctl_mux);
+    size_t n = s_bucket_count;
+    for (size_t i = 0; i < n; i++) {
+        counts[i] = s_buckets[i].suppressed;
+        s_buckets[i].suppressed = 0;
+    }
+    taskEXIT_CRITICAL(&s_ctl_mux);
+    size_t len = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+        if (len == 0) {
+            len = (size_t)snprintf(out, cap, "W (%lu) %s: log: suppressed", (unsigned long)esp_log_timestamp(), TAG);
+        }
+        if (len + LOG_CTL_TAG_MAX + 16 < cap) {
+            /* tag[] is written once, before s_bucket_count covers it */
+            len += (size_t)snprintf(out + len, cap - len, " %s=%lu", s_buckets[i].tag, (unsigned long)counts[i]);
+        }
+    }
+    if (len > 0) {
+        out[len++] = '\n';
+        out[len] = '\0';
+    }
+    return len;
+}
+
+static void log_ctl_report_cb(void *arg)
+{
+    (void)arg;
+    char line[LOG_CTL_LINE_MAX];
+    size_t len = take_report(line, sizeof(line) - 1);
+    if (len > 0 && s_next != NULL) {
+        next_line(line, len);
+    }
+}
+
+/* "I (123) tag: msg": level letter first (after an optional colour escape), tag up to ": ". */
+static bool parse_line(const char *s, esp_log_level_t *level, const char **tag, size_t *tag_len)
+{
+    if (s[0] == '\033') {
+        const char *m = strchr(s, 'm');
+        if (m == NULL) {
+            return false;
+        }
+        s = m + 1;
+    }
+    const char *letters = "EWIDV";
+    const char *p = strchr(letters, s[0]);
+    if (s[0] == '\0' || p == NULL || s[1] != ' ' || s[2] != '(') {
+        return false;
+    }
+    *level = (esp_log_level_t)(ESP_LOG_ERROR + (p - letters));
+    const char *close = strchr(s + 3, ')');
+    if (close == NULL || close[1] != ' ') {
+        return false;
+    }
+    *tag = close + 2;
+    const char *colon = strstr(*tag, ": ");
+    if (colon == NULL) {
+        return false;
+    }
+    *tag_len = (size_t)(colon - *tag);
+    return true;
+}
+
+static int log_ctl_vprintf(const char *fmt, va_list ap)
+{
+    char buf[LOG_CTL_LINE_MAX];
+    va_list ap2;
+    va_copy(ap2, ap);
+    int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    esp_log_level_t level;
+    const char *tag;
+    size_t tag_len;
+    if (n > 0 && parse_line(buf, &level, &tag, &tag_len) && !log_ctl_allow(tag, tag_len, level)) {
+        va_end(ap2);
+        return 0;
+    }
+    if (n >= 0 && n < (int)sizeof(buf)) {
+        n = next_line(buf, (size_t)n);
+    } else {
+        n = s_next(fmt, ap2);  /* longer than buf: let the next hook format it whole */
+    }
+    va_end(ap2);
+    return n;
+}
+
+static int parse_level(const char *s, size_t len)
+{
+    static const char *names[] = { "none", "error", "warn", "info", "debug", "verbose" };
+    if (len == 1 && s[0] >= '0' && s[0] <= '5') {
+        return s[0] - '0';
+    }
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i]) == len && strncasecmp(names[i], s, len) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+static void on_cmd_log(esp_mqtt_event_handle_t event, void *ctx)
+{
+    (void)ctx;
+    if (event->current_data_offset != 0 || (event->total_data_len > 0 && event->total_data_len != event->data_len)) {
+        ESP_LOGW(TAG, "log: cmd multi-chunk not supported");
+        return;
+    }
+    const char *p = event->data;
+    const char *end = event->data + event->data_len;
+    while (p < end) {
+        while (p < end && (*p == ',' || isspace((unsigned char)*p))) {
+            p++;
+        }
+        const char *item = p;
+        while (p < end && *p != ',' && !isspace((unsigned char)*p)) {
+            p++;
+        }
+        if (p == item) {
+            break;
+        }
+        const char *eq = memchr(item, '=', (size_t)(p - item));
+        int level = eq != NULL ? parse_level(eq + 1, (size_t)(p - eq - 1)) : -1;
+        size_t tag_len = eq != NULL ? (size_t)(eq - item) : 0;
+        if (level < 0 || tag_len == 0 || tag_len >= LOG_CTL_TAG_MAX) {
+            ESP_LOGW(TAG, "log: bad item '%.*s' (want tag=none|error|warn|info|debug|verbose)", (int)(p - item), item);
+            continue;
+        }
+        char tag[LOG_CTL_TAG_MAX];
+        memcpy(tag, item, tag_len);
+        tag[tag_len] = '\0';
+        esp_log_level_set(tag, (esp_log_level_t)level);  /* copies tag */
+        ESP_LOGI(TAG, "log: level %s=%d", tag, level);
+    }
+}
+
+void log_ctl_init(void)
+{
+    s_next = esp_log_set_vprintf(log_ctl_vprintf);
+    if (s_next == NULL) {
+        s_next = vprintf;
+    }
+    if (WB_LOG_RATE_PER_S > 0 && WB_LOG_RATE_REPORT_S > 0) {
+        const esp_timer_create_args_t args = { .callback = &log_ctl_report_cb, .name = "log_report" };
+        if (esp_timer_create(&args, &s_report_timer) == ESP_OK) {
+            esp_timer_start_periodic(s_report_timer, (uint64_t)WB_LOG_RATE_REPORT_S * 1000000ULL);
+        }
+    }
+    mqtt_topic_register(s_topic_cmd_log, 1, on_cmd_log, NULL);
+}
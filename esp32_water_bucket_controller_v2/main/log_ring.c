@@ -0,0 +1,137 @@
+/*
+ * log_ring.c - See log_ring.h. Positions are free-running uint32 byte offsets; records are a 4-byte
+ * header (length | LOG_REC_COMMIT) followed by the payload padded to 4 bytes, so headers never
+ * straddle the end of the buffer. Payloads may wrap and are copied in two parts.
+ *
+ * Every free word is zero: the consumer clears what it consumed before releasing tail, so a header
+ * slot reserved but not yet published always reads as "not committed".
+ */
+
+#include <string.h>
+#include "log_ring.h"
+
+#define LOG_REC_COMMIT 0x80000000u
+#define LOG_REC_LEN    0x0000FFFFu
+
+static uint32_t rec_size(size_t len)
+{
+    return 4u + (((uint32_t)len + 3u) & ~3u);
+}
+
+static void ring_copy_in(log_ring_t *r, uint32_t pos, const uint8_t *src, size_t len)
+{
+    uint8_t *base = (uint8_t *)r->words;
+    uint32_t off = pos & (r->cap - 1u);
+    size_t first = r->cap - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(base + off, src, first);
+    memcpy(base, src + first, len - first);
+}
+
+static void ring_copy_out(log_ring_t *r, uint32_t pos, uint8_t *dst, size_t len)
+{
+    const uint8_t *base = (const uint8_t *)r->words;
+    uint32_t off = pos & (r->cap - 1u);
+    size_t first = r->cap - off;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(dst, base + off, first);
+    memcpy(dst + first, base, len - first);
+}
+
+static void ring_zero(log_ring_t *r, uint32_t pos, size_t len)
+{
+    uint8_t *base = (uint8_t *)r->words;
+    uint32_t off = pos & (r->cap - 1u);
+    size_t first = r->cap - off;
+    if (first > len) {
+        first = len;
+    }
+    memset(base + off, 0, first);
+    memset(base, 0, len - first);
+}
+
+void log_ring_init(log_ring_t *r, uint32_t *words, uint32_t cap)
+{
+    memset(words, 0, cap);
+    r->words = words;
+    r->cap = cap;
+    r->head = 0;
+    r->tail = 0;
+    r->dropped_bytes = 0;
+}
+
+bool log_ring_write(log_ring_t *r, const void *data, size_t len, bool *was_empty)
+{
+    if (was_empty != NULL) {
+        *was_empty = false;
+    }
+    if (len == 0) {
+        return true;
+    }
+    uint32_t need = rec_size(len);
+    if (len > LOG_RING_REC_MAX || need > r->cap) {
+        __atomic_fetch_add(&r->dropped_bytes, (uint32_t)len, __ATOMIC_RELAXED);
+        return false;
+    }
+    uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    uint32_t tail;
+    do {
+        tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        if (head - tail + need > r->cap) {
+            __atomic_fetch_add(&r->dropped_bytes, (uint32_t)len, __ATOMIC_RELAXED);
+            return false;
+        }
+    } while (!__atomic_compare_exchange_n(&r->head, &head, head + need, true,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    ring_copy_in(r, head + 4u, (const uint8_t *)data, len);
+    uint32_t *hdr = &r->words[(head & (r->cap - 1u)) / 4u];
+    __atomic_store_n(hdr, (uint32_t)len | LOG_REC_COMMIT, __ATOMIC_RELEASE);
+    if (was_empty != NULL) {
+        *was_empty = head == tail;
+    }
+    return true;
+}
+
+static size_t ring_read(log_ring_t *r, void *out, size_t max, bool one)
+{
+    uint8_t *dst = (uint8_t *)out;
+    size_t copied = 0;
+    uint32_t tail = r->tail;
+    for (bool more = true; more; more = !one) {
+        uint32_t *hdr = &r->words[(tail & (r->cap - 1u)) / 4u];
+        uint32_t h = __atomic_load_n(hdr, __ATOMIC_ACQUIRE);
+        if ((h & LOG_REC_COMMIT) == 0) {
+            break;  /* empty, or the oldest writer has not published yet */
+        }
+        size_t len = h & LOG_REC_LEN;
+        if (copied + len > max) {
+            break;
+        }
+        ring_copy_out(r, tail + 4u, dst + copied, len);
+        copied += len;
+        uint32_t sz = rec_size(len);
+        ring_zero(r, tail, sz);
+        tail += sz;
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    return copied;
+}
+
+size_t log_ring_read(log_ring_t *r, void *out, size_t max)
+{
+    return ring_read(r, out, max, false);
+}
+
+size_t log_ring_read_one(log_ring_t *r, void *out, size_t max)
+{
+    return ring_read(r, out, max, true);
+}
+
+uint32_t log_ring_take_dropped(log_ring_t *r)
+{
+    return __atomic_exchange_n(&r->dropped_bytes, 0u, __ATOMIC_RELAXED);
+}
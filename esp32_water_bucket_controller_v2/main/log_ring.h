@@ -0,0 +1,36 @@
+/*
+ * log_ring.h - Multi-producer, single-consumer lock-free byte ring for log lines.
+ *
+ * Producers reserve space with a CAS on head, copy their bytes, then publish the record by
+ * storing its header word; they never wait. When the ring is full the line is dropped and
+ * counted. The single consumer drains committed records in order and zeroes what it consumed.
+ */
+
+#ifndef WB_LOG_RING_H
+#define WB_LOG_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_RING_REC_MAX 1024u
+
+typedef struct {
+    uint32_t *words;     /* cap / 4 words, zero-initialised */
+    uint32_t cap;        /* bytes, power of two */
+    uint32_t head;       /* reserve position (producers) */
+    uint32_t tail;       /* consume position (consumer) */
+    uint32_t dropped_bytes;
+} log_ring_t;
+
+void log_ring_init(log_ring_t *r, uint32_t *words, uint32_t cap);
+/* Returns false (and counts the bytes as dropped) when there is no room. *was_empty tells the
+ * caller whether the consumer may be idle and needs a wake-up. */
+bool log_ring_write(log_ring_t *r, const void *data, size_t len, bool *was_empty);
+/* Copies whole records into out (up to max bytes); returns bytes copied. Consumer only. */
+size_t log_ring_read(log_ring_t *r, void *out, size_t max);
+/* Like log_ring_read() but copies at most one record, for streams whose records are not self-delimiting. */
+size_t log_ring_read_one(log_ring_t *r, void *out, size_t max);
+uint32_t log_ring_take_dropped(log_ring_t *r);
+
+#endif
@@ -1,5 +1,17 @@
 /*
- * log_tcp.c - When WB_LOG_TCP_PORT > 0: hook esp_log vprintf and mirror log lines to a single TCP client. One client at a time; new connect drops previous.
+ * log_tcp.c - When WB_LOG_TCP_PORT > 0: hook esp_log vprintf and mirror log lines to up to
+ * WB_LOG_TCP_MAX_CLIENTS TCP clients.
+ *
+ * The hook never touches a socket: it formats the line, appends it to a lock-free ring (log_ring.c) and
+ * notifies the log_tx task when the ring was empty. log_tx drains the ring into a retained history of
+ * WB_LOG_HISTORY_SIZE bytes and sends it to every client with non-blocking sends; it sleeps until the
+ * next notification, or retries every LOG_TX_RETRY_MS while a client's socket is full. Each client has
+ * its own cursor; a new client gets the last WB_LOG_TCP_REPLAY bytes, and a client that falls out of
+ * the history window is skipped forward to the oldest retained line (marked in its stream) instead of
+ * holding anyone up. The log_tcp task only accepts clients and notices them closing, in a select()
+ * without a timeout. s_hist_mux covers history and clients between the two tasks, never the hook.
+ * Binary log records (log_bin.c) are written into the same ring, framed by WB_LOG_BIN_FRAME, so log_tx
+ * meets them in the order they were logged and formats each one into the history in place.
  */
 
 #include <stdarg.h>
@@ -10,15 +22,68 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "log_bin.h"
+#include "log_ring.h"
 #include "lwip/sockets.h"
+#include "priv.h"
 #include "wb_config.h"
 
 #if WB_LOG_TCP_PORT > 0
 
-static int s_client_sock = -1;
-static SemaphoreHandle_t s_client_mux;
+#ifndef WB_LOG_RING_SIZE
+#define WB_LOG_RING_SIZE 8192  /* bytes, power of two */
+#endif
+#ifndef WB_LOG_HISTORY_SIZE
+#define WB_LOG_HISTORY_SIZE 16384  /* bytes, power of two */
+#endif
+#ifndef WB_LOG_TCP_REPLAY
+#define WB_LOG_TCP_REPLAY 8192  /* bytes replayed to a new client */
+#endif
+#ifndef WB_LOG_TCP_MAX_CLIENTS
+#define WB_LOG_TCP_MAX_CLIENTS 4
+#endif
+
+#define LOG_DRAIN_BATCH 1024
+#define LOG_TX_RETRY_MS 20     /* while a client's socket is full */
+#define LOG_SELECT_ERR_MS 100
+
+_Static_assert((WB_LOG_RING_SIZE & (WB_LOG_RING_SIZE - 1)) == 0, "WB_LOG_RING_SIZE must be a power of two");
+_Static_assert((WB_LOG_HISTORY_SIZE & (WB_LOG_HISTORY_SIZE - 1)) == 0, "WB_LOG_HISTORY_SIZE must be a power of two");
+
+typedef struct {
+    int sock;
+    uint32_t cursor;  /* absolute history position of the next byte to send */
+    bool failed;      /* send error; log_tcp closes it when select() reports it */
+} log_client_t;
+
 static vprintf_like_t s_orig;
 
+static int log_orig_printf(const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = s_orig(fmt, ap);
+    va_end(ap);
+    return n;
+}
+static uint32_t s_ring_words[WB_LOG_RING_SIZE / 4];
+static log_ring_t s_ring;
+static TaskHandle_t s_tx_task;
+
+/* Retained history and clients; under s_hist_mux (log_tx, log_tcp). */
+static SemaphoreHandle_t s_hist_mux;
+static char s_hist[WB_LOG_HISTORY_SIZE];
+static uint32_t s_hist_head;
+static log_client_t s_clients[WB_LOG_TCP_MAX_CLIENTS];
+
+static void ring_put(const char *buf, size_t len)
+{
+    bool was_empty = false;
+    if (log_ring_write(&s_ring, buf, len, &was_empty) && was_empty && s_tx_task != NULL) {
+        xTaskNotifyGive(s_tx_task);
+    }
+}
+
 static int log_vprintf(const char *fmt, va_list ap)
 {
     char buf[256];
@@ -29,21 +94,193 @@ static int log_vprintf(const char *fmt, va_list ap)
         s_orig(fmt, ap2);  // always send to original (e.g. serial)
     }
     va_end(ap2);
-    if (s_client_sock >= 0) {
-        xSemaphoreTake(s_client_mux, portMAX_DELAY);
-        if (s_client_sock >= 0) {
-            send(s_client_sock, buf, (size_t)n, 0);
-        }
-        xSemaphoreGive(s_client_mux);
+    if (n > (int)sizeof(buf) - 1) {
+        n = (int)sizeof(buf) - 1;
+    }
+    if (n > 0) {
+        ring_put(buf, (size_t)n);
     }
     return n;
 }
 
+/* A line log_ctl has already formatted: copied to serial and the ring without another vsnprintf. */
+static int log_tcp_line(const char *line, size_t len)
+{
+    if (s_orig == vprintf) {
+        fwrite(line, 1, len, stdout);
+    } else if (s_orig != NULL) {
+        log_orig_printf("%.*s", (int)len, line);
+    }
+    if (len > 0) {
+        ring_put(line, len < LOG_RING_REC_MAX ? len : LOG_RING_REC_MAX);
+    }
+    return (int)len;
+}
+
+static void log_tx_wake(void)
+{
+    if (s_tx_task != NULL) {
+        xTaskNotifyGive(s_tx_task);
+    }
+}
+
+static void hist_append(const char *data, size_t len)
+{
+    while (len > 0) {
+        uint32_t off = s_hist_head & (WB_LOG_HISTORY_SIZE - 1);
+        size_t chunk = WB_LOG_HISTORY_SIZE - off;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(s_hist + off, data, chunk);
+        s_hist_head += (uint32_t)chunk;
+        data += chunk;
+        len -= chunk;
+    }
+}
+
+static uint32_t hist_oldest(void)
+{
+    return s_hist_head > WB_LOG_HISTORY_SIZE ? s_hist_head - WB_LOG_HISTORY_SIZE : 0;
+}
+
+/* First position >= pos that starts a line (or head if no newline follows). */
+static uint32_t hist_line_start(uint32_t pos)
+{
+    if (pos == 0) {
+        return 0;
+    }
+    while (pos < s_hist_head) {
+        if (s_hist[(pos - 1) & (WB_LOG_HISTORY_SIZE - 1)] == '\n') {
+            return pos;
+        }
+        pos++;
+    }
+    return pos;
+}
+
+static void hist_sink(const char *data, size_t len, void *ctx)
+{
+    (void)ctx;
+    hist_append(data, len);
+}
+
+static void log_drain_ring(void)
+{
+    static char batch[LOG_DRAIN_BATCH];
+    uint32_t dropped = log_ring_take_dropped(&s_ring);
+    if (dropped > 0) {
+        char note[48];
+        int m = snprintf(note, sizeof(note), "*** dropped %lu bytes ***\n", (unsigned long)dropped);
+        hist_append(note, (size_t)m);
+    }
+    /* One record at a time: a binary record is not delimited like a text line. */
+    size_t n;
+    while ((n = log_ring_read_one(&s_ring, batch, sizeof(batch))) > 0) {
+        if (batch[0] == WB_LOG_BIN_FRAME) {
+            log_bin_emit(batch + 1, n - 1, hist_sink, NULL);
+        } else {
+            hist_append(batch, n);
+        }
+    }
+}
+
+static void client_close(log_client_t *c)
+{
+    close(c->sock);
+    c->sock = -1;
+}
+
+static void client_accept(int listen_sock)
+{
+    struct sockaddr_in client_addr;
+    socklen_t len = sizeof(client_addr);
+    int sock = accept(listen_sock, (struct sockaddr *)&client_addr, &len);
+    if (sock < 0) {
+        return;
+    }
+    log_client_t *slot = NULL;
+    for (int i = 0; i < WB_LOG_TCP_MAX_CLIENTS; i++) {
+        if (s_clients[i].sock < 0) {
+            slot = &s_clients[i];
+            break;
+        }
+    }
+    if (slot == NULL) {
+        const char *busy = "*** TCP log: too many clients ***\n";
+        send(sock, busy, strlen(busy), MSG_DONTWAIT);
+        close(sock);
+        return;
+    }
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    const char *msg = "\n*** TCP log connected ***\n";
+    send(sock, msg, strlen(msg), 0);
+    uint32_t from = s_hist_head > WB_LOG_TCP_REPLAY ? s_hist_head - WB_LOG_TCP_REPLAY : 0;
+    if (from < hist_oldest()) {
+        from = hist_oldest();
+    }
+    slot->sock = sock;
+    slot->cursor = hist_line_start(from);
+    slot->failed = false;
+}
+
+/* Sends as much pending history as the socket takes without blocking. */
+static void client_flush(log_client_t *c)
+{
+    if (c->cursor < hist_oldest()) {
+        uint32_t to = hist_line_start(hist_oldest());
+        char note[48];
+        int m = snprintf(note, sizeof(note), "\n*** skipped %lu bytes ***\n", (unsigned long)(to - c->cursor));
+        send(c->sock, note, (size_t)m, MSG_DONTWAIT);
+        c->cursor = to;
+    }
+    while (c->cursor < s_hist_head) {
+        uint32_t off = c->cursor & (WB_LOG_HISTORY_SIZE - 1);
+        size_t chunk = WB_LOG_HISTORY_SIZE - off;
+        if (chunk > s_hist_head - c->cursor) {
+            chunk = s_hist_head - c->cursor;
+        }
+        int sent = send(c->sock, s_hist + off, chunk, MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                c->failed = true;
+            }
+            return;
+        }
+        c->cursor += (uint32_t)sent;
+        if ((size_t)sent < chunk) {
+            return;
+        }
+    }
+}
+
+static void log_tx_task(void *arg)
+{
+    (void)arg;
+    bool backlog = false;
+    for (;;) {
+        (void)ulTaskNotifyTake(pdTRUE, backlog ? pdMS_TO_TICKS(LOG_TX_RETRY_MS) : portMAX_DELAY);
+        xSemaphoreTake(s_hist_mux, portMAX_DELAY);
+        log_drain_ring();
+        backlog = false;
+        for (int i = 0; i < WB_LOG_TCP_MAX_CLIENTS; i++) {
+            log_client_t *c = &s_clients[i];
+            if (c->sock < 0 || c->failed) {
+                continue;
+            }
+            client_flush(c);
+            backlog |= !c->failed && c->cursor != s_hist_head;
+        }
+        xSemaphoreGive(s_hist_mux);
+    }
+}
+
 static void log_tcp_task(void *arg)
 {
     (void)arg;
     int listen_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (listen_sock < 0) {
+        vTaskDelete(NULL);
         return;
     }
     int opt = 1;
@@ -53,34 +290,49 @@ static void log_tcp_task(void *arg)
         .sin_addr.s_addr = htonl(INADDR_ANY),
         .sin_port = htons((uint16_t)WB_LOG_TCP_PORT),
     };
-    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
-        close(listen_sock);
-        return;
-    }
-    if (listen(listen_sock, 1) != 0) {
+    if (bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_sock, 2) != 0) {
         close(listen_sock);
+        vTaskDelete(NULL);
         return;
     }
     for (;;) {
-        struct sockaddr_in client_addr;
-        socklen_t len = sizeof(client_addr);
-        int client = accept(listen_sock, (struct sockaddr *)&client_addr, &len);
-        if (client < 0) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(listen_sock, &rfds);
+        int maxfd = listen_sock;
+        xSemaphoreTake(s_hist_mux, portMAX_DELAY);
+        for (int i = 0; i < WB_LOG_TCP_MAX_CLIENTS; i++) {
+            int sock = s_clients[i].sock;  /* only this task opens and closes client sockets */
+            if (sock >= 0) {
+                FD_SET(sock, &rfds);
+                maxfd = sock > maxfd ? sock : maxfd;
+            }
+        }
+        xSemaphoreGive(s_hist_mux);
+        if (select(maxfd + 1, &rfds, NULL, NULL, NULL) < 0) {
+            vTaskDelay(pdMS_TO_TICKS(LOG_SELECT_ERR_MS));
             continue;
         }
-        xSemaphoreTake(s_client_mux, portMAX_DELAY);
-        s_client_sock = client;
-        xSemaphoreGive(s_client_mux);
-        const char *msg = "\n*** TCP log connected ***\n";
-        send(client, msg, (size_t)strlen(msg), 0);
-        char discard[64];
-        while (recv(client, discard, sizeof(discard), 0) > 0) {
+        xSemaphoreTake(s_hist_mux, portMAX_DELAY);
+        for (int i = 0; i < WB_LOG_TCP_MAX_CLIENTS; i++) {
+            log_client_t *c = &s_clients[i];
+            if (c->sock < 0 || !FD_ISSET(c->sock, &rfds)) {
+                continue;
+            }
+            char discard[64];
+            int r = recv(c->sock, discard, sizeof(discard), MSG_DONTWAIT);
+            if (c->failed || r == 0 || (r < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+                client_close(c);  // client closed or error
+            }
+        }
+        bool accepted = FD_ISSET(listen_sock, &rfds);
+        if (accepted) {
+            client_accept(listen_sock);
+        }
+        xSemaphoreGive(s_hist_mux);
+        if (accepted) {
+            log_tx_wake();  /* send the new client its replay */
         }
-        // recv <= 0: client closed or error; fall through and clear s_client_sock, then accept next
-        xSemaphoreTake(s_client_mux, portMAX_DELAY);
-        close(s_client_sock);
-        s_client_sock = -1;
-        xSemaphoreGive(s_client_mux);
     }
 }
 
@@ -89,11 +341,18 @@ void log_tcp_init(void)
     if (WB_LOG_TCP_PORT <= 0) {
         return;
     }
-    s_client_mux = xSemaphoreCreateMutex();
-    if (s_client_mux == NULL) {
+    log_ring_init(&s_ring, s_ring_words, WB_LOG_RING_SIZE);
+    for (int i = 0; i < WB_LOG_TCP_MAX_CLIENTS; i++) {
+        s_clients[i].sock = -1;
+    }
+    s_hist_mux = xSemaphoreCreateMutex();
+    if (s_hist_mux == NULL || xTaskCreate(log_tx_task, "log_tx", 3072, NULL, 4, &s_tx_task) != pdPASS) {
         return;
     }
     s_orig = esp_log_set_vprintf(log_vprintf);
+    log_bin_set_console(s_orig);  // binary records echo to serial without re-entering the ring
+    log_bin_set_stream(&s_ring, log_tx_wake);
+    log_ctl_set_line_out(log_tcp_line);
     xTaskCreate(log_tcp_task, "log_tcp", 3072, NULL, 5, NULL);
 }
 
@@ -1,6 +1,9 @@
 /*
- * app_main init order: NVS -> mutex -> gpio (decoder+levels) -> ui_test (OLED+encoder) ->
- * ota_check_rollback -> netif/event -> wifi -> log_tcp -> MQTT -> 200ms level timer -> block.
+ * app_main init order: NVS -> mutex -> log_bin -> evlog (flash event journal) -> gpio (decoder+levels) -> first level read + 200ms level timer ->
+ * ui_test (OLED+encoder) -> health_start (post-OTA gate) -> netif/event -> log_tcp -> log_ctl ->
+ * MQTT (publish stage, topic handlers, client; not started) -> wifi_start -> resume pending OTA -> return.
+ * Nothing waits for the network: pump safety runs from the first milliseconds, and WiFi (then SNTP and MQTT)
+ * come up and reconnect from their event handlers.
  */
 
 #include <cstring>
@@ -13,6 +16,7 @@
 #include "freertos/task.h"
 #include "mqtt_client.h"
 #include "nvs_flash.h"
+#include "log_bin.h"
 #include "priv.h"
 #include "wb_config.h"
 
@@ -29,16 +33,29 @@ extern "C" void app_main(void)
         ESP_LOGE(TAG, "app_main: mutex create failed, aborting");
         return;
     }
+    log_bin_init();  // binary log ring consumer (no-op unless WB_LOG_BINARY)
+    evlog_start();  // before ui_test: the logs page starts from the journal's newest entries
     ESP_LOGI(TAG, "app_main: gpio_init");
     gpio_init();
+    read_levels();  // all-dry safety from the first moment, before anything network-related
+    ESP_LOGI(TAG, "app_main: create level timer 200 ms");
+    const esp_timer_create_args_t timer_args = {
+        .callback = &level_timer_cb,
+        .arg = nullptr,
+        .dispatch_method = ESP_TIMER_TASK,  // callback runs in timer task, not ISR
+        .name = "level",
+        .skip_unhandled_events = false
+    };
+    esp_timer_handle_t level_timer = nullptr;
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &level_timer));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(level_timer, 200000));  // 200 ms = 200000 us
     ui_test_init();
-    ota_check_rollback();  // if we just booted from OTA and state is PENDING_VERIFY, confirm or rollback; must run after gpio_init (diagnostic reads level pins)
+    health_start();  // times boot to healthy; a PENDING_VERIFY image is confirmed only once IP, MQTT, UI and level loop are up
     ESP_LOGI(TAG, "app_main: netif and event loop");
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());  // WiFi/MQTT handlers post to this
-    ESP_LOGI(TAG, "app_main: wifi_init_blocking");
-    wifi_init_blocking();
     log_tcp_init();
+    log_ctl_init();  // outermost log hook (rate limit) + water_bucket/cmd/log; before the MQTT client starts
     ESP_LOGI(TAG, "app_main: mqtt client init uri=%s", WB_MQTT_BROKER_URI);
     if (strstr(WB_MQTT_BROKER_URI, ":8123") != nullptr) {
         ESP_LOGW(TAG, "app_main: port 8123 is usually HTTP (e.g. Home Assistant); use 1883 for MQTT");
@@ -56,28 +73,23 @@ extern "C" void app_main(void)
     mqtt_cfg.session.last_will.msg_len = (int)sizeof(lwt_msg) - 1;  // exclude NUL
     mqtt_cfg.session.last_will.qos = 1;
     mqtt_cfg.session.last_will.retain = 1;  // so HA sees last state after reboot
+    mqtt_cfg.network.disable_auto_reconnect = true;  // mqtt.c reconnects with backoff and on new IP
     s_mqtt_client = esp_mqtt_client_init(&mqtt_cfg);
     if (s_mqtt_client == nullptr) {
-        ESP_LOGE(TAG, "app_main: mqtt client init failed, blocking");
-        vTaskDelay(portMAX_DELAY);
-        return;
+        ESP_LOGE(TAG, "app_main: mqtt client init failed, continuing without MQTT");
     }
-    ESP_LOGI(TAG, "app_main: mqtt register event handler and start");
-    ESP_ERROR_CHECK(esp_mqtt_client_register_event(s_mqtt_client,
-                                                    (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID,
-                                                    mqtt_event, nullptr));
-    ESP_ERROR_CHECK(esp_mqtt_client_start(s_mqtt_client));
-    ESP_LOGI(TAG, "app_main: create level timer 200 ms");
-    const esp_timer_create_args_t timer_args = {
-        .callback = &level_timer_cb,
-        .arg = nullptr,
-        .dispatch_method = ESP_TIMER_TASK,  // callback runs in timer task, not ISR
-        .name = "level",
-        .skip_unhandled_events = false
-    };
-    esp_timer_handle_t level_timer = nullptr;
-    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &level_timer));
-    ESP_ERROR_CHECK(esp_timer_start_periodic(level_timer, 200000));  // 200 ms = 200000 us
-    ESP_LOGI(TAG, "app_main: init done, entering main loop (block)");
-    vTaskDelay(portMAX_DELAY);  // no main loop; work is in timer callback and MQTT event handler
+    mqtt_pub_init();
+    if (s_mqtt_client != nullptr) {
+        mqtt_topics_init();  // command topic handlers; must be registered before the client connects
+        mqtt_reconnect_init();
+        ESP_LOGI(TAG, "app_main: mqtt register event handler (client starts on first IP)");
+        ESP_ERROR_CHECK(esp_mqtt_client_register_event(s_mqtt_client,
+                                                        (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID,
+                                                        mqtt_event, nullptr));
+    }
+    ESP_LOGI(TAG, "app_main: wifi_start");
+    wifi_start();
+    ota_resume_pending();  // continue an OTA download interrupted by a reboot
+    ESP_LOGI(TAG, "app_main: init done");
+    // no main loop; work is in the level timer, WiFi/MQTT event handlers and their tasks
 }
@@ -0,0 +1,58 @@
+/*
+ * mqtt_disc.c - Discovery document tables for six pump switches and three level sensors; see mqtt_disc.h.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "mqtt_disc.h"
+
+#define DISC_AVAIL_DEVICE \
+    "\"availability_topic\":\"" WB_TOPIC_STATUS "\",\"payload_available\":\"online\",\"payload_not_available\":\"offline\"," \
+    "\"device\":{\"identifiers\":[\""
+#define DISC_TAIL \
+    "\"],\"name\":\"Water Bucket\",\"model\":\"Water Bucket Controller\",\"manufacturer\":\"DIY\"}}"
+
+#define DISC_LEVEL_HEAD(n) \
+    "{\"name\":\"Level " #n "\",\"state_topic\":\"" WB_TOPIC_STATE_LEVEL(n) "\",\"payload_on\":\"1\",\"payload_off\":\"0\"," \
+    "\"unique_id\":\"water_bucket_level_" #n "\"," DISC_AVAIL_DEVICE
+#define DISC_PUMP_HEAD(n) \
+    "{\"name\":\"Pump " #n "\",\"command_topic\":\"" WB_TOPIC_CMD_PUMP "\",\"state_topic\":\"" WB_TOPIC_STATE_PUMP "\"," \
+    "\"payload_on\":\"" #n "\",\"payload_off\":\"off\",\"value_template\":\"{{ 'ON' if value == '" #n "' else 'OFF' }}\"," \
+    "\"state_on\":\"ON\",\"state_off\":\"OFF\",\"unique_id\":\"water_bucket_pump_" #n "\"," DISC_AVAIL_DEVICE
+
+#define DISC_ENTRY(topic, head) { topic, head, (uint16_t)(sizeof(head) - 1) }
+#define DISC_LEVEL(n) DISC_ENTRY(DISCOVERY_PREFIX "/binary_sensor/water_bucket_level_" #n "/config", DISC_LEVEL_HEAD(n))
+#define DISC_PUMP(n)  DISC_ENTRY(DISCOVERY_PREFIX "/switch/water_bucket_pump_" #n "/config", DISC_PUMP_HEAD(n))
+
+_Static_assert(sizeof(DISC_LEVEL_HEAD(1)) <= sizeof(DISC_PUMP_HEAD(0)), "pump documents are the longest");
+_Static_assert(sizeof(DISC_PUMP_HEAD(0)) - 1 + DEVICE_ID_LEN + sizeof(DISC_TAIL) - 1 <= DISC_MSG_MAX,
+               "DISC_MSG_MAX too small");
+
+typedef struct {
+    const char *topic;
+    const char *head;
+    uint16_t head_len;
+} disc_msg_t;
+
+static const disc_msg_t s_disc_msgs[] = {
+    DISC_LEVEL(1), DISC_LEVEL(2), DISC_LEVEL(3),
+    DISC_PUMP(0), DISC_PUMP(1), DISC_PUMP(2), DISC_PUMP(3), DISC_PUMP(4), DISC_PUMP(5),
+};
+
+size_t mqtt_disc_count(void)
+{
+    return sizeof(s_disc_msgs) / sizeof(s_disc_msgs[0]);
+}
+
+size_t mqtt_disc_build(size_t i, const char *device_id, char *buf, const char **topic)
+{
+    const disc_msg_t *m = &s_disc_msgs[i];
+    size_t len = m->head_len;
+    memcpy(buf, m->head, len);
+    memcpy(buf + len, device_id, DEVICE_ID_LEN);
+    len += DEVICE_ID_LEN;
+    memcpy(buf + len, DISC_TAIL, sizeof(DISC_TAIL) - 1);
+    len += sizeof(DISC_TAIL) - 1;
+    *topic = m->topic;
+    return len;
+}
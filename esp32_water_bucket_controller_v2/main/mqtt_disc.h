@@ -0,0 +1,37 @@
+/*
+ * mqtt_disc.h - Home Assistant discovery documents, built from compile-time tables (mqtt_disc.c).
+ *
+ * Each document is a string literal split at the only per-device field (the identifier):
+ * head + device_id + tail. Lengths come from sizeof, so building one only memcpys three segments;
+ * nothing is formatted. Pure C so tools/mqtt_disc_test.c can check the output on the host.
+ */
+
+#ifndef WB_MQTT_DISC_H
+#define WB_MQTT_DISC_H
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define WB_TOPIC_CMD_PUMP        "water_bucket/cmd/pump"
+#define WB_TOPIC_CMD_OTA         "water_bucket/cmd/ota"
+#define WB_TOPIC_STATE_PUMP      "water_bucket/state/pump"
+#define WB_TOPIC_STATE_LEVEL(n)  "water_bucket/state/level_" #n
+#define WB_TOPIC_STATUS          "water_bucket/status"
+
+#define DISCOVERY_PREFIX "homeassistant"
+
+#define DEVICE_ID_LEN 25        /* "water_bucket_" + 12 hex MAC digits */
+#define DISC_MSG_MAX  600       /* checked against the longest document in mqtt_disc.c */
+
+size_t mqtt_disc_count(void);
+/* Document i for device_id (DEVICE_ID_LEN chars) into buf (DISC_MSG_MAX bytes); returns its length. */
+size_t mqtt_disc_build(size_t i, const char *device_id, char *buf, const char **topic);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
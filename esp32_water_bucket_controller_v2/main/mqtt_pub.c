@@ -0,0 +1,259 @@
+/*
+ * mqtt_pub.c - Outbound state stage. Producers (level timer, set_pump, MQTT task) call mqtt_pub_set();
+ * each state topic keeps its pending and last-sent value, unchanged values are dropped, and a burst
+ * within WB_MQTT_PUB_COALESCE_MS collapses to the final value. One task (mqtt_pub) does every publish.
+ *
+ * Nothing is sent while MQTT is down: transitions are recorded in journal.c for replay, and
+ * mqtt_pub_resync() on connect forgets what the broker has so the next set of values goes out in full.
+ *
+ * WB_MQTT_STATE_JSON=1 adds one consolidated document on water_bucket/state (levels, pump, disabled,
+ * uptime, RSSI, heap), written by json_wr into s_state_buf after any flush that sent something and
+ * every WB_MQTT_STATE_HEARTBEAT_S otherwise.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "json_wr.h"
+#include "mqtt_disc.h"
+#include "priv.h"
+#include "wb_config.h"
+
+#ifndef WB_MQTT_PUB_COALESCE_MS
+#define WB_MQTT_PUB_COALESCE_MS 50
+#endif
+#ifndef WB_MQTT_STATE_JSON
+#define WB_MQTT_STATE_JSON 0
+#endif
+#ifndef WB_MQTT_STATE_HEARTBEAT_S
+#define WB_MQTT_STATE_HEARTBEAT_S 60
+#endif
+
+#define PUB_PAYLOAD_MAX   8
+#define PUB_STATS_LOG_MS  60000
+
+static const char *TAG = "wb";
+
+typedef struct {
+    const char *topic;
+    char pending[PUB_PAYLOAD_MAX];
+    char sent[PUB_PAYLOAD_MAX];
+    uint8_t pending_len;
+    uint8_t sent_len;
+    bool dirty;
+    bool have_sent;
+} pub_slot_t;
+
+static pub_slot_t s_slots[WB_PUB_COUNT] = {
+    [WB_PUB_LEVEL_1] = { .topic = WB_TOPIC_STATE_LEVEL(1) },
+    [WB_PUB_LEVEL_2] = { .topic = WB_TOPIC_STATE_LEVEL(2) },
+    [WB_PUB_LEVEL_3] = { .topic = WB_TOPIC_STATE_LEVEL(3) },
+    [WB_PUB_PUMP]    = { .topic = WB_TOPIC_STATE_PUMP },
+};
+
+static portMUX_TYPE s_pub_mux = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t s_pub_task;
+static mqtt_pub_stats_t s_stats;
+#if WB_MQTT_STATE_JSON
+static char s_state_buf[192];
+#endif
+
+void mqtt_pub_set(wb_pub_topic_t topic, const char *payload, size_t len)
+{
+    if ((unsigned)topic >= WB_PUB_COUNT || payload == NULL || len > PUB_PAYLOAD_MAX) {
+        return;
+    }
+    pub_slot_t *s = &s_slots[topic];
+    bool wake = false;
+    bool spill = false;
+    journal_stamp_t stamp;
+    journal_stamp(&stamp);  /* reads the clock, so not inside the critical section */
+    taskENTER_CRITICAL(&s_pub_mux);
+    bool same_as_sent = s->have_sent && s->sent_len == len && memcmp(s->sent, payload, len) == 0;
+    bool same_as_pending = s->dirty && s->pending_len == len && memcmp(s->pending, payload, len) == 0;
+    bool transition = s->dirty ? !same_as_pending : !same_as_sent;
+    if (same_as_sent || same_as_pending) {
+        s->dirty = s->dirty && !same_as_sent;  /* a burst back to what the broker has sends nothing */
+        s_stats.suppressed++;
+    } else {
+        if (s->dirty) {
+            s_stats.coalesced++;  /* a different pending value is replaced */
+        }
+        memcpy(s->pending, payload, len);
+        s->pending_len = (uint8_t)len;
+        wake = !s->dirty;
+        s->dirty = true;
+    }
+    if (transition && !s_mqtt_connected_state) {
+        /* Journalled in the order the slot saw the values, not the order producers leave the lock. */
+        spill = journal_record(topic, payload, len, &stamp);
+    }
+    taskEXIT_CRITICAL(&s_pub_mux);
+    if ((wake || spill) && s_pub_task != NULL) {
+        xTaskNotifyGive(s_pub_task);
+    }
+}
+
+const char *mqtt_pub_topic_name(wb_pub_topic_t topic)
+{
+    if ((unsigned)topic >= WB_PUB_COUNT) {
+        return "?";
+    }
+    return s_slots[topic].topic + sizeof("water_bucket/state/") - 1;
+}
+
+void mqtt_pub_resync(void)
+{
+    taskENTER_CRITICAL(&s_pub_mux);
+    for (size_t i = 0; i < WB_PUB_COUNT; i++) {
+        s_slots[i].have_sent = false;
+    }
+    taskEXIT_CRITICAL(&s_pub_mux);
+}
+
+void mqtt_pub_get_stats(mqtt_pub_stats_t *out)
+{
+    taskENTER_CRITICAL(&s_pub_mux);
+    *out = s_stats;
+    taskEXIT_CRITICAL(&s_pub_mux);
+}
+
+/* Returns how many topics were published. */
+static size_t pub_flush(void)
+{
+    if (s_mqtt_client == NULL || !s_mqtt_connected_state) {
+        return 0;  /* stay dirty; resync on connect re-sends */
+    }
+    size_t sent = 0;
+    for (size_t i = 0; i < WB_PUB_COUNT; i++) {
+        pub_slot_t *s = &s_slots[i];
+        char payload[PUB_PAYLOAD_MAX];
+        uint8_t len = 0;
+        bool send = false;
+        taskENTER_CRITICAL(&s_pub_mux);
+        if (s->dirty) {
+            len = s->pending_len;
+            memcpy(payload, s->pending, len);
+            memcpy(s->sent, s->pending, len);
+            s->sent_len = len;
+            s->have_sent = true;
+            s->dirty = false;
+            s_stats.sent++;
+            send = true;
+        }
+        taskEXIT_CRITICAL(&s_pub_mux);
+        if (send) {
+            esp_mqtt_client_publish(s_mqtt_client, s->topic, payload, len, 0, 0);
+            ESP_LOGD(TAG, "mqtt_pub: %s=%.*s", s->topic, (int)len, payload);
+            sent++;
+        }
+    }
+    return sent;
+}
+
+#if WB_MQTT_STATE_JSON
+static void publish_state_json(void)
+{
+    if (s_mqtt_client == NULL || !s_mqtt_connected_state) {
+        return;
+    }
+    jw_t w;
+    jw_init(&w, s_state_buf, sizeof(s_state_buf));
+    jw_obj_begin(&w);
+    jw_key(&w, "levels");
+    jw_arr_begin(&w);
+    for (size_t i = 0; i < WB_NUM_LEVELS; i++) {
+        jw_int(&w, s_level[i]);
+    }
+    jw_arr_end(&w);
+    jw_key(&w, "pump");
+    uint8_t pump = s_current_pump;
+    if (pump < WB_NUM_PUMPS) {
+        jw_uint(&w, pump);
+    } else {
+        jw_str(&w, "off");
+    }
+    jw_key(&w, "disabled");
+    jw_bool(&w, s_pumps_disabled);
+    jw_key(&w, "uptime");
+    jw_uint(&w, (uint32_t)(esp_timer_get_time() / 1000000LL));
+    wifi_ap_record_t ap;
+    jw_key(&w, "rssi");
+    if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
+        jw_int(&w, ap.rssi);
+    } else {
+        jw_int(&w, 0);
+    }
+    jw_key(&w, "heap");
+    jw_uint(&w, esp_get_free_heap_size());
+    jw_obj_end(&w);
+    int len = jw_finish(&w);
+    if (len < 0) {
+        ESP_LOGW(TAG, "mqtt_pub: state document overflow");
+        return;
+    }
+    esp_mqtt_client_publish(s_mqtt_client, "water_bucket/state", s_state_buf, len, 0, 0);
+    taskENTER_CRITICAL(&s_pub_mux);
+    s_stats.sent++;
+    taskEXIT_CRITICAL(&s_pub_mux);
+}
+#endif
+
+static void mqtt_pub_task(void *arg)
+{
+    (void)arg;
+    TickType_t last_stats = xTaskGetTickCount();
+#if WB_MQTT_STATE_JSON
+    TickType_t last_state = last_stats;
+    const TickType_t wait = pdMS_TO_TICKS(WB_MQTT_STATE_HEARTBEAT_S * 1000) < pdMS_TO_TICKS(PUB_STATS_LOG_MS)
+                                ? pdMS_TO_TICKS(WB_MQTT_STATE_HEARTBEAT_S * 1000)
+                                : pdMS_TO_TICKS(PUB_STATS_LOG_MS);
+#else
+    const TickType_t wait = pdMS_TO_TICKS(PUB_STATS_LOG_MS);
+#endif
+    for (;;) {
+        size_t sent = 0;
+        if (ulTaskNotifyTake(pdTRUE, wait) != 0) {
+            vTaskDelay(pdMS_TO_TICKS(WB_MQTT_PUB_COALESCE_MS));  /* let the burst settle */
+            sent = pub_flush();
+        }
+#if WB_MQTT_STATE_JSON
+        if (sent > 0 || xTaskGetTickCount() - last_state >= pdMS_TO_TICKS(WB_MQTT_STATE_HEARTBEAT_S * 1000)) {
+            last_state = xTaskGetTickCount();
+            publish_state_json();
+        }
+#else
+        (void)sent;
+#endif
+        journal_service();
+        if (xTaskGetTickCount() - last_stats >= pdMS_TO_TICKS(PUB_STATS_LOG_MS)) {
+            last_stats = xTaskGetTickCount();
+            mqtt_pub_stats_t st;
+            mqtt_pub_get_stats(&st);
+            ESP_LOGI(TAG, "mqtt_pub: sent=%lu suppressed=%lu coalesced=%lu",
+                     (unsigned long)st.sent, (unsigned long)st.suppressed, (unsigned long)st.coalesced);
+        }
+    }
+}
+
+void mqtt_pub_kick(void)
+{
+    if (s_pub_task != NULL) {
+        xTaskNotifyGive(s_pub_task);
+    }
+}
+
+void mqtt_pub_init(void)
+{
+    if (s_pub_task != NULL) {
+        return;
+    }
+    journal_init();
+    if (xTaskCreate(mqtt_pub_task, "mqtt_pub", 3072, NULL, 5, &s_pub_task) != pdPASS) {
+        ESP_LOGE(TAG, "mqtt_pub: task create failed");
+    }
+}
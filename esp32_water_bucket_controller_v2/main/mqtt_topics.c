@@ -0,0 +1,153 @@
+/*
+ * mqtt_topics.c - Inbound topic dispatch. Modules register a handler per topic filter (exact, or with
+ * MQTT '+' / '#' wildcards) before the client starts; mqtt_event routes DATA straight from
+ * event->topic/topic_len with no copy. Exact topics live in an open-addressed FNV-1a table (one hash +
+ * one memcmp per message); wildcard filters are matched level by level only on a miss.
+ *
+ * Continuation fragments of a long payload arrive with topic_len == 0; they go to the handler that
+ * took the first fragment.
+ */
+
+#include <string.h>
+#include "esp_log.h"
+#include "priv.h"
+
+static const char *TAG = "wb";
+
+#define TOPIC_MAX      24
+#define TOPIC_HASH_CAP 32  /* power of two, > TOPIC_MAX */
+
+typedef struct {
+    const char *filter;
+    uint16_t len;
+    uint8_t qos;
+    mqtt_topic_handler_t handler;
+    void *ctx;
+} topic_entry_t;
+
+static topic_entry_t s_topics[TOPIC_MAX];
+static size_t s_topic_count;
+static uint8_t s_exact[TOPIC_HASH_CAP];  /* index + 1 into s_topics; 0 = empty */
+static uint8_t s_wild[TOPIC_MAX];
+static size_t s_wild_count;
+static const topic_entry_t *s_frag_owner;
+
+static uint32_t topic_hash(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (uint8_t)s[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static bool filter_is_wild(const char *f)
+{
+    return strchr(f, '+') != NULL || strchr(f, '#') != NULL;
+}
+
+static bool filter_match(const char *f, size_t flen, const char *t, size_t tlen)
+{
+    size_t fi = 0;
+    size_t ti = 0;
+    while (fi < flen) {
+        if (f[fi] == '#') {
+            return true;  /* matches the parent level and everything below */
+        }
+        if (f[fi] == '+') {
+            while (ti < tlen && t[ti] != '/') {
+                ti++;
+            }
+            fi++;
+            continue;
+        }
+        if (ti >= tlen) {
+            /* "a/#" also matches "a" itself */
+            return fi + 2 == flen && f[fi] == '/' && f[fi + 1] == '#';
+        }
+        if (f[fi] != t[ti]) {
+            return false;
+        }
+        fi++;
+        ti++;
+    }
+    return ti == tlen;
+}
+
+esp_err_t mqtt_topic_register(const char *filter, int qos, mqtt_topic_handler_t handler, void *ctx)
+{
+    if (filter == NULL || filter[0] == '\0' || handler == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (s_topic_count >= TOPIC_MAX) {
+        ESP_LOGE(TAG, "mqtt: topic table full, %s not registered", filter);
+        return ESP_ERR_NO_MEM;
+    }
+    size_t len = strlen(filter);
+    topic_entry_t *e = &s_topics[s_topic_count];
+    e->filter = filter;
+    e->len = (uint16_t)len;
+    e->qos = (uint8_t)qos;
+    e->handler = handler;
+    e->ctx = ctx;
+    if (filter_is_wild(filter)) {
+        s_wild[s_wild_count++] = (uint8_t)s_topic_count;
+    } else {
+        uint32_t slot = topic_hash(filter, len) & (TOPIC_HASH_CAP - 1);
+        while (s_exact[slot] != 0) {
+            const topic_entry_t *o = &s_topics[s_exact[slot] - 1];
+            if (o->len == len && memcmp(o->filter, filter, len) == 0) {
+                ESP_LOGE(TAG, "mqtt: topic %s registered twice", filter);
+                return ESP_ERR_INVALID_STATE;
+            }
+            slot = (slot + 1) & (TOPIC_HASH_CAP - 1);
+        }
+        s_exact[slot] = (uint8_t)(s_topic_count + 1);
+    }
+    s_topic_count++;
+    return ESP_OK;
+}
+
+void mqtt_topic_subscribe_all(esp_mqtt_client_handle_t client)
+{
+    for (size_t i = 0; i < s_topic_count; i++) {
+        esp_mqtt_client_subscribe(client, s_topics[i].filter, s_topics[i].qos);
+    }
+    ESP_LOGI(TAG, "mqtt: subscribed %u topics", (unsigned)s_topic_count);
+}
+
+static const topic_entry_t *topic_lookup(const char *topic, size_t len)
+{
+    uint32_t slot = topic_hash(topic, len) & (TOPIC_HASH_CAP - 1);
+    while (s_exact[slot] != 0) {
+        const topic_entry_t *e = &s_topics[s_exact[slot] - 1];
+        if (e->len == len && memcmp(e->filter, topic, len) == 0) {
+            return e;
+        }
+        slot = (slot + 1) & (TOPIC_HASH_CAP - 1);
+    }
+    for (size_t i = 0; i < s_wild_count; i++) {
+        const topic_entry_t *e = &s_topics[s_wild[i]];
+        if (filter_match(e->filter, e->len, topic, len)) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+bool mqtt_topic_dispatch(esp_mqtt_event_handle_t event)
+{
+    const topic_entry_t *e;
+    if (event->topic_len == 0 && event->current_data_offset > 0) {
+        e = s_frag_owner;
+    } else {
+        e = topic_lookup(event->topic, (size_t)event->topic_len);
+        s_frag_owner = e;
+    }
+    if (e == NULL) {
+        return false;
+    }
+    e->handler(event, e->ctx);
+    return true;
+}
@@ -1,118 +1,759 @@
 /*
- * ota.c - After OTA boot: PENDING_VERIFY + level GPIO sanity -> mark valid or rollback.
- * ota_start_from_url: one OTA task at a time; downloads via esp_https_ota then reboot.
+ * ota.c - ota_start_from_url("URL [sha256hex]"): one OTA task at a time; resumable download, then reboot.
+ *
+ * The image is streamed with esp_http_client straight into the next OTA partition (sector erase just
+ * ahead of the write position). Every WB_OTA_SAVE_BYTES the sector-aligned write offset, URL, image size
+ * and partition go to NVS namespace "wb_ota". When the connection drops the task waits for WiFi and asks
+ * for "Range: bytes=<offset>-" (up to WB_OTA_MAX_RETRIES times); a 206 whose Content-Range does not start
+ * at that offset restarts the image from 0. After a reboot ota_resume_pending() restarts the same download. The SHA-256 of the bytes already in flash is recomputed from the partition
+ * on resume rather than kept in NVS (the mbedtls context is not a stable format). If the command carried
+ * a SHA-256 it must match the whole image before esp_ota_set_boot_partition, which additionally runs the
+ * bootloader's own image verification. The new image is confirmed (or rolled back) by health.c.
+ *
+ * While the running image is still ESP_OTA_IMG_PENDING_VERIFY the other slot holds the only rollback
+ * image, so nothing is erased: a command is saved to NVS as a job not yet started and, like a download
+ * interrupted by a reboot, started by ota_resume_pending() once health.c has confirmed this image.
+ *
+ * Progress goes to water_bucket/state/ota at most every WB_OTA_PROGRESS_MS (plus start, resume, retry,
+ * end and error):
+ *   {"phase":"download","bytes":N,"total":N,"percent":N,"kbps":N,"eta_s":N}
+ * kbps counts this session's bytes only. The download loop gives up the CPU for a tick every
+ * WB_OTA_YIELD_MS so the level timer and UI keep running on fast links; WB_OTA_HTTP_RX_BUF sets the HTTP
+ * receive buffer and read size.
+ *
+ * A body starting with "WBD1" is a delta patch (tools/wb_delta.py, format in delta_apply.h) rather than
+ * an image: it is inflated with the ROM tinfl into a 32 KB window and applied against the running
+ * partition, whose SHA-256 must match the patch header first. The rebuilt image goes through the same
+ * write/hash path and must match the header's target SHA-256 (and the command's, if given). A delta
+ * download is not resumable; a drop restarts it from byte 0. Progress counts image bytes written.
  */
 
 #include <stdatomic.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "esp_https_ota.h"
+#include <strings.h>
+#include "esp_http_client.h"
 #include "esp_log.h"
 #include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "json_wr.h"
+#include "delta_apply.h"
+#include "mbedtls/sha256.h"
+#include "miniz.h"
+#include "nvs.h"
 #include "priv.h"
+#include "wb_config.h"
+
+#ifndef WB_OTA_HTTP_RX_BUF
+#define WB_OTA_HTTP_RX_BUF 4096
+#endif
+#ifndef WB_OTA_PROGRESS_MS
+#define WB_OTA_PROGRESS_MS 1000
+#endif
+#ifndef WB_OTA_YIELD_MS
+#define WB_OTA_YIELD_MS 100
+#endif
+#ifndef WB_OTA_SAVE_BYTES
+#define WB_OTA_SAVE_BYTES (64 * 1024)
+#endif
+#ifndef WB_OTA_MAX_RETRIES
+#define WB_OTA_MAX_RETRIES 20
+#endif
+#ifndef WB_OTA_RETRY_MS
+#define WB_OTA_RETRY_MS 3000
+#endif
+
+#define OTA_URL_MAX     256
+#define OTA_SECTOR      4096u
+#define OTA_NVS_NS      "wb_ota"
+#define OTA_HTTP_TIMEOUT_MS 10000
+#define OTA_DELTA_OUT   4096   /* rebuilt image bytes are staged to flash in blocks of this size */
 
 static const char *TAG = "wb";
+static const char *s_topic_state_ota = "water_bucket/state/ota";
 
 static atomic_int s_ota_active;
 
-void ota_check_rollback(void)
+typedef struct {
+    char url[OTA_URL_MAX];
+    uint8_t sha[32];
+    bool have_sha;
+} ota_job_t;
+
+/* Persisted resume point; off is always sector-aligned. */
+typedef struct {
+    uint32_t part_addr;
+    uint32_t size;
+    uint32_t off;
+} ota_resume_t;
+
+typedef struct {
+    ota_job_t job;
+    const esp_partition_t *part;
+    ota_resume_t rs;
+    uint32_t off;          /* bytes written to flash */
+    uint32_t erased_to;    /* first byte not yet erased */
+    mbedtls_sha256_context sha;
+    int64_t start_us;
+    int64_t last_report_us;
+    uint32_t start_off;
+    int64_t range_start;   /* first byte in this response's Content-Range; -1 if none */
+    char buf[WB_OTA_HTTP_RX_BUF];
+    char json[192];
+} ota_ctx_t;
+
+/* Delta patch state; heap-allocated (about 48 KB) only while a patch is applied. */
+typedef struct {
+    ota_ctx_t *c;
+    const esp_partition_t *src;
+    tinfl_decompressor inflator;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+    size_t dict_ofs;
+    uint8_t hdr_raw[DELTA_HDR_SIZE];
+    size_t hdr_len;
+    delta_hdr_t hdr;
+    delta_t patch;
+    uint8_t out[OTA_DELTA_OUT];
+    size_t out_len;
+    esp_err_t io_err;
+} ota_delta_t;
+
+static void ota_clear_active(void)
 {
-    const esp_partition_t *running = esp_ota_get_running_partition();
-    if (running == NULL) {
+    atomic_store_explicit(&s_ota_active, 0, memory_order_release);
+}
+
+static void ota_report(ota_ctx_t *c, const char *phase, const char *error)
+{
+    int64_t now = esp_timer_get_time();
+    c->last_report_us = now;
+    uint32_t done = c->off;
+    uint32_t total = c->rs.size;
+    uint32_t session = done - c->start_off;
+    int64_t elapsed_ms = (now - c->start_us) / 1000;
+    uint32_t kbps = elapsed_ms > 0 ? (uint32_t)((int64_t)session * 1000 / 1024 / elapsed_ms) : 0;
+    uint32_t percent = total > 0 ? (uint32_t)((uint64_t)done * 100 / total) : 0;
+    uint32_t eta_s = 0;
+    if (total > done && session > 0) {
+        eta_s = (uint32_t)((int64_t)(total - done) * elapsed_ms / session / 1000);
+    }
+    ESP_LOGI(TAG, "ota: %s %lu/%lu bytes %lu%% %lu KB/s eta %lus", phase, (unsigned long)done,
+             (unsigned long)total, (unsigned long)percent, (unsigned long)kbps, (unsigned long)eta_s);
+    if (s_mqtt_client == NULL || !s_mqtt_connected_state) {
         return;
     }
-    esp_ota_img_states_t ota_state;
-    if (esp_ota_get_state_partition(running, &ota_state) != ESP_OK) {
+    jw_t w;
+    jw_init(&w, c->json, sizeof(c->json));
+    jw_obj_begin(&w);
+    jw_key(&w, "phase");
+    jw_str(&w, phase);
+    jw_key(&w, "bytes");
+    jw_uint(&w, done);
+    jw_key(&w, "total");
+    jw_uint(&w, total);
+    jw_key(&w, "percent");
+    jw_uint(&w, percent);
+    jw_key(&w, "kbps");
+    jw_uint(&w, kbps);
+    jw_key(&w, "eta_s");
+    jw_uint(&w, eta_s);
+    if (error != NULL) {
+        jw_key(&w, "error");
+        jw_str(&w, error);
+    }
+    jw_obj_end(&w);
+    int len = jw_finish(&w);
+    if (len > 0) {
+        esp_mqtt_client_publish(s_mqtt_client, s_topic_state_ota, c->json, len, 0, 0);
+    }
+}
+
+static void ota_state_save(const ota_ctx_t *c)
+{
+    nvs_handle_t h;
+    if (nvs_open(OTA_NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
         return;
     }
-    if (ota_state != ESP_OTA_IMG_PENDING_VERIFY) {
+    nvs_set_str(h, "url", c->job.url);
+    nvs_set_blob(h, "rs", &c->rs, sizeof(c->rs));
+    if (c->job.have_sha) {
+        nvs_set_blob(h, "sha", c->job.sha, sizeof(c->job.sha));
+    } else {
+        nvs_erase_key(h, "sha");
+    }
+    nvs_commit(h);
+    nvs_close(h);
+}
+
+static void ota_state_clear(void)
+{
+    nvs_handle_t h;
+    if (nvs_open(OTA_NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
         return;
     }
-    bool diagnostic_ok = true;
-    for (int i = 0; i < WB_NUM_LEVELS; i++) {
-        int v = level_gpio_get(i);
-        if (v != 0 && v != 1) {
-            diagnostic_ok = false;
-            break;
+    nvs_erase_all(h);
+    nvs_commit(h);
+    nvs_close(h);
+}
+
+/* True while this image awaits health.c's verdict and the update slot is the rollback image. */
+static bool ota_running_unconfirmed(void)
+{
+    esp_ota_img_states_t state;
+    const esp_partition_t *running = esp_ota_get_running_partition();
+    return running != NULL && esp_ota_get_state_partition(running, &state) == ESP_OK &&
+           state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+/* Loads the saved job and resume point; false if there is none. */
+static bool ota_state_load(ota_job_t *job, ota_resume_t *rs)
+{
+    nvs_handle_t h;
+    if (nvs_open(OTA_NVS_NS, NVS_READONLY, &h) != ESP_OK) {
+        return false;
+    }
+    size_t url_len = sizeof(job->url);
+    size_t rs_len = sizeof(*rs);
+    size_t sha_len = sizeof(job->sha);
+    bool ok = nvs_get_str(h, "url", job->url, &url_len) == ESP_OK &&
+              nvs_get_blob(h, "rs", rs, &rs_len) == ESP_OK && rs_len == sizeof(*rs);
+    job->have_sha = ok && nvs_get_blob(h, "sha", job->sha, &sha_len) == ESP_OK && sha_len == sizeof(job->sha);
+    nvs_close(h);
+    return ok;
+}
+
+/* Saves the resume point at the last sector boundary below off. */
+static void ota_checkpoint(ota_ctx_t *c)
+{
+    c->rs.off = c->off & ~(OTA_SECTOR - 1u);
+    ota_state_save(c);
+}
+
+/* Restarts the hash and flash bookkeeping at byte offset off (sector-aligned) of the partition,
+ * re-hashing what is already there. */
+static esp_err_t ota_rewind(ota_ctx_t *c, uint32_t off)
+{
+    mbedtls_sha256_free(&c->sha);
+    mbedtls_sha256_init(&c->sha);
+    mbedtls_sha256_starts(&c->sha, 0);
+    for (uint32_t pos = 0; pos < off; pos += sizeof(c->buf)) {
+        size_t n = off - pos < sizeof(c->buf) ? off - pos : sizeof(c->buf);
+        esp_err_t err = esp_partition_read(c->part, pos, c->buf, n);
+        if (err != ESP_OK) {
+            return err;
         }
+        mbedtls_sha256_update(&c->sha, (const unsigned char *)c->buf, n);
     }
-    if (diagnostic_ok) {
-        ESP_LOGI(TAG, "ota: diagnostics ok, mark valid");
-        esp_ota_mark_app_valid_cancel_rollback();
-    } else {
-        ESP_LOGE(TAG, "ota: diagnostics fail, rollback");
-        esp_ota_mark_app_invalid_rollback_and_reboot();
+    c->off = off;
+    c->erased_to = off;
+    return ESP_OK;
+}
+
+static esp_err_t ota_write(ota_ctx_t *c, const char *data, size_t len)
+{
+    if (c->off + len > c->part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (c->erased_to < c->off + len) {
+        esp_err_t err = esp_partition_erase_range(c->part, c->erased_to, OTA_SECTOR);
+        if (err != ESP_OK) {
+            return err;
+        }
+        c->erased_to += OTA_SECTOR;
+    }
+    esp_err_t err = esp_partition_write(c->part, c->off, data, len);
+    if (err != ESP_OK) {
+        return err;
     }
+    mbedtls_sha256_update(&c->sha, (const unsigned char *)data, len);
+    c->off += (uint32_t)len;
+    return ESP_OK;
 }
 
-static void ota_clear_active(void)
+static int ota_delta_read_src(void *ctx, uint32_t off, void *buf, size_t len)
 {
-    atomic_store_explicit(&s_ota_active, 0, memory_order_release);
+    ota_delta_t *d = (ota_delta_t *)ctx;
+    esp_err_t err = esp_partition_read(d->src, off, buf, len);
+    if (err != ESP_OK) {
+        d->io_err = err;
+        return -1;
+    }
+    return 0;
+}
+
+static esp_err_t ota_delta_flush(ota_delta_t *d)
+{
+    esp_err_t err = d->out_len > 0 ? ota_write(d->c, (const char *)d->out, d->out_len) : ESP_OK;
+    d->out_len = 0;
+    return err;
+}
+
+static int ota_delta_write_dst(void *ctx, const void *buf, size_t len)
+{
+    ota_delta_t *d = (ota_delta_t *)ctx;
+    const uint8_t *p = (const uint8_t *)buf;
+    while (len > 0) {
+        size_t n = len < OTA_DELTA_OUT - d->out_len ? len : OTA_DELTA_OUT - d->out_len;
+        memcpy(d->out + d->out_len, p, n);
+        d->out_len += n;
+        p += n;
+        len -= n;
+        if (d->out_len == OTA_DELTA_OUT) {
+            esp_err_t err = ota_delta_flush(d);
+            if (err != ESP_OK) {
+                d->io_err = err;
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+/* The patch only applies to the exact image it was made from. */
+static esp_err_t ota_delta_check_src(ota_delta_t *d)
+{
+    if (d->hdr.src_size > d->src->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    esp_err_t err = ESP_OK;
+    for (uint32_t pos = 0; pos < d->hdr.src_size && err == ESP_OK; pos += sizeof(d->out)) {
+        size_t n = d->hdr.src_size - pos < sizeof(d->out) ? d->hdr.src_size - pos : sizeof(d->out);
+        err = esp_partition_read(d->src, pos, d->out, n);
+        mbedtls_sha256_update(&sha, d->out, n);
+    }
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    if (err == ESP_OK && memcmp(digest, d->hdr.src_sha, sizeof(digest)) != 0) {
+        ESP_LOGE(TAG, "ota: delta was made from a different image than the running one");
+        err = ESP_ERR_INVALID_VERSION;
+    }
+    return err;
+}
+
+/* Header complete: validate it against the command and the running image, then start applying. */
+static esp_err_t ota_delta_begin(ota_delta_t *d, uint32_t patch_len)
+{
+    ota_ctx_t *c = d->c;
+    if (!delta_hdr_parse(d->hdr_raw, &d->hdr)) {
+        ESP_LOGE(TAG, "ota: bad delta header");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (d->hdr.dst_size > c->part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (c->job.have_sha && memcmp(c->job.sha, d->hdr.dst_sha, sizeof(c->job.sha)) != 0) {
+        ESP_LOGE(TAG, "ota: delta target does not match the commanded SHA-256");
+        return ESP_ERR_INVALID_CRC;
+    }
+    esp_err_t err = ota_delta_check_src(d);
+    if (err != ESP_OK) {
+        return err;
+    }
+    memcpy(c->job.sha, d->hdr.dst_sha, sizeof(c->job.sha));
+    c->job.have_sha = true;
+    c->rs.size = d->hdr.dst_size;
+    tinfl_init(&d->inflator);
+    delta_init(&d->patch, &d->hdr, ota_delta_read_src, ota_delta_write_dst, d);
+    ESP_LOGI(TAG, "ota: delta %lu bytes -> image %lu bytes (from %s, %lu bytes)", (unsigned long)patch_len,
+             (unsigned long)d->hdr.dst_size, d->src->label, (unsigned long)d->hdr.src_size);
+    return ESP_OK;
+}
+
+/* Takes received patch bytes: header first, then the zlib stream through tinfl into the applier. */
+static esp_err_t ota_delta_input(ota_delta_t *d, const uint8_t *in, size_t len, uint32_t patch_len, bool *done)
+{
+    if (d->hdr_len < DELTA_HDR_SIZE) {
+        size_t n = len < DELTA_HDR_SIZE - d->hdr_len ? len : DELTA_HDR_SIZE - d->hdr_len;
+        memcpy(d->hdr_raw + d->hdr_len, in, n);
+        d->hdr_len += n;
+        in += n;
+        len -= n;
+        if (d->hdr_len < DELTA_HDR_SIZE) {
+            return ESP_OK;
+        }
+        esp_err_t err = ota_delta_begin(d, patch_len);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+    for (;;) {
+        size_t in_bytes = len;
+        size_t out_bytes = TINFL_LZ_DICT_SIZE - d->dict_ofs;
+        tinfl_status st = tinfl_decompress(&d->inflator, in, &in_bytes, d->dict, d->dict + d->dict_ofs, &out_bytes,
+                                           TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        in += in_bytes;
+        len -= in_bytes;
+        if (out_bytes > 0) {
+            delta_status_t ds = delta_feed(&d->patch, d->dict + d->dict_ofs, out_bytes);
+            if (ds != DELTA_OK) {
+                ESP_LOGE(TAG, "ota: delta apply error %d at %lu", (int)ds, (unsigned long)d->patch.written);
+                return d->io_err != ESP_OK ? d->io_err : ESP_ERR_INVALID_RESPONSE;
+            }
+            d->dict_ofs = (d->dict_ofs + out_bytes) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        if (st < TINFL_STATUS_DONE) {
+            ESP_LOGE(TAG, "ota: delta inflate error %d", (int)st);
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+        if (st == TINFL_STATUS_DONE) {
+            *done = true;
+            return ESP_OK;
+        }
+        if (st == TINFL_STATUS_NEEDS_MORE_INPUT) {
+            return ESP_OK;
+        }
+    }
+}
+
+/*
+ * Applies a delta patch whose first `first` bytes are already in c->buf. Same result codes as
+ * ota_fetch; on ESP_FAIL the output is rewound so the retry fetches the patch from the start.
+ */
+static esp_err_t ota_delta_body(ota_ctx_t *c, esp_http_client_handle_t http, uint32_t patch_len, size_t first)
+{
+    ota_delta_t *d = calloc(1, sizeof(*d));
+    if (d == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    d->c = c;
+    d->src = esp_ota_get_running_partition();
+    c->start_off = 0;
+    esp_err_t err = d->src != NULL ? ESP_OK : ESP_ERR_NOT_FOUND;
+    uint32_t rx = 0;
+    size_t n = first;
+    bool done = false;
+    int64_t last_yield_us = esp_timer_get_time();
+    while (err == ESP_OK && !done) {
+        if (n == 0) {
+            if (rx >= patch_len) {
+                ESP_LOGE(TAG, "ota: delta patch truncated");
+                err = ESP_ERR_INVALID_RESPONSE;
+                break;
+            }
+            int r = esp_http_client_read(http, c->buf, sizeof(c->buf));
+            if (r <= 0) {
+                ESP_LOGW(TAG, "ota: connection lost at patch byte %lu, delta restarts", (unsigned long)rx);
+                err = ESP_FAIL;
+                break;
+            }
+            n = (size_t)r;
+        }
+        rx += (uint32_t)n;
+        err = ota_delta_input(d, (const uint8_t *)c->buf, n, patch_len, &done);
+        n = 0;
+        int64_t now = esp_timer_get_time();
+        if (now - c->last_report_us >= (int64_t)WB_OTA_PROGRESS_MS * 1000) {
+            ota_report(c, "download", NULL);
+        }
+        if (now - last_yield_us >= (int64_t)WB_OTA_YIELD_MS * 1000) {
+            vTaskDelay(1);
+            last_yield_us = esp_timer_get_time();
+        }
+    }
+    if (err == ESP_OK) {
+        err = ota_delta_flush(d);
+    }
+    if (err == ESP_OK && !delta_done(&d->patch)) {
+        ESP_LOGE(TAG, "ota: delta ended at %lu of %lu bytes", (unsigned long)d->patch.written,
+                 (unsigned long)d->hdr.dst_size);
+        err = ESP_ERR_INVALID_RESPONSE;
+    }
+    free(d);
+    if (err == ESP_FAIL) {
+        esp_err_t rerr = ota_rewind(c, 0);
+        if (rerr != ESP_OK) {
+            return rerr;
+        }
+    }
+    return err;
+}
+
+/* "bytes FIRST-LAST/TOTAL" -> FIRST, or -1. */
+static int64_t parse_content_range(const char *v)
+{
+    if (v == NULL || strncasecmp(v, "bytes ", 6) != 0) {
+        return -1;
+    }
+    v += 6;
+    int64_t first = 0;
+    const char *d = v;
+    while (*d >= '0' && *d <= '9' && first <= UINT32_MAX) {
+        first = first * 10 + (*d++ - '0');
+    }
+    return d > v && *d == '-' && first <= UINT32_MAX ? first : -1;
+}
+
+/* Response headers arrive here from esp_http_client_fetch_headers(). */
+static esp_err_t ota_http_event(esp_http_client_event_t *evt)
+{
+    ota_ctx_t *c = (ota_ctx_t *)evt->user_data;
+    if (evt->event_id == HTTP_EVENT_ON_HEADER && strcasecmp(evt->header_key, "Content-Range") == 0) {
+        c->range_start = parse_content_range(evt->header_value);
+    }
+    return ESP_OK;
+}
+
+/* Streams the open response into flash; see ota_fetch for the result codes. */
+static esp_err_t ota_fetch_body(ota_ctx_t *c, esp_http_client_handle_t http)
+{
+    int64_t len = esp_http_client_fetch_headers(http);
+    int status = esp_http_client_get_status_code(http);
+    if (status == 200 && c->off > 0) {
+        ESP_LOGW(TAG, "ota: server ignored Range, restarting at 0");
+        esp_err_t err = ota_rewind(c, 0);
+        if (err != ESP_OK) {
+            return err;
+        }
+    } else if (status == 206 && c->range_start != (int64_t)c->off) {
+        /* Appending these bytes at c->off would corrupt the image; fetch it whole on the retry. */
+        ESP_LOGW(TAG, "ota: Content-Range starts at %lld, not %lu; restarting at 0", (long long)c->range_start,
+                 (unsigned long)c->off);
+        esp_err_t err = ota_rewind(c, 0);
+        return err == ESP_OK ? ESP_FAIL : err;
+    } else if (status != 200 && status != 206) {
+        ESP_LOGE(TAG, "ota: HTTP status %d", status);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    if (len <= 0) {
+        ESP_LOGE(TAG, "ota: no Content-Length");
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    int pending = 0;
+    if (c->off == 0) {
+        pending = esp_http_client_read(http, c->buf, sizeof(c->buf));
+        if (pending <= 0) {
+            return ESP_FAIL;
+        }
+        if (pending >= 4 && memcmp(c->buf, "WBD1", 4) == 0) {
+            return ota_delta_body(c, http, (uint32_t)len, (size_t)pending);
+        }
+    }
+    uint32_t total = c->off + (uint32_t)len;
+    if (c->rs.size != 0 && c->rs.size != total) {
+        ESP_LOGW(TAG, "ota: image size changed %lu -> %lu, restarting", (unsigned long)c->rs.size,
+                 (unsigned long)total);
+        c->rs.size = 0;
+        esp_err_t err = ota_rewind(c, 0);
+        return err == ESP_OK ? ESP_FAIL : err;
+    }
+    if (total > c->part->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if (c->rs.size == 0) {
+        c->rs.size = total;
+        ota_checkpoint(c);
+    }
+    int64_t last_yield_us = esp_timer_get_time();
+    while (c->off < total) {
+        int n = pending > 0 ? pending : esp_http_client_read(http, c->buf, sizeof(c->buf));
+        pending = 0;
+        if (n <= 0) {
+            ESP_LOGW(TAG, "ota: connection lost at %lu", (unsigned long)c->off);
+            return ESP_FAIL;
+        }
+        uint32_t before = c->off;
+        esp_err_t err = ota_write(c, c->buf, (size_t)n);
+        if (err != ESP_OK) {
+            return err;
+        }
+        if (c->off / WB_OTA_SAVE_BYTES != before / WB_OTA_SAVE_BYTES) {
+            ota_checkpoint(c);
+        }
+        int64_t now = esp_timer_get_time();
+        if (now - c->last_report_us >= (int64_t)WB_OTA_PROGRESS_MS * 1000) {
+            ota_report(c, "download", NULL);
+        }
+        if (now - last_yield_us >= (int64_t)WB_OTA_YIELD_MS * 1000) {
+            vTaskDelay(1);  // socket reads only block when the link is slower than we are
+            last_yield_us = esp_timer_get_time();
+        }
+    }
+    return ESP_OK;
+}
+
+/*
+ * One HTTP request from c->off to the end. ESP_OK: image complete. ESP_FAIL: connection lost, retry.
+ * Anything else is permanent (HTTP status, size, flash error).
+ */
+static esp_err_t ota_fetch(ota_ctx_t *c)
+{
+    esp_http_client_config_t cfg = {
+        .url = c->job.url,
+        .buffer_size = WB_OTA_HTTP_RX_BUF,
+        .timeout_ms = OTA_HTTP_TIMEOUT_MS,
+        .keep_alive_enable = true,
+        .event_handler = ota_http_event,
+        .user_data = c,
+    };
+    c->range_start = -1;
+    esp_http_client_handle_t http = esp_http_client_init(&cfg);
+    if (http == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    char range[32];
+    if (c->off > 0) {
+        snprintf(range, sizeof(range), "bytes=%lu-", (unsigned long)c->off);
+        esp_http_client_set_header(http, "Range", range);
+    }
+    esp_err_t err = ESP_FAIL;
+    if (esp_http_client_open(http, 0) == ESP_OK) {
+        err = ota_fetch_body(c, http);
+    }
+    esp_http_client_close(http);
+    esp_http_client_cleanup(http);
+    return err;
+}
+
+static esp_err_t ota_verify_and_activate(ota_ctx_t *c)
+{
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&c->sha, digest);
+    if (c->job.have_sha && memcmp(digest, c->job.sha, sizeof(digest)) != 0) {
+        ESP_LOGE(TAG, "ota: SHA-256 mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
+    ESP_LOGI(TAG, "ota: SHA-256 %02x%02x%02x%02x... %s", digest[0], digest[1], digest[2], digest[3],
+             c->job.have_sha ? "matches" : "(not checked)");
+    return esp_ota_set_boot_partition(c->part);  // verifies the image header, segments and appended hash
+}
+
+static void ota_finish_task(ota_ctx_t *c)
+{
+    mbedtls_sha256_free(&c->sha);
+    free(c);
+    ota_clear_active();
+    vTaskDelete(NULL);
 }
 
 static void ota_task(void *arg)
 {
-    char *url = (char *)arg;
-    if (url == NULL) {
-        ota_clear_active();
-        vTaskDelete(NULL);
+    ota_ctx_t *c = (ota_ctx_t *)arg;
+    c->part = esp_ota_get_next_update_partition(NULL);
+    mbedtls_sha256_init(&c->sha);
+    if (c->part == NULL) {
+        ESP_LOGE(TAG, "ota: no update partition");
+        ota_finish_task(c);
         return;
     }
-    esp_http_client_config_t http_config = {
-        .url = url,
-    };
-    esp_https_ota_config_t ota_config = {
-        .http_config = &http_config,
-    };
-    esp_https_ota_handle_t ota_handle = NULL;
-    esp_err_t err = esp_https_ota_begin(&ota_config, &ota_handle);
+    uint32_t resume_off = 0;
+    if (c->rs.part_addr == c->part->address && c->rs.size != 0 && c->rs.off < c->rs.size) {
+        resume_off = c->rs.off;
+    } else {
+        c->rs.part_addr = c->part->address;
+        c->rs.size = 0;
+        c->rs.off = 0;
+    }
+    esp_err_t err = ota_rewind(c, resume_off);
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "ota: begin %s", esp_err_to_name(err));
-        free(url);
-        ota_clear_active();
-        vTaskDelete(NULL);
-        return;
+        resume_off = 0;
+        c->rs.size = 0;
+        err = ota_rewind(c, 0);
     }
-    while (1) {
-        err = esp_https_ota_perform(ota_handle);
-        if (err == ESP_ERR_HTTPS_OTA_IN_PROGRESS) {
-            continue;
+    c->start_us = esp_timer_get_time();
+    c->start_off = c->off;
+    ota_report(c, resume_off > 0 ? "resume" : "start", NULL);
+    for (int attempt = 0; err == ESP_OK || err == ESP_FAIL; attempt++) {
+        if (attempt > 0) {
+            ota_checkpoint(c);
+            if (attempt > WB_OTA_MAX_RETRIES) {
+                ESP_LOGE(TAG, "ota: giving up after %d retries; resumes on next boot or command", WB_OTA_MAX_RETRIES);
+                ota_report(c, "error", "retries");
+                ota_finish_task(c);
+                return;
+            }
+            ota_report(c, "retry", NULL);
+            vTaskDelay(pdMS_TO_TICKS(WB_OTA_RETRY_MS));
         }
-        if (err != ESP_OK) {
-            ESP_LOGE(TAG, "ota: perform %s", esp_err_to_name(err));
-            esp_https_ota_abort(ota_handle);
-            free(url);
-            ota_clear_active();
-            vTaskDelete(NULL);
-            return;
+        while (!s_wifi_connected_state) {  // also on the first attempt: a resume after boot starts before WiFi
+            vTaskDelay(pdMS_TO_TICKS(WB_OTA_RETRY_MS));
         }
-        break;
+        err = ota_fetch(c);
+        if (err == ESP_OK) {
+            break;
+        }
+    }
+    if (err == ESP_OK) {
+        err = ota_verify_and_activate(c);
     }
-    err = esp_https_ota_finish(ota_handle);
-    free(url);
+    ota_state_clear();  /* done, or failed in a way a resume would not fix */
     if (err != ESP_OK) {
-        ESP_LOGE(TAG, "ota: finish %s", esp_err_to_name(err));
-        ota_clear_active();
-        vTaskDelete(NULL);
+        ESP_LOGE(TAG, "ota: failed %s", esp_err_to_name(err));
+        ota_report(c, "error", esp_err_to_name(err));
+        ota_finish_task(c);
         return;
     }
+    ota_report(c, "reboot", NULL);
+    vTaskDelay(pdMS_TO_TICKS(500));  // let the last progress message leave
     ESP_LOGI(TAG, "ota: reboot");
     esp_restart();
 }
 
-void ota_start_from_url(const char *url)
+static int hex_digit(char ch)
+{
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    if (ch >= 'A' && ch <= 'F') {
+        return ch - 'A' + 10;
+    }
+    return -1;
+}
+
+/* Exactly 64 hex digits, optionally followed by spaces or a line ending; nothing else. */
+static bool parse_sha256(const char *hex, uint8_t out[32])
+{
+    for (int i = 0; i < 32; i++) {
+        int hi = hex_digit(hex[2 * i]);
+        int lo = hi >= 0 ? hex_digit(hex[2 * i + 1]) : -1;
+        if (lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    const char *p = hex + 64;
+    while (*p == ' ' || *p == '\r' || *p == '\n') {
+        p++;
+    }
+    return *p == '\0';
+}
+
+static void ota_launch(ota_ctx_t *c)
+{
+    BaseType_t ok = xTaskCreate(ota_task, "ota", 6144, c, 5, NULL);
+    if (ok != pdPASS) {
+        free(c);
+        ota_clear_active();
+        ESP_LOGE(TAG, "ota: task create");
+    }
+}
+
+void ota_start_from_url(const char *cmd)
 {
-    if (url == NULL || strlen(url) < 12) {
+    if (cmd == NULL || strlen(cmd) < 12) {
         return;
     }
-    if (strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0) {
+    if (strncmp(cmd, "http://", 7) != 0 && strncmp(cmd, "https://", 8) != 0) {
         ESP_LOGW(TAG, "ota: url must be http(s)://");
         return;
     }
-    size_t len = strlen(url) + 1;
-    if (len > 256) {
+    const char *sp = strchr(cmd, ' ');
+    size_t len = sp != NULL ? (size_t)(sp - cmd) : strlen(cmd);
+    while (len > 0 && (cmd[len - 1] == '\n' || cmd[len - 1] == '\r')) {
+        len--;
+    }
+    if (len + 1 > OTA_URL_MAX) {
         ESP_LOGW(TAG, "ota: url too long");
         return;
     }
@@ -120,18 +761,63 @@ void ota_start_from_url(const char *url)
         ESP_LOGW(TAG, "ota: already in progress");
         return;
     }
-
-    char *copy = malloc(len);
-    if (copy == NULL) {
+    ota_ctx_t *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
         ESP_LOGE(TAG, "ota: malloc");
         ota_clear_active();
         return;
     }
-    memcpy(copy, url, len);
-    BaseType_t ok = xTaskCreate(ota_task, "ota", 8192, copy, 5, NULL);
-    if (ok != pdPASS) {
-        free(copy);
+    memcpy(c->job.url, cmd, len);
+    c->job.url[len] = '\0';
+    if (sp != NULL) {
+        while (*sp == ' ') {
+            sp++;
+        }
+        if (*sp != '\0' && !(c->job.have_sha = parse_sha256(sp, c->job.sha))) {
+            ESP_LOGW(TAG, "ota: bad sha256, expected 64 hex digits after the URL");
+            free(c);
+            ota_clear_active();
+            return;
+        }
+    }
+    /* Same URL (and hash) as a saved partial download: pick up where it stopped. */
+    ota_job_t saved = {0};
+    ota_resume_t rs;
+    if (ota_state_load(&saved, &rs) && strcmp(saved.url, c->job.url) == 0 && saved.have_sha == c->job.have_sha &&
+        (!saved.have_sha || memcmp(saved.sha, c->job.sha, sizeof(saved.sha)) == 0)) {
+        c->rs = rs;
+    }
+    if (ota_running_unconfirmed()) {
+        ESP_LOGW(TAG, "ota: running image not confirmed yet; %s starts once it is", c->job.url);
+        ota_state_save(c);
+        free(c);
         ota_clear_active();
-        ESP_LOGE(TAG, "ota: task create");
+        return;
+    }
+    ota_launch(c);
+}
+
+void ota_resume_pending(void)
+{
+    ota_job_t job;
+    ota_resume_t rs;
+    if (!ota_state_load(&job, &rs)) {
+        return;
+    }
+    if (ota_running_unconfirmed()) {
+        ESP_LOGI(TAG, "ota: %s waits until the running image is confirmed", job.url);
+        return;
+    }
+    if (atomic_exchange_explicit(&s_ota_active, 1, memory_order_acq_rel)) {
+        return;
+    }
+    ota_ctx_t *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        ota_clear_active();
+        return;
     }
+    c->job = job;
+    c->rs = rs;
+    ESP_LOGI(TAG, "ota: resuming %s at %lu/%lu", job.url, (unsigned long)rs.off, (unsigned long)rs.size);
+    ota_launch(c);
 }
@@ -1,7 +1,7 @@
 /*
  * priv.h - Internal API and shared state for the water bucket controller.
  *
- * Used by main component: gpio, level, pump, mqtt, wifi, log_tcp, ota, ui_test, main.cpp.
+ * Used by main component: gpio, level, pump, mqtt, mqtt_topics, mqtt_pub, journal, evlog_task, wifi, log_tcp, log_ctl, log_bin, ota, health, ui_test, main.cpp.
  *
  * Threading: s_pump_mux (pump.c) protects pump and level state when accessed
  * from level timer (level_timer_cb -> read_levels -> set_pump) and MQTT
@@ -9,8 +9,8 @@
  * is defined in level.c; pump state (s_current_pump) in pump.c.
  *
  * s_mqtt_client is set once from app_main after esp_mqtt_client_init(); read
- * by MQTT handler and publish functions. No mutex for publish (single-threaded
- * per context).
+ * by MQTT handler and the mqtt_pub task. State publishes are funnelled through
+ * mqtt_pub_set(), which only touches its own spinlock-guarded slots.
  */
 
 #ifndef PRIV_H
@@ -22,9 +22,11 @@
 #include <stdarg.h>
 #include "esp_err.h"
 #include "esp_event.h"
+#include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
 #include "mqtt_client.h"
+#include "evlog.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -45,6 +47,25 @@ extern esp_mqtt_client_handle_t s_mqtt_client;
 extern int s_last_level[WB_NUM_LEVELS];   /* previous read for change detection */
 extern bool s_last_pumps_disabled;
 
+/* Reconnect delay that doubles from min_ms to max_ms; reset after a success. */
+typedef struct {
+    uint32_t min_ms;
+    uint32_t max_ms;
+    uint32_t next_ms;
+} wb_backoff_t;
+
+static inline uint32_t wb_backoff_next(wb_backoff_t *b)
+{
+    uint32_t d = b->next_ms < b->min_ms ? b->min_ms : b->next_ms;
+    b->next_ms = d > b->max_ms / 2 ? b->max_ms : d * 2;
+    return d;
+}
+
+static inline void wb_backoff_reset(wb_backoff_t *b)
+{
+    b->next_ms = b->min_ms;
+}
+
 void gpio_init(void);
 int level_gpio_get(int i);
 void pump_decoder_apply(uint8_t index);
@@ -52,21 +73,91 @@ void pump_decoder_apply(uint8_t index);
 void set_pump(uint8_t index);
 void set_ui_pump_enabled(bool enabled);
 void read_levels(void);
+uint32_t level_first_read_ms(void);  /* ms after boot of the first level read, 0 before it */
 void publish_levels(void);
 void publish_pump(void);
 void publish_full_state(void);
 void level_timer_cb(void *arg);
-void wifi_init_blocking(void);
+void wifi_start(void);                /* non-blocking; connects and reconnects from events */
+const char *wifi_connect_path(void);  /* "fast", "fast_ip", "scan" or "none" (no IP yet) */
 void log_tcp_init(void);
+/* Runtime log control (log_ctl.c): water_bucket/cmd/log per-tag levels and per-tag rate limiting.
+ * Install after log_tcp_init so rate-limited lines reach neither UART nor TCP. */
+void log_ctl_init(void);
+bool log_ctl_allow(const char *tag, size_t tag_len, esp_log_level_t level);
+/* Takes lines log_ctl has already formatted, instead of the next vprintf hook (log_tcp_line). */
+typedef int (*log_line_out_t)(const char *line, size_t len);
+void log_ctl_set_line_out(log_line_out_t out);
 void mqtt_event(void *arg, esp_event_base_t base, int32_t id, void *data);
-void ota_check_rollback(void);
-void ota_start_from_url(const char *url);
+void mqtt_reconnect_init(void);  /* client must exist and have auto-reconnect disabled */
+void mqtt_net_up(void);          /* WiFi got an IP: start the client, or reconnect it now */
+void mqtt_topics_init(void);
+
+/* Outbound state topics (mqtt_pub.c): last value per topic, unchanged values dropped, bursts coalesced. */
+typedef enum {
+    WB_PUB_LEVEL_1 = 0,
+    WB_PUB_LEVEL_2,
+    WB_PUB_LEVEL_3,
+    WB_PUB_PUMP,
+    WB_PUB_COUNT
+} wb_pub_topic_t;
+
+typedef struct {
+    uint32_t sent;
+    uint32_t suppressed;   /* value equal to what the broker already has, or to the one pending */
+    uint32_t coalesced;    /* a different pending value overwritten before it was flushed */
+} mqtt_pub_stats_t;
+
+void mqtt_pub_init(void);
+void mqtt_pub_set(wb_pub_topic_t topic, const char *payload, size_t len);
+void mqtt_pub_resync(void);
+void mqtt_pub_kick(void);
+void mqtt_pub_get_stats(mqtt_pub_stats_t *out);
+const char *mqtt_pub_topic_name(wb_pub_topic_t topic);
+
+/* Offline journal (journal.c): transitions recorded while MQTT is down, replayed on connect. */
+void journal_init(void);  /* from mqtt_pub_init(), before the client can connect */
+typedef struct {
+    uint32_t ts;
+    bool unix_time;        /* ts is unix time, else seconds since boot */
+} journal_stamp_t;
+void journal_stamp(journal_stamp_t *out);
+/* Takes only a spinlock, so it can run inside the caller's critical section; returns true when
+ * journal_service() should run (mqtt_pub_kick() once out of the critical section). */
+bool journal_record(wb_pub_topic_t topic, const char *value, size_t len, const journal_stamp_t *stamp);
+void journal_service(void);
+void journal_replay(esp_mqtt_client_handle_t client);
+
+/* Inbound topic dispatch (mqtt_topics.c). Register before esp_mqtt_client_start; filter must be a
+ * string with static lifetime. '+' and '#' wildcards follow MQTT semantics. */
+typedef void (*mqtt_topic_handler_t)(esp_mqtt_event_handle_t event, void *ctx);
+esp_err_t mqtt_topic_register(const char *filter, int qos, mqtt_topic_handler_t handler, void *ctx);
+void mqtt_topic_subscribe_all(esp_mqtt_client_handle_t client);
+bool mqtt_topic_dispatch(esp_mqtt_event_handle_t event);
+void ota_start_from_url(const char *cmd);  /* "URL" or "URL sha256hex" */
+void ota_resume_pending(void);  /* at boot, and from health.c once a new image is confirmed */
+
+/* Boot health gate (health.c): a post-OTA image is marked valid once every stage is reported, or rolled
+ * back at the deadline. health_mark is for task context; health_loop_tick for the level timer only. */
+typedef enum {
+    HEALTH_STAGE_IP = 0,
+    HEALTH_STAGE_MQTT,
+    HEALTH_STAGE_UI,
+    HEALTH_STAGE_LOOP,
+    HEALTH_STAGE_COUNT
+} health_stage_t;
+
+void health_start(void);
+void health_mark(health_stage_t stage);
+void health_loop_tick(void);
 
 typedef enum {
     ROTARY_EVENT_CW = 0,
     ROTARY_EVENT_CCW,
     ROTARY_EVENT_PRESS_SHORT,
-    ROTARY_EVENT_PRESS_LONG
+    ROTARY_EVENT_PRESS_LONG,        /* at the threshold, while still held */
+    ROTARY_EVENT_PRESS_DOUBLE,      /* only with WB_ENC_DOUBLE_MS */
+    ROTARY_EVENT_PRESS_REPEAT       /* only with WB_ENC_REPEAT_MS, while held after LONG */
 } rotary_event_t;
 
 typedef void (*rotary_event_cb_t)(rotary_event_t event, void *ctx);
@@ -83,10 +174,60 @@ typedef enum {
 esp_err_t lcd_init(void);
 esp_err_t lcd_draw_rows(const char rows[8][17], int invert_row);
 esp_err_t lcd_set_contrast(uint8_t contrast);
+
+typedef struct {
+    uint32_t frames;          /* lcd_draw_rows() calls */
+    uint32_t rows_sent;       /* page spans transmitted; unchanged rows are skipped */
+    uint32_t flushes;         /* flush task passes; frames drawn during a transfer share one */
+    uint64_t bytes;           /* I2C bytes including addressing overhead */
+    uint64_t total_us;        /* time spent in lcd_draw_rows() */
+    uint32_t max_us;          /* slowest lcd_draw_rows() since the last stats log */
+    uint64_t glass_total_us;  /* per flush: first frame handed over -> transfer complete */
+    uint32_t glass_max_us;
+} lcd_stats_t;
+
+void lcd_get_stats(lcd_stats_t *out);
+typedef enum {
+    UI_NOTIFY_LEVELS = 0,   /* s_level, s_pumps_disabled */
+    UI_NOTIFY_PUMP,         /* s_current_pump, s_ui_pump_enabled */
+    UI_NOTIFY_WIFI,
+    UI_NOTIFY_MQTT,
+    UI_NOTIFY_TIME,         /* SNTP set the clock */
+    UI_NOTIFY_LOG,
+} ui_notify_t;
+
 void ui_init(void);
 void ui_post_input(ui_input_event_t event);
+/* Wakes the UI to redraw after a state change shown on the display. Not for ISRs. */
+void ui_notify(ui_notify_t what);
+/* UI event log entries; the logs page formats them (ui_log.c) only when they scroll into view. */
+typedef enum {
+    UI_LOG_TEXT = 0,        /* ui_log_event() */
+    UI_LOG_WIFI,            /* a: connected */
+    UI_LOG_MQTT,            /* a: connected */
+    UI_LOG_LEVEL,           /* a: sensor index, b: dry */
+    UI_LOG_SAFETY,          /* a: dry lock on */
+    UI_LOG_PUMP,            /* a: pump index, WB_PUMP_OFF for off */
+    UI_LOG_UI_PUMP,         /* a: enabled */
+    UI_LOG_CONTRAST,        /* a: contrast */
+    UI_LOG_LOST,            /* a: entries the ring (or the journal queue) had no room for */
+    UI_LOG_BOOT,            /* a: journal boot number, b: esp_reset_reason() */
+} ui_log_code_t;
+
+/* Lock-free and non-blocking from any task (not ISRs); a full ring is counted and shown as UI_LOG_LOST. */
+void ui_log_post(ui_log_code_t code, int32_t a, int32_t b);
+/* `message` is kept by pointer: a string literal or other static storage. */
 void ui_log_event(const char *message);
-void ui_log_eventf(const char *fmt, ...);
+/* Entry text without its timestamp; `text` is used by UI_LOG_TEXT only. */
+void ui_log_describe(uint8_t code, int32_t a, int32_t b, const char *text, char *out, size_t out_len);
+
+/* Flash event journal (evlog_task.c): UI log entries kept across resets, see evlog.h. */
+void evlog_start(void);
+/* Queues one entry for the writer task; never blocks, a full queue is counted as UI_LOG_LOST. */
+void evlog_put(const evlog_rec_t *rec);
+/* Up to max entries, newest first, from_newest entries back; 0 without a journal. */
+size_t evlog_history(size_t from_newest, evlog_rec_t *out, size_t max);
+uint32_t evlog_total(void);
 void rotary_encoder_init(void);
 void ui_test_init(void);
 
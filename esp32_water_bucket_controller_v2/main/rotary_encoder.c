@@ -1,30 +1,84 @@
+/*
+ * rotary_encoder.c - Rotary encoder (A/B quadrature plus push switch) for the UI.
+ *
+ * With WB_ENC_PCNT (default) the pulse counter counts every A and B edge in hardware (x4 quadrature
+ * decode, glitch filter of WB_ENC_GLITCH_NS) and enc_task reads the count every WB_ENC_POLL_MS, turning
+ * each ENC_DETENT_THRESHOLD counts into one CW/CCW event; a fast spin only makes the count move further
+ * between reads, so no detent is lost and there is no interrupt per edge. With WB_ENC_PCNT 0 each edge
+ * interrupts and queues the pin state for the table decode in enc_task, as before.
+ *
+ * The switch interrupts on both edges in both modes and only wakes enc_task, which feeds the level to
+ * the button.c state machine and bounds its queue wait by the machine's next deadline (debounce,
+ * WB_ENC_LONG_MS, WB_ENC_DOUBLE_MS, WB_ENC_REPEAT_MS). Nothing waits for the release, so rotation is
+ * decoded while the button is held and a long press fires at the threshold.
+ */
+
 #include "driver/gpio.h"
 #include "esp_log.h"
 #include "esp_timer.h"
+#include "button.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
 #include "freertos/task.h"
+#include "log_bin.h"
 #include "priv.h"
+#include "wb_config.h"
 
 #define ENC_A GPIO_NUM_26
 #define ENC_B GPIO_NUM_33
 #define ENC_SW GPIO_NUM_27
 #define ENC_EV_SW 0x80u
 
+#ifndef WB_ENC_PCNT
+#define WB_ENC_PCNT 1
+#endif
+#ifndef WB_ENC_POLL_MS
+#define WB_ENC_POLL_MS 20
+#endif
+#ifndef WB_ENC_GLITCH_NS
+#define WB_ENC_GLITCH_NS 1000
+#endif
+#ifndef WB_ENC_DEBOUNCE_MS
+#define WB_ENC_DEBOUNCE_MS 20
+#endif
+#ifndef WB_ENC_LONG_MS
+#define WB_ENC_LONG_MS 800
+#endif
+#ifndef WB_ENC_DOUBLE_MS
+#define WB_ENC_DOUBLE_MS 0      /* 0: no double click, a short press is sent on release */
+#endif
+#ifndef WB_ENC_REPEAT_MS
+#define WB_ENC_REPEAT_MS 0      /* 0: no hold-repeat */
+#endif
+
 static const char *TAG = "wb_ui";
-static const int8_t s_quad[16] = {
-    0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0
-};
 
 static QueueHandle_t s_enc_q;
-static uint8_t s_enc_last;
-static int64_t s_sw_last_us;
+static btn_t s_btn;
 static rotary_event_cb_t s_cb;
 static void *s_cb_ctx;
 static int s_quad_accum;
-static int64_t s_last_detent_us;
 
 #define ENC_DETENT_THRESHOLD 4
+
+#if WB_ENC_PCNT
+
+#include "driver/pulse_cnt.h"
+
+#define ENC_PCNT_LIMIT 1000     /* counts are accumulated in software past this */
+
+static pcnt_unit_handle_t s_pcnt;
+static int s_pcnt_last;
+
+#else
+
+static const int8_t s_quad[16] = {
+    0, -1, 1, 0, 1, 0, 0, -1, -1, 0, 0, 1, 0, 1, -1, 0
+};
+
+static uint8_t s_enc_last;
+static int64_t s_last_detent_us;
+
 #define ENC_MIN_EMIT_GAP_US 45000
 
 static void IRAM_ATTR enc_isr(void *arg)
@@ -39,6 +93,8 @@ static void IRAM_ATTR enc_isr(void *arg)
     }
 }
 
+#endif
+
 static void IRAM_ATTR enc_sw_isr(void *arg)
 {
     (void)arg;
@@ -52,35 +108,128 @@ static void IRAM_ATTR enc_sw_isr(void *arg)
     }
 }
 
+static uint32_t enc_now_ms(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000);
+}
+
+/* Runs the switch state machine on the current level; returns the ticks until its next deadline. */
+static TickType_t enc_button_service(TickType_t max_wait)
+{
+    static const rotary_event_t s_map[] = {
+        [BTN_SHORT] = ROTARY_EVENT_PRESS_SHORT,
+        [BTN_LONG] = ROTARY_EVENT_PRESS_LONG,
+        [BTN_DOUBLE] = ROTARY_EVENT_PRESS_DOUBLE,
+        [BTN_REPEAT] = ROTARY_EVENT_PRESS_REPEAT,
+    };
+    bool pressed = gpio_get_level(ENC_SW) == 0;
+    uint32_t now = enc_now_ms();
+    btn_event_t ev;
+    while ((ev = btn_update(&s_btn, pressed, now)) != BTN_NONE) {
+        WB_BLOGI(TAG, "enc: %s", btn_event_name(ev));
+        if (s_cb) {
+            s_cb(s_map[ev], s_cb_ctx);
+        }
+    }
+    uint32_t in = btn_next_ms(&s_btn, now);
+    if (in == BTN_IDLE) {
+        return max_wait;
+    }
+    TickType_t t = pdMS_TO_TICKS(in) + 1;   /* round up so the deadline has passed on wake */
+    return t < max_wait ? t : max_wait;
+}
+
+#if WB_ENC_PCNT
+
+/* Every whole detent counted since the last read, in order; the remainder carries over. */
+static void enc_pcnt_poll(void)
+{
+    int count;
+    if (pcnt_unit_get_count(s_pcnt, &count) != ESP_OK) {
+        return;
+    }
+    s_quad_accum += count - s_pcnt_last;
+    s_pcnt_last = count;
+    while (s_quad_accum >= ENC_DETENT_THRESHOLD) {
+        s_quad_accum -= ENC_DETENT_THRESHOLD;
+        WB_BLOGI(TAG, "enc: CW detent count=%d", count);
+        if (s_cb) {
+            s_cb(ROTARY_EVENT_CW, s_cb_ctx);
+        }
+    }
+    while (s_quad_accum <= -ENC_DETENT_THRESHOLD) {
+        s_quad_accum += ENC_DETENT_THRESHOLD;
+        WB_BLOGI(TAG, "enc: CCW detent count=%d", count);
+        if (s_cb) {
+            s_cb(ROTARY_EVENT_CCW, s_cb_ctx);
+        }
+    }
+}
+
+static void enc_task(void *arg)
+{
+    (void)arg;
+    TickType_t wait = pdMS_TO_TICKS(WB_ENC_POLL_MS);
+    for (;;) {
+        uint8_t ev;
+        (void)xQueueReceive(s_enc_q, &ev, wait);
+        enc_pcnt_poll();
+        wait = enc_button_service(pdMS_TO_TICKS(WB_ENC_POLL_MS));
+    }
+}
+
+/*
+ * One unit, two channels: each channel counts its own pin's edges and the other pin's level sets the
+ * direction, which is the full x4 decode. The watch points at the limits let the driver accumulate
+ * past them (an interrupt per ENC_PCNT_LIMIT counts, not per edge).
+ */
+static esp_err_t enc_pcnt_init(void)
+{
+    pcnt_unit_config_t unit_cfg = {
+        .low_limit = -ENC_PCNT_LIMIT,
+        .high_limit = ENC_PCNT_LIMIT,
+        .flags.accum_count = 1,
+    };
+    esp_err_t err = pcnt_new_unit(&unit_cfg, &s_pcnt);
+    if (err != ESP_OK) {
+        return err;
+    }
+    pcnt_glitch_filter_config_t filter_cfg = { .max_glitch_ns = WB_ENC_GLITCH_NS };
+    pcnt_chan_config_t a_cfg = { .edge_gpio_num = ENC_A, .level_gpio_num = ENC_B };
+    pcnt_chan_config_t b_cfg = { .edge_gpio_num = ENC_B, .level_gpio_num = ENC_A };
+    pcnt_channel_handle_t ch_a = NULL;
+    pcnt_channel_handle_t ch_b = NULL;
+    if ((err = pcnt_unit_set_glitch_filter(s_pcnt, &filter_cfg)) != ESP_OK ||
+        (err = pcnt_new_channel(s_pcnt, &a_cfg, &ch_a)) != ESP_OK ||
+        (err = pcnt_new_channel(s_pcnt, &b_cfg, &ch_b)) != ESP_OK) {
+        return err;
+    }
+    /* Signs match the s_quad table of the edge-interrupt mode: A leading B is CW. */
+    pcnt_channel_set_edge_action(ch_a, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE);
+    pcnt_channel_set_level_action(ch_a, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    pcnt_channel_set_edge_action(ch_b, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE);
+    pcnt_channel_set_level_action(ch_b, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE);
+    pcnt_unit_add_watch_point(s_pcnt, ENC_PCNT_LIMIT);
+    pcnt_unit_add_watch_point(s_pcnt, -ENC_PCNT_LIMIT);
+    if ((err = pcnt_unit_enable(s_pcnt)) != ESP_OK || (err = pcnt_unit_clear_count(s_pcnt)) != ESP_OK) {
+        return err;
+    }
+    s_pcnt_last = 0;
+    return pcnt_unit_start(s_pcnt);
+}
+
+#else
+
 static void enc_task(void *arg)
 {
     (void)arg;
+    TickType_t wait = portMAX_DELAY;
     for (;;) {
         uint8_t st;
-        if (xQueueReceive(s_enc_q, &st, pdMS_TO_TICKS(20)) == pdTRUE) {
+        BaseType_t got = xQueueReceive(s_enc_q, &st, wait);
+        wait = enc_button_service(portMAX_DELAY);
+        if (got == pdTRUE) {
             if (st == ENC_EV_SW) {
-                vTaskDelay(pdMS_TO_TICKS(5));
-                if (gpio_get_level(ENC_SW) == 0) {
-                    int64_t press_start = esp_timer_get_time();
-                    if (press_start - s_sw_last_us > 80000) {
-                        while (gpio_get_level(ENC_SW) == 0) {
-                            vTaskDelay(pdMS_TO_TICKS(10));
-                        }
-                        int64_t press_us = esp_timer_get_time() - press_start;
-                        s_sw_last_us = press_start;
-                        if (press_us >= 800000) {
-                            ESP_LOGI(TAG, "enc: LONG %lldus", (long long)press_us);
-                            if (s_cb) {
-                                s_cb(ROTARY_EVENT_PRESS_LONG, s_cb_ctx);
-                            }
-                        } else {
-                            ESP_LOGI(TAG, "enc: SHORT %lldus", (long long)press_us);
-                            if (s_cb) {
-                                s_cb(ROTARY_EVENT_PRESS_SHORT, s_cb_ctx);
-                            }
-                        }
-                    }
-                }
                 continue;
             }
             int8_t d = s_quad[(s_enc_last << 2) | (st & 3u)];
@@ -101,7 +250,7 @@ static void enc_task(void *arg)
                 s_last_detent_us = now;
                 int a = gpio_get_level(ENC_A);
                 int b = gpio_get_level(ENC_B);
-                ESP_LOGI(TAG, "enc: CW detent A=%d B=%d", a, b);
+                WB_BLOGI(TAG, "enc: CW detent A=%d B=%d", a, b);
                 if (s_cb) {
                     s_cb(ROTARY_EVENT_CW, s_cb_ctx);
                 }
@@ -115,7 +264,7 @@ static void enc_task(void *arg)
                 s_last_detent_us = now;
                 int a = gpio_get_level(ENC_A);
                 int b = gpio_get_level(ENC_B);
-                ESP_LOGI(TAG, "enc: CCW detent A=%d B=%d", a, b);
+                WB_BLOGI(TAG, "enc: CCW detent A=%d B=%d", a, b);
                 if (s_cb) {
                     s_cb(ROTARY_EVENT_CCW, s_cb_ctx);
                 }
@@ -125,6 +274,8 @@ static void enc_task(void *arg)
     }
 }
 
+#endif
+
 void rotary_encoder_set_callback(rotary_event_cb_t cb, void *ctx)
 {
     s_cb = cb;
@@ -133,7 +284,7 @@ void rotary_encoder_set_callback(rotary_event_cb_t cb, void *ctx)
 
 void rotary_encoder_init(void)
 {
-    s_enc_q = xQueueCreate(48, sizeof(uint8_t));
+    s_enc_q = xQueueCreate(WB_ENC_PCNT ? 4 : 48, sizeof(uint8_t));
     if (!s_enc_q) {
         ESP_LOGW(TAG, "enc: queue create failed");
         return;
@@ -145,20 +296,35 @@ void rotary_encoder_init(void)
     io.pull_down_en = GPIO_PULLDOWN_DISABLE;
     io.intr_type = GPIO_INTR_DISABLE;
     gpio_config(&io);
+    const btn_config_t btn_cfg = {
+        .debounce_ms = WB_ENC_DEBOUNCE_MS,
+        .long_ms = WB_ENC_LONG_MS,
+        .double_ms = WB_ENC_DOUBLE_MS,
+        .repeat_ms = WB_ENC_REPEAT_MS,
+    };
+    btn_init(&s_btn, &btn_cfg, gpio_get_level(ENC_SW) == 0, enc_now_ms());
+#if WB_ENC_PCNT
+    esp_err_t pr = enc_pcnt_init();
+    if (pr != ESP_OK) {
+        ESP_LOGW(TAG, "enc: pulse counter %s, rotation disabled", esp_err_to_name(pr));
+    }
+#else
     s_enc_last = (uint8_t)((gpio_get_level(ENC_A) << 1) | gpio_get_level(ENC_B));
-    s_sw_last_us = esp_timer_get_time();
     gpio_set_intr_type(ENC_A, GPIO_INTR_ANYEDGE);
     gpio_set_intr_type(ENC_B, GPIO_INTR_ANYEDGE);
-    gpio_set_intr_type(ENC_SW, GPIO_INTR_NEGEDGE);
+#endif
+    gpio_set_intr_type(ENC_SW, GPIO_INTR_ANYEDGE);
     esp_err_t ir = gpio_install_isr_service(0);
     if (ir != ESP_OK && ir != ESP_ERR_INVALID_STATE) {
         ESP_LOGW(TAG, "enc: gpio_install_isr_service %s", esp_err_to_name(ir));
     }
+#if !WB_ENC_PCNT
     gpio_isr_handler_add(ENC_A, enc_isr, NULL);
     gpio_isr_handler_add(ENC_B, enc_isr, NULL);
+#endif
     gpio_isr_handler_add(ENC_SW, enc_sw_isr, NULL);
     if (xTaskCreate(enc_task, "enc_ui", 3072, NULL, 5, NULL) != pdPASS) {
         ESP_LOGW(TAG, "enc: task create failed");
     }
-    ESP_LOGI(TAG, "enc: A=26 B=33 SW=27");
+    ESP_LOGI(TAG, "enc: A=26 B=33 SW=27 %s", WB_ENC_PCNT ? "pcnt" : "edge irq");
 }
@@ -4,128 +4,211 @@
 #include "esp_app_desc.h"
 #include "esp_heap_caps.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "ui_pages_internal.h"
 #include "ui_tz.h"
+#include "wb_config.h"
+
+#ifndef WB_UI_SETTINGS_SLOW_MS
+#define WB_UI_SETTINGS_SLOW_MS 5000
+#endif
 
 #define STZ_LINES 13
 #define STZ_VIS 7
-#define STZ_SEG_MAX 96
+#define STZ_TEXT 96
+#define STZ_LINE_SEGS 8     /* 14 + 7 * 13 columns >= STZ_TEXT - 1 */
+
+/*
+ * Settings model: one cached line per item, each with its own refresh cadence. STZ_ONCE lines never
+ * change after boot, STZ_EACH lines read in-RAM state and are re-formatted on every refresh, STZ_SLOW
+ * lines (driver and heap queries) only every WB_UI_SETTINGS_SLOW_MS. A line is re-wrapped into
+ * display segments only when its text changed.
+ */
+typedef enum {
+    STZ_ONCE = 0,
+    STZ_EACH,
+    STZ_SLOW
+} stz_cadence_t;
 
 typedef struct {
-    uint8_t line;
-    uint8_t first;
-    char row[17];
-} StzSeg;
+    char text[STZ_TEXT];
+    uint8_t nseg;
+    bool valid;
+    int64_t due_us;
+    char seg[STZ_LINE_SEGS][17];
+} stz_line_t;
+
+static const uint8_t s_stz_cadence[STZ_LINES] = {
+    STZ_EACH, STZ_EACH, STZ_EACH, STZ_ONCE, STZ_EACH, STZ_EACH, STZ_SLOW,
+    STZ_SLOW, STZ_EACH, STZ_SLOW, STZ_ONCE, STZ_EACH, STZ_EACH,
+};
 
-static size_t stz_build_segments(const ui_state_t *st, StzSeg *out, size_t maxn)
+static stz_line_t s_stz[STZ_LINES];
+
+static void stz_format(int i, const ui_state_t *st, char *out, size_t n)
 {
-    char full[STZ_LINES][96];
-    snprintf(full[0], sizeof(full[0]), "Contrast: %u",
-             (unsigned)g_ui_contrast_levels[st->settings_contrast_idx]);
-    snprintf(full[1], sizeof(full[1]), "Timezone: %s", ui_tz_name(ui_tz_get()));
-    {
+    switch (i) {
+    case 0:
+        snprintf(out, n, "Contrast: %u", (unsigned)g_ui_contrast_levels[st->settings_contrast_idx]);
+        break;
+    case 1:
+        snprintf(out, n, "Timezone: %s", ui_tz_name(ui_tz_get()));
+        break;
+    case 2: {
         char clk[48];
         ui_format_local_clock(clk, sizeof(clk));
-        snprintf(full[2], sizeof(full[2]), "Time: %s", clk);
+        snprintf(out, n, "Time: %s", clk);
+        break;
     }
-    snprintf(full[3], sizeof(full[3]), "5 Gal Controller");
-    snprintf(full[4], sizeof(full[4]), "MQTT: %s",
-             ui_runtime_mqtt_connected() ? "CONNECTED" : "DISCONNECTED");
-    snprintf(full[5], sizeof(full[5]), "WIFI: %s",
-             ui_runtime_wifi_connected() ? "CONNECTED" : "DISCONNECTED");
-    {
+    case 3:
+        snprintf(out, n, "5 Gal Controller");
+        break;
+    case 4:
+        snprintf(out, n, "MQTT: %s", ui_runtime_mqtt_connected() ? "CONNECTED" : "DISCONNECTED");
+        break;
+    case 5:
+        snprintf(out, n, "WIFI: %s", ui_runtime_wifi_connected() ? "CONNECTED" : "DISCONNECTED");
+        break;
+    case 6: {
         wifi_ap_record_t ap;
         if (esp_wifi_sta_get_ap_info(&ap) == ESP_OK) {
-            snprintf(full[6], sizeof(full[6]), "RSSI: %d dBm", ap.rssi);
+            snprintf(out, n, "RSSI: %d dBm", ap.rssi);
         } else {
-            snprintf(full[6], sizeof(full[6]), "RSSI: not connected");
+            snprintf(out, n, "RSSI: not connected");
         }
+        break;
     }
-    {
-        esp_netif_t *n = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
+    case 7: {
+        esp_netif_t *nif = esp_netif_get_handle_from_ifkey("WIFI_STA_DEF");
         esp_netif_ip_info_t ip;
-        if (n && esp_netif_get_ip_info(n, &ip) == ESP_OK) {
-            snprintf(full[7], sizeof(full[7]), "IP: %u.%u.%u.%u", IP2STR(&ip.ip));
+        if (nif && esp_netif_get_ip_info(nif, &ip) == ESP_OK) {
+            snprintf(out, n, "IP: %u.%u.%u.%u", IP2STR(&ip.ip));
         } else {
-            snprintf(full[7], sizeof(full[7]), "IP: not assigned");
+            snprintf(out, n, "IP: not assigned");
         }
+        break;
     }
-    snprintf(full[8], sizeof(full[8]), "Uptime: %lu seconds", (unsigned long)ui_runtime_uptime_s());
-    snprintf(full[9], sizeof(full[9]), "Heap free: %u bytes",
-             (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT));
-    {
-        const esp_app_desc_t *desc = esp_app_get_description();
-        snprintf(full[10], sizeof(full[10]), "Firmware: %s", desc->version);
-    }
-    {
-        time_t tt = time(NULL);
-        snprintf(full[11], sizeof(full[11]), "NTP: %s",
-                 tt > 1700000000 ? "synchronized" : "waiting for sync");
+    case 8:
+        snprintf(out, n, "Uptime: %lu seconds", (unsigned long)ui_runtime_uptime_s());
+        break;
+    case 9:
+        snprintf(out, n, "Heap free: %u bytes", (unsigned)heap_caps_get_free_size(MALLOC_CAP_8BIT));
+        break;
+    case 10:
+        snprintf(out, n, "Firmware: %s", esp_app_get_description()->version);
+        break;
+    case 11:
+        snprintf(out, n, "NTP: %s", time(NULL) > 1700000000 ? "synchronized" : "waiting for sync");
+        break;
+    default:
+        snprintf(out, n, "Safety: %s", s_pumps_disabled ? "locked, all buckets read dry" : "ready, pumps allowed");
+        break;
     }
-    snprintf(full[12], sizeof(full[12]), "Safety: %s",
-             s_pumps_disabled
-                 ? "locked, all buckets read dry"
-                 : "ready, pumps allowed");
+}
 
-    size_t nseg = 0;
-    for (int L = 1; L <= STZ_LINES; L++) {
-        const char *p = full[L - 1];
-        size_t len = strlen(p);
-        size_t off = 0;
-        int isfirst = 1;
-        while (off < len && nseg < maxn) {
-            out[nseg].line = (uint8_t)L;
-            out[nseg].first = (uint8_t)isfirst;
-            if (isfirst) {
-                char num[8];
-                int nl = snprintf(num, sizeof(num), "%d ", L);
-                if (nl < 0) {
-                    nl = 0;
-                }
-                size_t room = 16 - (size_t)nl;
-                if (room > len - off) {
-                    room = len - off;
-                }
-                memset(out[nseg].row, ' ', 16);
-                memcpy(out[nseg].row, num, (size_t)nl);
-                memcpy(out[nseg].row + nl, p + off, room);
-                out[nseg].row[16] = '\0';
-                off += room;
-            } else {
-                size_t take = len - off;
-                if (take > 13) {
-                    take = 13;
-                }
-                memset(out[nseg].row, ' ', 16);
-                out[nseg].row[0] = ' ';
-                out[nseg].row[1] = ' ';
-                out[nseg].row[2] = ' ';
-                memcpy(out[nseg].row + 3, p + off, take);
-                out[nseg].row[16] = '\0';
-                off += take;
+/* Line L (1-based) as "L text" wrapped to 16 columns, continuations indented by three. */
+static void stz_wrap(int L, stz_line_t *ln)
+{
+    const char *p = ln->text;
+    size_t len = strlen(p);
+    size_t off = 0;
+    uint8_t n = 0;
+    while (off < len && n < STZ_LINE_SEGS) {
+        char *row = ln->seg[n];
+        memset(row, ' ', 16);
+        row[16] = '\0';
+        if (n == 0) {
+            char num[8];
+            int nl = snprintf(num, sizeof(num), "%d ", L);
+            if (nl < 0) {
+                nl = 0;
+            }
+            size_t room = 16 - (size_t)nl;
+            if (room > len - off) {
+                room = len - off;
+            }
+            memcpy(row, num, (size_t)nl);
+            memcpy(row + nl, p + off, room);
+            off += room;
+        } else {
+            size_t take = len - off;
+            if (take > 13) {
+                take = 13;
             }
-            isfirst = 0;
-            nseg++;
+            memcpy(row + 3, p + off, take);
+            off += take;
         }
+        n++;
     }
-    return nseg;
+    ln->nseg = n;
 }
 
-static void stz_apply_scroll(ui_state_t *s, const StzSeg *segs, size_t n)
+/* Brings due lines up to date. */
+static void stz_refresh(const ui_state_t *st)
 {
+    int64_t now = esp_timer_get_time();
+    for (int i = 0; i < STZ_LINES; i++) {
+        stz_line_t *ln = &s_stz[i];
+        uint8_t cad = s_stz_cadence[i];
+        if (ln->valid && (cad == STZ_ONCE || (cad == STZ_SLOW && now < ln->due_us))) {
+            continue;
+        }
+        char text[STZ_TEXT];
+        stz_format(i, st, text, sizeof(text));
+        ln->due_us = now + (int64_t)WB_UI_SETTINGS_SLOW_MS * 1000;
+        if (ln->valid && strcmp(text, ln->text) == 0) {
+            continue;
+        }
+        memcpy(ln->text, text, sizeof(text));
+        ln->valid = true;
+        stz_wrap(i + 1, ln);
+    }
+}
+
+static size_t stz_seg_count(void)
+{
+    size_t n = 0;
+    for (int i = 0; i < STZ_LINES; i++) {
+        n += s_stz[i].nseg;
+    }
+    return n;
+}
+
+/* Segment `idx` in display order; sets *line (1-based) when found. */
+static const char *stz_seg_at(size_t idx, uint8_t *line)
+{
+    for (int i = 0; i < STZ_LINES; i++) {
+        if (idx < s_stz[i].nseg) {
+            *line = (uint8_t)(i + 1);
+            return s_stz[i].seg[idx];
+        }
+        idx -= s_stz[i].nseg;
+    }
+    return NULL;
+}
+
+static int stz_first_seg(uint8_t line)
+{
+    size_t n = 0;
+    for (int i = 0; i < STZ_LINES; i++) {
+        if (i + 1 == line) {
+            return s_stz[i].nseg > 0 ? (int)n : -1;
+        }
+        n += s_stz[i].nseg;
+    }
+    return -1;
+}
+
+static void stz_apply_scroll(ui_state_t *s)
+{
+    size_t n = stz_seg_count();
     uint16_t max_sc = n > STZ_VIS ? (uint16_t)(n - STZ_VIS) : 0;
     if (s->cursor == 0) {
         s->scroll = 0;
         return;
     }
-    int fs = -1;
-    for (size_t i = 0; i < n; i++) {
-        if (segs[i].line == s->cursor) {
-            fs = (int)i;
-            break;
-        }
-    }
+    int fs = stz_first_seg(s->cursor);
     if (fs < 0) {
         s->scroll = 0;
         return;
@@ -139,39 +222,30 @@ static void stz_apply_scroll(ui_state_t *s, const StzSeg *segs, size_t n)
 
 void ui_settings_clamp_scroll(ui_state_t *s)
 {
-    StzSeg segs[STZ_SEG_MAX];
-    size_t n = stz_build_segments(s, segs, STZ_SEG_MAX);
-    stz_apply_scroll(s, segs, n);
+    stz_refresh(s);
+    stz_apply_scroll(s);
 }
 
 void ui_page_build_settings(const ui_state_t *state, ui_frame_t *frame)
 {
-    StzSeg segs[STZ_SEG_MAX];
-    size_t n = stz_build_segments(state, segs, STZ_SEG_MAX);
+    stz_refresh(state);
     ui_state_t v = *state;
-    stz_apply_scroll(&v, segs, n);
+    stz_apply_scroll(&v);
     uint16_t sc = v.scroll;
     ui_pages_header_title(frame, "SETTINGS");
+    uint8_t c = state->cursor;
+    int inv = -1;
     for (int r = 1; r <= 7; r++) {
-        size_t idx = (size_t)sc + (size_t)r - 1;
-        if (idx < n) {
-            ui_pages_set_line(frame->rows[r], segs[idx].row);
-        } else {
-            ui_pages_set_line(frame->rows[r], "");
+        uint8_t line = 0;
+        const char *row = stz_seg_at((size_t)sc + (size_t)r - 1, &line);
+        ui_pages_set_line(frame->rows[r], row != NULL ? row : "");
+        if (inv < 0 && row != NULL && line == c) {
+            inv = r;
         }
     }
-    uint8_t c = state->cursor;
     if (c == 0) {
         frame->invert_row = 0;
     } else {
-        int inv = -1;
-        for (int r = 1; r <= 7; r++) {
-            size_t idx = (size_t)sc + (size_t)r - 1;
-            if (idx < n && segs[idx].line == c) {
-                inv = r;
-                break;
-            }
-        }
         frame->invert_row = inv > 0 ? inv : 1;
     }
 }
@@ -1,6 +1,8 @@
 /*
- * UI runtime task: consumes rotary input events, polls controller state, updates UI logs,
- * and renders frames to the display at a steady cadence.
+ * UI runtime task: consumes rotary input events, diffs controller state into UI logs, and renders
+ * frames to the display. It sleeps until an input or a ui_notify() event arrives, or until the next
+ * time-driven field on the current page changes (ui_pages_next_change_ms), with WB_UI_MAX_IDLE_MS as
+ * a backstop for state that has no notification.
  */
 #include <string.h>
 #include "esp_log.h"
@@ -10,9 +12,15 @@
 #include "freertos/task.h"
 #include "ui.h"
 #include "ui_tz.h"
+#include "wb_config.h"
+
+#ifndef WB_UI_MAX_IDLE_MS
+#define WB_UI_MAX_IDLE_MS 10000
+#endif
 
 typedef enum {
-    UI_EVT_INPUT = 0
+    UI_EVT_INPUT = 0,
+    UI_EVT_NOTIFY
 } ui_evt_type_t;
 
 typedef struct {
@@ -25,6 +33,8 @@ typedef struct {
 static const char *TAG = "wb_ui";
 
 static QueueHandle_t s_ui_q;
+static TaskHandle_t s_ui_task;
+static uint32_t s_notify_pending;   /* bits of ui_notify_t with an event in s_ui_q; __atomic */
 static ui_state_t s_state;
 static bool s_wifi_connected;
 static bool s_mqtt_connected;
@@ -74,6 +84,26 @@ void ui_post_input(ui_input_event_t event)
     ui_push_event(&e);
 }
 
+/* Callable from any task. At most one event per kind is queued; the UI task itself needs none as it
+ * rebuilds the frame after every event it handles. */
+void ui_notify(ui_notify_t what)
+{
+    if (s_ui_q == NULL || xTaskGetCurrentTaskHandle() == s_ui_task) {
+        return;
+    }
+    uint32_t bit = 1u << what;
+    if ((__atomic_fetch_or(&s_notify_pending, bit, __ATOMIC_ACQ_REL) & bit) != 0) {
+        return;
+    }
+    ui_evt_t e = {
+        .type = UI_EVT_NOTIFY,
+        .a = (int)what,
+    };
+    if (xQueueSend(s_ui_q, &e, 0) != pdTRUE) {
+        __atomic_fetch_and(&s_notify_pending, ~bit, __ATOMIC_ACQ_REL);
+    }
+}
+
 bool ui_runtime_wifi_connected(void)
 {
     return s_wifi_connected;
@@ -102,41 +132,60 @@ uint32_t ui_runtime_sensor_age_s(int idx)
     return (uint32_t)(dt / 1000000LL);
 }
 
+static uint32_t ms_to_next_second(int64_t elapsed_us)
+{
+    return (uint32_t)(1000 - (elapsed_us / 1000) % 1000);
+}
+
+uint32_t ui_runtime_uptime_next_ms(void)
+{
+    return ms_to_next_second(esp_timer_get_time());
+}
+
+uint32_t ui_runtime_sensor_age_next_ms(void)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t next = UI_NEVER;
+    for (int i = 0; i < WB_NUM_LEVELS; i++) {
+        uint32_t ms = ms_to_next_second(now - s_sensor_change_us[i]);
+        if (ms < next) {
+            next = ms;
+        }
+    }
+    return next;
+}
+
 static void ui_poll_runtime(void)
 {
     bool wifi_now = s_wifi_connected_state;
     if (wifi_now != s_wifi_connected) {
         s_wifi_connected = wifi_now;
-        ui_log_event(s_wifi_connected ? "WiFi connected" : "WiFi disconnected");
+        ui_log_post(UI_LOG_WIFI, s_wifi_connected, 0);
     }
     bool mqtt_now = false;
     mqtt_now = s_mqtt_connected_state;
     if (mqtt_now != s_mqtt_connected) {
         s_mqtt_connected = mqtt_now;
-        ui_log_event(s_mqtt_connected ? "MQTT connected" : "MQTT disconnected");
+        ui_log_post(UI_LOG_MQTT, s_mqtt_connected, 0);
     }
     for (int i = 0; i < WB_NUM_LEVELS; i++) {
         if (s_prev_level[i] != s_level[i]) {
             s_prev_level[i] = s_level[i];
             s_sensor_change_us[i] = esp_timer_get_time();
-            ui_log_eventf("L%d %s", i + 1, s_level[i] ? "dry" : "water");
+            ui_log_post(UI_LOG_LEVEL, i, s_level[i] != 0);
         }
     }
     if (s_prev_disabled != s_pumps_disabled) {
         s_prev_disabled = s_pumps_disabled;
-        ui_log_event(s_pumps_disabled ? "Safety dry lock" : "Safety ready");
+        ui_log_post(UI_LOG_SAFETY, s_pumps_disabled, 0);
     }
     if (s_prev_pump != s_current_pump) {
         s_prev_pump = s_current_pump;
-        if (s_current_pump >= WB_NUM_PUMPS) {
-            ui_log_event("Pump off");
-        } else {
-            ui_log_eventf("Pump %u active", (unsigned)s_current_pump);
-        }
+        ui_log_post(UI_LOG_PUMP, s_current_pump, 0);
     }
     if (s_prev_ui_enabled != s_ui_pump_enabled) {
         s_prev_ui_enabled = s_ui_pump_enabled;
-        ui_log_eventf("UI pump %s", s_ui_pump_enabled ? "enabled" : "disabled");
+        ui_log_post(UI_LOG_UI_PUMP, s_ui_pump_enabled, 0);
     }
 }
 
@@ -165,6 +214,19 @@ static void ui_handle_event(const ui_evt_t *e)
         ui_trace_state(ui_input_tag(e->input));
         return;
     }
+    if (e->type == UI_EVT_NOTIFY) {
+        __atomic_fetch_and(&s_notify_pending, ~(1u << e->a), __ATOMIC_ACQ_REL);
+    }
+}
+
+static TickType_t ui_wait_ticks(void)
+{
+    uint32_t ms = ui_pages_next_change_ms(&s_state);
+    if (ms > WB_UI_MAX_IDLE_MS) {
+        ms = WB_UI_MAX_IDLE_MS;
+    }
+    /* Round up so the wake lands after the change, not one tick before it. */
+    return (TickType_t)((ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS) + 1;
 }
 
 static void ui_task(void *arg)
@@ -173,12 +235,15 @@ static void ui_task(void *arg)
     ui_frame_t frame;
     for (;;) {
         ui_evt_t ev;
-        if (xQueueReceive(s_ui_q, &ev, pdMS_TO_TICKS(200)) == pdTRUE) {
-            ui_handle_event(&ev);
+        if (xQueueReceive(s_ui_q, &ev, ui_wait_ticks()) == pdTRUE) {
+            do {
+                ui_handle_event(&ev);
+            } while (xQueueReceive(s_ui_q, &ev, 0) == pdTRUE);
         }
         ui_poll_runtime();
+        ui_log_drain();
         ui_pages_build_frame(&s_state, &frame);
-        (void)ui_render_frame(&frame);
+        ui_render_frame(&frame);   /* lcd.c reports HEALTH_STAGE_UI once a frame is on the panel */
     }
 }
 
@@ -207,7 +272,7 @@ void ui_init(void)
     ui_log_event("UI init");
     ui_trace_state("init");
     rotary_encoder_set_callback(ui_rotary_cb, NULL);
-    if (xTaskCreate(ui_task, "ui_task", 6144, NULL, 5, NULL) != pdPASS) {
+    if (xTaskCreate(ui_task, "ui_task", 6144, NULL, 5, &s_ui_task) != pdPASS) {
         ESP_LOGE(TAG, "ui task create failed");
     }
 }
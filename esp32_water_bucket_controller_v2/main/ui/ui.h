@@ -8,6 +8,7 @@
 
 #define UI_ROWS 8
 #define UI_COLS 16
+#define UI_NEVER UINT32_MAX
 
 typedef enum {
     UI_PAGE_HOME = 0,
@@ -32,13 +33,34 @@ typedef struct {
     int invert_row;
 } ui_frame_t;
 
+typedef struct {
+    int num;            /* entry label, 1 = newest */
+    bool first;         /* first segment of the entry, shown after the label */
+    char text[17];
+} ui_log_seg_t;
+
 void ui_log_init(void);
+/* Moves posted events into the history; the UI task calls it on every wake so the ring never fills. */
+void ui_log_drain(void);
 size_t ui_log_count(void);
+/* Pages the logs view back through the flash journal; false (view unchanged) when there is no more. */
+bool ui_log_history_older(void);
+void ui_log_history_live(void);
+/* True while a history page is shown; *from is how many journal entries are newer than it. */
+bool ui_log_history_from(uint32_t *from);
 void ui_log_get_recent(size_t index_from_newest, char *out, size_t out_len);
+/* Wrapped segments of all entries, newest first; ui_log_segs_get copies up to max from `first`. */
+size_t ui_log_seg_count(void);
+size_t ui_log_segs_get(size_t first, ui_log_seg_t *out, size_t max);
+/* One word-wrap step of b[*poff..L) into at most maxw columns; advances *poff. */
+void ui_log_wrap_step(const char *b, size_t L, size_t *poff, size_t maxw, char *out, size_t out_cap);
+size_t ui_log_first_width(int label);
 
 void ui_pages_init(ui_state_t *state);
 void ui_pages_handle_input(ui_state_t *state, ui_input_event_t event);
 void ui_pages_build_frame(const ui_state_t *state, ui_frame_t *frame);
+/* Milliseconds until a time-driven field of the current page (clock, ages, uptime) changes, or UI_NEVER. */
+uint32_t ui_pages_next_change_ms(const ui_state_t *state);
 
 esp_err_t ui_render_frame(const ui_frame_t *frame);
 
@@ -46,5 +68,7 @@ bool ui_runtime_wifi_connected(void);
 bool ui_runtime_mqtt_connected(void);
 uint32_t ui_runtime_uptime_s(void);
 uint32_t ui_runtime_sensor_age_s(int idx);
+uint32_t ui_runtime_uptime_next_ms(void);
+uint32_t ui_runtime_sensor_age_next_ms(void);
 
 #endif
@@ -1,89 +1,518 @@
-#include <stdarg.h>
+/*
+ * ui_log.c - The last UI_LOG_CAP UI events and their word-wrap index for the logs page.
+ *
+ * Producers post fixed-size binary records (uptime, wall clock, event code, two arguments) into a
+ * bounded multi-producer ring of UI_LOG_RING cells, each carrying a sequence number (Vyukov's bounded
+ * queue): a producer claims a cell with one compare-and-swap and publishes it with a release store,
+ * so it never waits on a lock and never runs the formatter. When the ring is full the record is
+ * counted instead; the reader turns the count into a UI_LOG_LOST entry.
+ *
+ * The reader is the UI task (every function below apart from ui_log_post/ui_log_event). It drains the
+ * ring into the live view on every wake and before each lookup, and hands each entry to evlog_put()
+ * for the flash journal; only text for rows on screen is formatted. At init the live view is filled
+ * with the newest journal entries, so the page shows what happened before a reset. The history view
+ * holds one page of UI_LOG_CAP older entries read back from the journal (ui_log_history_older); the
+ * lookups below read whichever view is current.
+ *
+ * The page numbers entries from the newest (label 1) and wraps each one to the 16-column display:
+ * the first segment shares its row with the label, continuation segments are indented by three.
+ * Each entry's segment count is worked out once, when it is appended, for both label widths (labels
+ * 1-9 leave 14 columns, 10 and up 13). seg_before keeps an ever-growing running total of 13-column
+ * counts, so the segment that starts a page is found with a walk over the nine one-digit labels and a
+ * binary search; only the entries on screen are formatted and re-wrapped.
+ */
+
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
 #include "esp_timer.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
 #include "ui.h"
 
 #define UI_LOG_CAP 96
 #define UI_LOG_LEN 64
+#define UI_LOG_RING 32              /* power of two; producers between two UI task wakes */
+#define UI_LOG_SHORT_LABELS 9       /* labels 1..9 take one digit */
+#define UI_LOG_CONT_W 13
+
+_Static_assert(UI_LOG_CAP < 100, "labels wider than two digits");
+_Static_assert((UI_LOG_RING & (UI_LOG_RING - 1)) == 0, "ring size not a power of two");
+
+typedef struct {
+    uint32_t up_s;          /* uptime */
+    uint32_t wall;          /* time(NULL) once synced, else 0 */
+    const char *text;       /* UI_LOG_TEXT */
+    int32_t a;
+    int32_t b;
+    uint8_t code;           /* ui_log_code_t */
+} ui_log_rec_t;
+
+/* seq - index is stored, so the zeroed cells of a never-initialised ring are all free. */
+typedef struct {
+    uint32_t seq;
+    ui_log_rec_t rec;
+} ui_log_cell_t;
 
-static char s_log[UI_LOG_CAP][UI_LOG_LEN];
-static size_t s_head;
-static size_t s_count;
-static SemaphoreHandle_t s_mux;
+static ui_log_cell_t s_ring[UI_LOG_RING];
+static uint32_t s_enq;                      /* next ring position to claim; __atomic */
+static uint32_t s_lost;                     /* posts that found the ring full; __atomic */
+static uint32_t s_deq;                      /* reader only, as is everything below */
 
-static void format_ts(char *out, size_t out_len)
+typedef struct {
+    ui_log_rec_t log[UI_LOG_CAP];
+    char text[UI_LOG_CAP][EVLOG_TEXT_MAX];  /* text of entries read back from the journal */
+    uint8_t segs_w14[UI_LOG_CAP];           /* segments with a one-digit label */
+    uint8_t segs_w13[UI_LOG_CAP];           /* segments with a two-digit label */
+    uint32_t seg_before[UI_LOG_CAP];        /* seg_total when the entry was appended */
+    uint32_t seg_total;                     /* sum of segs_w13 over every entry ever appended */
+    size_t head;
+    size_t count;
+    uint32_t from;                          /* journal entries newer than this page (history) */
+} ui_log_view_t;
+
+static ui_log_view_t s_live;
+static ui_log_view_t s_hist;
+static ui_log_view_t *s_view = &s_live;
+
+static void rec_stamp(ui_log_rec_t *r)
 {
     time_t now = time(NULL);
-    if (now > 1700000000) {
+    r->up_s = (uint32_t)(esp_timer_get_time() / 1000000LL);
+    r->wall = now > 1700000000 ? (uint32_t)now : 0;
+}
+
+static void ring_post(const ui_log_rec_t *r)
+{
+    uint32_t pos = __atomic_load_n(&s_enq, __ATOMIC_RELAXED);
+    ui_log_cell_t *cell;
+    for (;;) {
+        cell = &s_ring[pos & (UI_LOG_RING - 1U)];
+        uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) + (pos & (UI_LOG_RING - 1U));
+        int32_t dif = (int32_t)(seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&s_enq, &pos, pos + 1U, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (dif < 0) {
+            __atomic_fetch_add(&s_lost, 1U, __ATOMIC_RELAXED);
+            ui_notify(UI_NOTIFY_LOG);
+            return;
+        } else {
+            pos = __atomic_load_n(&s_enq, __ATOMIC_RELAXED);
+        }
+    }
+    cell->rec = *r;
+    __atomic_store_n(&cell->seq, pos + 1U - (pos & (UI_LOG_RING - 1U)), __ATOMIC_RELEASE);
+    ui_notify(UI_NOTIFY_LOG);
+}
+
+void ui_log_post(ui_log_code_t code, int32_t a, int32_t b)
+{
+    ui_log_rec_t r = { .code = (uint8_t)code, .a = a, .b = b };
+    rec_stamp(&r);
+    ring_post(&r);
+}
+
+void ui_log_event(const char *message)
+{
+    if (message == NULL) {
+        return;
+    }
+    ui_log_rec_t r = { .code = UI_LOG_TEXT, .text = message };
+    rec_stamp(&r);
+    ring_post(&r);
+}
+
+static void format_ts(const ui_log_rec_t *r, char *out, size_t out_len)
+{
+    if (r->wall != 0) {
+        time_t t = (time_t)r->wall;
         struct tm ti;
-        localtime_r(&now, &ti);
+        localtime_r(&t, &ti);
         snprintf(out, out_len, "%02d:%02d:%02d", ti.tm_hour, ti.tm_min, ti.tm_sec);
         return;
     }
-    uint64_t us = (uint64_t)esp_timer_get_time();
-    uint32_t s = (uint32_t)(us / 1000000ULL);
-    uint32_t h = s / 3600U;
-    uint32_t m = (s % 3600U) / 60U;
-    uint32_t sec = s % 60U;
-    snprintf(out, out_len, "%02u:%02u:%02u", (unsigned)h, (unsigned)m, (unsigned)sec);
+    uint32_t s = r->up_s;
+    snprintf(out, out_len, "%02u:%02u:%02u", (unsigned)(s / 3600U), (unsigned)((s % 3600U) / 60U),
+             (unsigned)(s % 60U));
 }
 
-void ui_log_init(void)
+void ui_log_describe(uint8_t code, int32_t a, int32_t b, const char *text, char *out, size_t out_len)
 {
-    if (s_mux == NULL) {
-        s_mux = xSemaphoreCreateMutex();
+    switch ((ui_log_code_t)code) {
+    case UI_LOG_TEXT:
+        snprintf(out, out_len, "%s", text != NULL ? text : "");
+        break;
+    case UI_LOG_WIFI:
+        snprintf(out, out_len, "WiFi %s", a ? "connected" : "disconnected");
+        break;
+    case UI_LOG_MQTT:
+        snprintf(out, out_len, "MQTT %s", a ? "connected" : "disconnected");
+        break;
+    case UI_LOG_LEVEL:
+        snprintf(out, out_len, "L%ld %s", (long)a + 1, b ? "dry" : "water");
+        break;
+    case UI_LOG_SAFETY:
+        snprintf(out, out_len, "Safety %s", a ? "dry lock" : "ready");
+        break;
+    case UI_LOG_PUMP:
+        if (a >= 0 && a < WB_NUM_PUMPS) {
+            snprintf(out, out_len, "Pump %ld active", (long)a);
+        } else {
+            snprintf(out, out_len, "Pump off");
+        }
+        break;
+    case UI_LOG_UI_PUMP:
+        snprintf(out, out_len, "UI pump %s", a ? "enabled" : "disabled");
+        break;
+    case UI_LOG_CONTRAST:
+        snprintf(out, out_len, "UI contrast %ld", (long)a);
+        break;
+    case UI_LOG_LOST:
+        snprintf(out, out_len, "%ld log events lost", (long)a);
+        break;
+    case UI_LOG_BOOT:
+        snprintf(out, out_len, "Boot %ld reset %ld", (long)a, (long)b);
+        break;
+    default:
+        snprintf(out, out_len, "event %u", (unsigned)code);
+        break;
     }
 }
 
-void ui_log_event(const char *message)
+static void format_rec(const ui_log_rec_t *r, char *out, size_t out_len)
 {
-    if (s_mux == NULL) {
-        ui_log_init();
+    char ts[16];
+    format_ts(r, ts, sizeof(ts));
+    int n = snprintf(out, out_len, "%s ", ts);
+    if (n > 0 && (size_t)n < out_len) {
+        ui_log_describe(r->code, r->a, r->b, r->text, out + n, out_len - (size_t)n);
     }
-    if (message == NULL) {
-        return;
+}
+
+void ui_log_wrap_step(const char *b, size_t L, size_t *poff, size_t maxw, char *out, size_t out_cap)
+{
+    size_t off = *poff;
+    while (off < L && b[off] == ' ') {
+        off++;
     }
-    if (xSemaphoreTake(s_mux, pdMS_TO_TICKS(20)) != pdTRUE) {
+    if (off >= L) {
+        *poff = L;
+        if (out && out_cap) {
+            out[0] = '\0';
+        }
         return;
     }
-    char ts[16];
-    format_ts(ts, sizeof(ts));
-    snprintf(s_log[s_head], UI_LOG_LEN, "%s %s", ts, message);
-    s_head = (s_head + 1U) % UI_LOG_CAP;
-    if (s_count < UI_LOG_CAP) {
-        s_count++;
+    size_t rem = L - off;
+    size_t take;
+    size_t next;
+    if (rem <= maxw) {
+        take = rem;
+        next = L;
+    } else {
+        size_t sp = off + maxw;
+        while (sp > off && b[sp - 1] != ' ') {
+            sp--;
+        }
+        if (sp == off) {
+            take = maxw;
+            next = off + maxw;
+        } else {
+            take = sp - off;
+            while (take > 0 && b[off + take - 1] == ' ') {
+                take--;
+            }
+            if (take == 0) {
+                take = maxw;
+                next = off + maxw;
+            } else {
+                next = off + take;
+                while (next < L && b[next] == ' ') {
+                    next++;
+                }
+            }
+        }
+    }
+    if (out && out_cap) {
+        if (take > out_cap - 1) {
+            take = out_cap - 1;
+        }
+        memcpy(out, b + off, take);
+        out[take] = '\0';
+    }
+    *poff = next;
+}
+
+size_t ui_log_first_width(int label)
+{
+    char t[12];
+    int n = snprintf(t, sizeof(t), "%d ", label);
+    if (n < 0) {
+        n = 0;
+    }
+    size_t w = 16 - (size_t)n;
+    if (w < 6) {
+        w = 6;
     }
-    xSemaphoreGive(s_mux);
+    return w;
 }
 
-void ui_log_eventf(const char *fmt, ...)
+/* Segments of one entry; an empty entry still takes a row ("-"). */
+static uint8_t wrap_count(const char *b, size_t first_w)
 {
-    if (fmt == NULL) {
+    size_t L = strlen(b);
+    if (L == 0) {
+        return 1;
+    }
+    uint8_t n = 0;
+    size_t off = 0;
+    while (off < L) {
+        char tmp[20];
+        size_t before = off;
+        ui_log_wrap_step(b, L, &off, n == 0 ? first_w : UI_LOG_CONT_W, tmp, sizeof(tmp));
+        if (off == before && tmp[0] == '\0') {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+/* Segment `seg` of an entry into out->text. */
+static void wrap_segment(const char *b, size_t first_w, size_t seg, ui_log_seg_t *out)
+{
+    size_t L = strlen(b);
+    out->first = seg == 0;
+    if (L == 0) {
+        strcpy(out->text, "-");
         return;
     }
-    char line[48];
-    va_list ap;
-    va_start(ap, fmt);
-    vsnprintf(line, sizeof(line), fmt, ap);
-    va_end(ap);
-    ui_log_event(line);
+    size_t off = 0;
+    for (size_t i = 0; i <= seg; i++) {
+        ui_log_wrap_step(b, L, &off, i == 0 ? first_w : UI_LOG_CONT_W, out->text, sizeof(out->text));
+    }
+}
+
+/*
+ * Adds a record to a view; its text is formatted here once, for the segment counts only. `text`
+ * (if not NULL) is copied into the view, for records whose text lives in a journal read buffer.
+ */
+static void append(ui_log_view_t *v, const ui_log_rec_t *r, const char *text)
+{
+    char line[UI_LOG_LEN];
+    size_t h = v->head;
+    v->log[h] = *r;
+    if (text != NULL) {
+        strncpy(v->text[h], text, EVLOG_TEXT_MAX - 1);
+        v->text[h][EVLOG_TEXT_MAX - 1] = '\0';
+        v->log[h].text = v->text[h];
+    }
+    format_rec(&v->log[h], line, sizeof(line));
+    v->segs_w14[h] = wrap_count(line, ui_log_first_width(1));
+    v->segs_w13[h] = wrap_count(line, ui_log_first_width(UI_LOG_SHORT_LABELS + 1));
+    v->seg_before[h] = v->seg_total;
+    v->seg_total += v->segs_w13[h];
+    v->head = (h + 1U) % UI_LOG_CAP;
+    if (v->count < UI_LOG_CAP) {
+        v->count++;
+    }
+}
+
+/* Live entry: onto the page and into the journal queue. */
+static void append_live(const ui_log_rec_t *r)
+{
+    evlog_rec_t e = {
+        .code = r->code,
+        .up_s = r->up_s,
+        .wall = r->wall,
+        .a = r->a,
+        .b = r->b,
+    };
+    if (r->text != NULL) {
+        strncpy(e.text, r->text, EVLOG_TEXT_MAX - 1);
+    }
+    append(&s_live, r, NULL);
+    evlog_put(&e);
+}
+
+void ui_log_drain(void)
+{
+    for (;;) {
+        ui_log_cell_t *cell = &s_ring[s_deq & (UI_LOG_RING - 1U)];
+        uint32_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE) + (s_deq & (UI_LOG_RING - 1U));
+        if (seq != s_deq + 1U) {
+            break;
+        }
+        ui_log_rec_t r = cell->rec;
+        __atomic_store_n(&cell->seq, s_deq + UI_LOG_RING - (s_deq & (UI_LOG_RING - 1U)), __ATOMIC_RELEASE);
+        s_deq++;
+        append_live(&r);
+    }
+    uint32_t lost = __atomic_exchange_n(&s_lost, 0U, __ATOMIC_RELAXED);
+    if (lost > 0) {
+        ui_log_rec_t r = { .code = UI_LOG_LOST, .a = (int32_t)lost };
+        rec_stamp(&r);
+        append_live(&r);
+    }
+}
+
+/* Fills an empty view with journal entries from+n-1 .. from, oldest first; returns how many were read. */
+static size_t load_journal(ui_log_view_t *v, size_t from, size_t n)
+{
+    static evlog_rec_t buf[16];
+    size_t got_total = 0;
+    while (n > 0) {
+        size_t c = n < 16U ? n : 16U;
+        n -= c;
+        size_t got = evlog_history(from + n, buf, c);
+        while (got > 0) {
+            const evlog_rec_t *e = &buf[--got];
+            ui_log_rec_t r = { .up_s = e->up_s, .wall = e->wall, .a = e->a, .b = e->b, .code = e->code };
+            append(v, &r, e->code == UI_LOG_TEXT ? e->text : NULL);
+            got_total++;
+        }
+    }
+    return got_total;
+}
+
+void ui_log_init(void)
+{
+    size_t n = evlog_total();
+    (void)load_journal(&s_live, 0, n < UI_LOG_CAP ? n : UI_LOG_CAP);
+    ui_log_drain();
+}
+
+bool ui_log_history_older(void)
+{
+    size_t from = s_view == &s_hist ? s_hist.from + s_hist.count : 0;
+    if (from >= evlog_total()) {
+        return false;
+    }
+    memset(&s_hist, 0, sizeof(s_hist));
+    s_hist.from = (uint32_t)from;
+    if (load_journal(&s_hist, from, UI_LOG_CAP) == 0) {
+        s_view = &s_live;
+        return false;
+    }
+    s_view = &s_hist;
+    return true;
+}
+
+void ui_log_history_live(void)
+{
+    s_view = &s_live;
+}
+
+bool ui_log_history_from(uint32_t *from)
+{
+    if (s_view != &s_hist) {
+        return false;
+    }
+    *from = s_hist.from;
+    return true;
 }
 
 size_t ui_log_count(void)
 {
-    if (s_mux == NULL) {
-        return s_count;
+    ui_log_drain();
+    return s_view->count;
+}
+
+/* Ring slot of the entry `k` places from the newest. */
+static size_t slot_of(const ui_log_view_t *v, size_t k)
+{
+    return (v->head + UI_LOG_CAP - 1U - k) % UI_LOG_CAP;
+}
+
+static size_t segs_of(const ui_log_view_t *v, size_t k)
+{
+    size_t slot = slot_of(v, k);
+    return k < UI_LOG_SHORT_LABELS ? v->segs_w14[slot] : v->segs_w13[slot];
+}
+
+/* Index of the first segment of entry `k` (k >= UI_LOG_SHORT_LABELS), counted from the newest. */
+static size_t seg_start_long(const ui_log_view_t *v, size_t k, size_t short_segs)
+{
+    size_t s9 = slot_of(v, UI_LOG_SHORT_LABELS);
+    size_t sk = slot_of(v, k);
+    uint32_t end9 = v->seg_before[s9] + v->segs_w13[s9];
+    uint32_t endk = v->seg_before[sk] + v->segs_w13[sk];
+    return short_segs + (size_t)(end9 - endk);
+}
+
+static size_t short_segs_count(const ui_log_view_t *v)
+{
+    size_t n = 0;
+    for (size_t k = 0; k < v->count && k < UI_LOG_SHORT_LABELS; k++) {
+        n += segs_of(v, k);
     }
-    if (xSemaphoreTake(s_mux, pdMS_TO_TICKS(20)) != pdTRUE) {
-        return s_count;
+    return n;
+}
+
+static size_t seg_count_total(const ui_log_view_t *v, size_t short_segs)
+{
+    if (v->count <= UI_LOG_SHORT_LABELS) {
+        return short_segs;
     }
-    size_t count = s_count;
-    xSemaphoreGive(s_mux);
-    return count;
+    return seg_start_long(v, v->count - 1U, short_segs) + segs_of(v, v->count - 1U);
+}
+
+size_t ui_log_seg_count(void)
+{
+    ui_log_drain();
+    return seg_count_total(s_view, short_segs_count(s_view));
+}
+
+size_t ui_log_segs_get(size_t first, ui_log_seg_t *out, size_t max)
+{
+    if (out == NULL || max == 0) {
+        return 0;
+    }
+    ui_log_drain();
+    const ui_log_view_t *v = s_view;
+    size_t short_segs = short_segs_count(v);
+    size_t k = 0;
+    size_t seg = first;
+    if (first >= seg_count_total(v, short_segs)) {
+        return 0;
+    }
+    if (first < short_segs) {
+        while (seg >= segs_of(v, k)) {
+            seg -= segs_of(v, k);
+            k++;
+        }
+    } else {
+        /* Last entry whose first segment is at or before `first`; starts grow with k. */
+        size_t lo = UI_LOG_SHORT_LABELS;
+        size_t hi = v->count - 1U;
+        while (lo < hi) {
+            size_t mid = (lo + hi + 1U) / 2U;
+            if (seg_start_long(v, mid, short_segs) <= first) {
+                lo = mid;
+            } else {
+                hi = mid - 1U;
+            }
+        }
+        k = lo;
+        seg = first - seg_start_long(v, k, short_segs);
+    }
+    size_t n = 0;
+    char line[UI_LOG_LEN];
+    size_t line_k = (size_t)-1;
+    while (n < max && k < v->count) {
+        int label = (int)k + 1;
+        if (line_k != k) {
+            format_rec(&v->log[slot_of(v, k)], line, sizeof(line));
+            line_k = k;
+        }
+        out[n].num = label;
+        wrap_segment(line, ui_log_first_width(label), seg, &out[n]);
+        n++;
+        if (++seg >= segs_of(v, k)) {
+            seg = 0;
+            k++;
+        }
+    }
+    return n;
 }
 
 void ui_log_get_recent(size_t index_from_newest, char *out, size_t out_len)
@@ -92,18 +521,8 @@ void ui_log_get_recent(size_t index_from_newest, char *out, size_t out_len)
         return;
     }
     out[0] = '\0';
-    if (s_mux == NULL) {
-        return;
-    }
-    if (xSemaphoreTake(s_mux, pdMS_TO_TICKS(20)) != pdTRUE) {
-        return;
-    }
-    if (index_from_newest >= s_count) {
-        xSemaphoreGive(s_mux);
-        return;
+    ui_log_drain();
+    if (index_from_newest < s_view->count) {
+        format_rec(&s_view->log[slot_of(s_view, index_from_newest)], out, out_len);
     }
-    size_t newest = (s_head + UI_LOG_CAP - 1U) % UI_LOG_CAP;
-    size_t idx = (newest + UI_LOG_CAP - index_from_newest) % UI_LOG_CAP;
-    snprintf(out, out_len, "%s", s_log[idx]);
-    xSemaphoreGive(s_mux);
 }
@@ -1,6 +1,7 @@
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
 #include <time.h>
 #include "ui_pages_internal.h"
 #include "ui_tz.h"
@@ -100,6 +101,7 @@ static void go_home_menu(ui_state_t *s)
     s->cursor = s->home_menu_cursor % 4;
     s->scroll = 0;
     s->menu_mode = true;
+    ui_log_history_live();
 }
 
 void ui_pages_handle_input(ui_state_t *s, ui_input_event_t event)
@@ -186,7 +188,7 @@ void ui_pages_handle_input(ui_state_t *s, ui_input_event_t event)
         uint8_t item = (uint8_t)(s->cursor - 1);
         if (item == 0) {
             set_ui_pump_enabled(!s_ui_pump_enabled);
-            ui_log_eventf("UI pump %s", s_ui_pump_enabled ? "enabled" : "disabled");
+            ui_log_post(UI_LOG_UI_PUMP, s_ui_pump_enabled, 0);
             return;
         }
         uint8_t pidx = (uint8_t)(item - 1);
@@ -208,6 +210,12 @@ void ui_pages_handle_input(ui_state_t *s, ui_input_event_t event)
     if (s->page == UI_PAGE_LOGS) {
         if (s->cursor == 0) {
             go_home_menu(s);
+        } else {
+            /* Pressing on the entries pages back through the journal, then wraps to the live log. */
+            if (!ui_log_history_older()) {
+                ui_log_history_live();
+            }
+            s->scroll = 0;
         }
         return;
     }
@@ -217,7 +225,7 @@ void ui_pages_handle_input(ui_state_t *s, ui_input_event_t event)
         } else if (s->cursor == 1) {
             s->settings_contrast_idx = (uint8_t)((s->settings_contrast_idx + 1) % 4);
             (void)lcd_set_contrast(g_ui_contrast_levels[s->settings_contrast_idx]);
-            ui_log_eventf("UI contrast %u", (unsigned)g_ui_contrast_levels[s->settings_contrast_idx]);
+            ui_log_post(UI_LOG_CONTRAST, g_ui_contrast_levels[s->settings_contrast_idx], 0);
         } else if (s->cursor == STZ_TZ) {
             ui_tz_set((uint8_t)((ui_tz_get() + 1) % UI_TZ_COUNT));
         } else if (s->cursor < STZ_MAX) {
@@ -254,3 +262,34 @@ void ui_pages_build_frame(const ui_state_t *state, ui_frame_t *frame)
         break;
     }
 }
+
+/* Header clock: the next wall-clock second, or never while it shows "--:--:--" (SNTP sync posts
+ * UI_NOTIFY_TIME). */
+static uint32_t header_clock_next_ms(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    if (tv.tv_sec < 1700000000) {
+        return UI_NEVER;
+    }
+    return (uint32_t)(1000 - tv.tv_usec / 1000);
+}
+
+uint32_t ui_pages_next_change_ms(const ui_state_t *state)
+{
+    uint32_t ms;
+    switch (state->page) {
+    case UI_PAGE_SENSORS:
+        ms = ui_runtime_sensor_age_next_ms();
+        break;
+    case UI_PAGE_SETTINGS:
+        /* No header clock; uptime counts seconds. The RSSI/heap lines are STZ_SLOW (settings_page.c) and
+         * are re-read only once per WB_UI_SETTINGS_SLOW_MS (5 s), so most of these wakes redraw just uptime. */
+        return ui_runtime_uptime_next_ms();
+    default:
+        ms = UI_NEVER;
+        break;
+    }
+    uint32_t clk = header_clock_next_ms();
+    return clk < ms ? clk : ms;
+}
@@ -1,28 +1,143 @@
 /*
- * wifi.c - Blocking STA init: scan (optional log), set config, connect; wait for IP with retries. On disconnect during wait, auto reconnect.
+ * wifi.c - Non-blocking STA bring-up: wifi_start() returns at once; connecting, IP and reconnects are
+ * driven by WiFi/IP events and a retry timer. A lost or failed connection is retried after an exponential
+ * backoff (WB_WIFI_BACKOFF_MIN_MS doubling up to WB_WIFI_BACKOFF_MAX_MS, reset on IP), forever; so is a
+ * connect that esp_wifi_connect() refuses outright.
+ *
+ * Fast path: the BSSID, channel and IP lease of the last successful connection are kept in NVS
+ * namespace "wb_wifi". When present, connects go straight to that AP on that channel (no scan); with
+ * WB_WIFI_FAST_IP 1 the lease is reused as a static address, skipping DHCP (only safe with a DHCP
+ * reservation). An attempt that does not reach an IP within WB_WIFI_FAST_WAIT_MS falls back at once to
+ * connecting by SSID with an all-channel scan; the cache is kept for the next connect and only dropped
+ * after WB_WIFI_FAST_FAILS such failures in a row without an IP in between. Boot-to-IP time is logged and sent in the
+ * boot document (health.c) together with the path taken. Each new IP also (re)starts MQTT.
  */
 
-#include <stdlib.h>
 #include <string.h>
 #include "esp_event.h"
 #include "esp_log.h"
+#include "esp_mac.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "esp_sntp.h"
 #include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
 #include "freertos/task.h"
+#include "nvs.h"
 #include "priv.h"
 #include "wb_config.h"
 
-#define WIFI_WAIT_IP_MS       6000
-#define WIFI_ATTEMPT_MAX     12
-#define WIFI_RETRY_DELAY_MS  500
+#define WIFI_NVS_NS          "wb_wifi"
+
+#ifndef WB_WIFI_FAST_WAIT_MS
+#define WB_WIFI_FAST_WAIT_MS 3000
+#endif
+#ifndef WB_WIFI_FAST_FAILS
+#define WB_WIFI_FAST_FAILS 3
+#endif
+#ifndef WB_WIFI_FAST_IP
+#define WB_WIFI_FAST_IP 0
+#endif
+#ifndef WB_WIFI_BACKOFF_MIN_MS
+#define WB_WIFI_BACKOFF_MIN_MS 1000
+#endif
+#ifndef WB_WIFI_BACKOFF_MAX_MS
+#define WB_WIFI_BACKOFF_MAX_MS 60000
+#endif
 
 static const char *TAG = "wb";
-static SemaphoreHandle_t s_got_ip;
 bool s_wifi_connected_state = false;
 
+/* Last good connection; compared before writing so reconnects do not wear flash. */
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    esp_netif_ip_info_t ip;
+    uint32_t dns;
+} wifi_cache_t;
+
+static esp_netif_t *s_sta_netif;
+static wifi_cache_t s_cache;
+static const char *s_path = "none";   /* "fast", "fast_ip" or "scan" once connected */
+static const char *s_trying = "scan";
+static bool s_static_ip;
+static bool s_use_cache;       /* next connect goes to the cached AP */
+static bool s_attempt_got_ip;  /* the current connection reached an IP */
+static uint8_t s_fast_fails;   /* cached-AP attempts in a row that got no IP */
+static esp_timer_handle_t s_retry_timer;
+static esp_timer_handle_t s_fast_timer;
+static wb_backoff_t s_backoff = { WB_WIFI_BACKOFF_MIN_MS, WB_WIFI_BACKOFF_MAX_MS, WB_WIFI_BACKOFF_MIN_MS };
+
+static bool wifi_cache_load(wifi_cache_t *c)
+{
+    nvs_handle_t h;
+    if (nvs_open(WIFI_NVS_NS, NVS_READONLY, &h) != ESP_OK) {
+        return false;
+    }
+    size_t len = sizeof(*c);
+    bool ok = nvs_get_blob(h, "ap", c, &len) == ESP_OK && len == sizeof(*c) && c->channel != 0;
+    nvs_close(h);
+    return ok;
+}
+
+static void wifi_cache_store(const wifi_cache_t *c)
+{
+    if (memcmp(c, &s_cache, sizeof(*c)) == 0) {
+        return;
+    }
+    nvs_handle_t h;
+    if (nvs_open(WIFI_NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(h, "ap", c, sizeof(*c)) == ESP_OK && nvs_commit(h) == ESP_OK) {
+        s_cache = *c;
+        ESP_LOGI(TAG, "wifi: cached AP " MACSTR " ch %u", MAC2STR(c->bssid), (unsigned)c->channel);
+    }
+    nvs_close(h);
+}
+
+static void wifi_cache_clear(void)
+{
+    nvs_handle_t h;
+    if (nvs_open(WIFI_NVS_NS, NVS_READWRITE, &h) != ESP_OK) {
+        return;
+    }
+    nvs_erase_key(h, "ap");
+    nvs_commit(h);
+    nvs_close(h);
+    memset(&s_cache, 0, sizeof(s_cache));
+}
+
+/* Remembers the AP and lease we just got an IP from. Runs in the event loop task. */
+static void wifi_cache_update(const esp_netif_ip_info_t *ip)
+{
+    wifi_ap_record_t ap;
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) {
+        return;
+    }
+    wifi_cache_t c = {0};
+    memcpy(c.bssid, ap.bssid, sizeof(c.bssid));
+    c.channel = ap.primary;
+    c.ip = *ip;
+    esp_netif_dns_info_t dns;
+    if (esp_netif_get_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        c.dns = dns.ip.u_addr.ip4.addr;
+    }
+    wifi_cache_store(&c);
+}
+
+const char *wifi_connect_path(void)
+{
+    return s_path;
+}
+
+static void wb_sntp_synced(struct timeval *tv)
+{
+    (void)tv;
+    ui_notify(UI_NOTIFY_TIME);
+}
+
 static void wb_sntp_start_once(void)
 {
     static bool started;
@@ -32,25 +147,123 @@ static void wb_sntp_start_once(void)
     started = true;
     esp_sntp_setoperatingmode(SNTP_OPMODE_POLL);
     esp_sntp_setservername(0, "pool.ntp.org");
+    sntp_set_time_sync_notification_cb(wb_sntp_synced);
     esp_sntp_init();
     ESP_LOGI(TAG, "wifi: SNTP started (UTC)");
 }
 
+static void wifi_static_ip(bool on)
+{
+    if (on == s_static_ip) {
+        return;
+    }
+    if (on) {
+        esp_netif_dhcpc_stop(s_sta_netif);
+        esp_netif_set_ip_info(s_sta_netif, &s_cache.ip);
+        if (s_cache.dns != 0) {
+            esp_netif_dns_info_t dns = {0};
+            dns.ip.u_addr.ip4.addr = s_cache.dns;
+            dns.ip.type = ESP_IPADDR_TYPE_V4;
+            esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns);
+        }
+    } else {
+        esp_netif_dhcpc_start(s_sta_netif);
+    }
+    s_static_ip = on;
+}
+
+static void wifi_retry_later(void)
+{
+    uint32_t delay_ms = wb_backoff_next(&s_backoff);
+    ESP_LOGI(TAG, "wifi: reconnect in %lu ms", (unsigned long)delay_ms);
+    esp_timer_stop(s_retry_timer);
+    esp_timer_start_once(s_retry_timer, (uint64_t)delay_ms * 1000);
+}
+
+/* One connection attempt: to the cached AP if s_use_cache, else by SSID. */
+static void wifi_connect_now(void)
+{
+    wifi_config_t wcfg = {0};
+    strncpy((char *)wcfg.sta.ssid, WB_WIFI_SSID, sizeof(wcfg.sta.ssid) - 1);
+    strncpy((char *)wcfg.sta.password, WB_WIFI_PASSWORD, sizeof(wcfg.sta.password) - 1);
+    wcfg.sta.threshold.authmode = WIFI_AUTH_WPA2_WPA3_PSK;
+    s_attempt_got_ip = false;
+    if (s_use_cache) {
+        wcfg.sta.bssid_set = true;
+        memcpy(wcfg.sta.bssid, s_cache.bssid, sizeof(wcfg.sta.bssid));
+        wcfg.sta.channel = s_cache.channel;
+        wcfg.sta.scan_method = WIFI_FAST_SCAN;
+        bool use_ip = WB_WIFI_FAST_IP && s_cache.ip.ip.addr != 0;
+        s_trying = use_ip ? "fast_ip" : "fast";
+        ESP_LOGI(TAG, "wifi: fast connect to " MACSTR " ch %u%s", MAC2STR(s_cache.bssid),
+                 (unsigned)s_cache.channel, use_ip ? " with cached lease" : "");
+        wifi_static_ip(use_ip);
+        esp_timer_stop(s_fast_timer);
+        esp_timer_start_once(s_fast_timer, (uint64_t)WB_WIFI_FAST_WAIT_MS * 1000);
+    } else {
+        wcfg.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+        s_trying = "scan";
+        ESP_LOGI(TAG, "wifi: connect SSID=%s (scan)", WB_WIFI_SSID);
+        wifi_static_ip(false);
+    }
+    esp_wifi_set_config(WIFI_IF_STA, &wcfg);
+    esp_err_t err = esp_wifi_connect();
+    if (err != ESP_OK) {
+        /* No disconnect event follows a refused connect; without the timer nothing would retry. */
+        ESP_LOGW(TAG, "wifi: connect failed %s", esp_err_to_name(err));
+        esp_timer_stop(s_fast_timer);
+        wifi_retry_later();
+    }
+}
+
+static void wifi_retry_cb(void *arg)
+{
+    (void)arg;
+    s_use_cache = s_cache.channel != 0;
+    wifi_connect_now();
+}
+
+/* The cached AP did not give us an IP in time: disconnect; the event handler falls back to a scan. */
+static void wifi_fast_timeout_cb(void *arg)
+{
+    (void)arg;
+    if (!s_attempt_got_ip) {
+        ESP_LOGW(TAG, "wifi: no IP from cached AP after %d ms", WB_WIFI_FAST_WAIT_MS);
+        esp_wifi_disconnect();
+    }
+}
+
 static void wifi_event(void *arg, esp_event_base_t base, int32_t id, void *data)
 {
     (void)arg;
     (void)data;
     if (base != WIFI_EVENT) return;
-    if (id == WIFI_EVENT_STA_CONNECTED) {
+    if (id == WIFI_EVENT_STA_START) {
+        wifi_connect_now();
+    } else if (id == WIFI_EVENT_STA_CONNECTED) {
         ESP_LOGI(TAG, "wifi: STA connected to AP (waiting for DHCP)");
         s_wifi_connected_state = true;
+        ui_notify(UI_NOTIFY_WIFI);
     } else if (id == WIFI_EVENT_STA_DISCONNECTED) {
         wifi_event_sta_disconnected_t *ev = (wifi_event_sta_disconnected_t *)data;
         ESP_LOGW(TAG, "wifi: STA disconnected reason=%u rssi=%d", (unsigned)ev->reason, (int)ev->rssi);
         s_wifi_connected_state = false;
-        if (s_got_ip != NULL) {
-            esp_wifi_connect();  // still waiting for IP; try connect again
+        ui_notify(UI_NOTIFY_WIFI);
+        esp_timer_stop(s_fast_timer);
+        if (s_use_cache && !s_attempt_got_ip) {
+            s_use_cache = false;
+            if (++s_fast_fails >= WB_WIFI_FAST_FAILS) {
+                ESP_LOGW(TAG, "wifi: cached AP failed %d times, dropping cache", WB_WIFI_FAST_FAILS);
+                s_fast_fails = 0;
+                wifi_cache_clear();
+            } else {
+                ESP_LOGW(TAG, "wifi: cached AP failed (%u/%d), trying a scan", (unsigned)s_fast_fails,
+                         WB_WIFI_FAST_FAILS);
+            }
+            wifi_connect_now();
+            return;
         }
+        wifi_retry_later();
     }
 }
 
@@ -63,76 +276,40 @@ static void ip_event(void *arg, esp_event_base_t base, int32_t id, void *data)
                  IP2STR(&event->ip_info.ip),
                  IP2STR(&event->ip_info.netmask),
                  IP2STR(&event->ip_info.gw));
-        wb_sntp_start_once();
-        if (s_got_ip != NULL) {
-            xSemaphoreGive(s_got_ip);
+        s_attempt_got_ip = true;
+        s_fast_fails = 0;
+        esp_timer_stop(s_fast_timer);
+        wb_backoff_reset(&s_backoff);
+        if (strcmp(s_path, "none") == 0) {
+            s_path = s_trying;
+            ESP_LOGI(TAG, "wifi: IP %lu ms after boot (%s)", (unsigned long)(esp_timer_get_time() / 1000), s_path);
         }
+        wifi_cache_update(&event->ip_info);
+        s_use_cache = s_cache.channel != 0;
+        wb_sntp_start_once();
+        ui_notify(UI_NOTIFY_WIFI);
+        health_mark(HEALTH_STAGE_IP);
+        mqtt_net_up();
     }
 }
 
-void wifi_init_blocking(void)
+void wifi_start(void)
 {
-    esp_log_level_set("wifi", ESP_LOG_DEBUG);
     ESP_LOGI(TAG, "wifi: init STA, SSID=%s", WB_WIFI_SSID);
-    esp_netif_create_default_wifi_sta();
+    s_sta_netif = esp_netif_create_default_wifi_sta();
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    const esp_timer_create_args_t retry_args = { .callback = &wifi_retry_cb, .name = "wifi_retry" };
+    const esp_timer_create_args_t fast_args = { .callback = &wifi_fast_timeout_cb, .name = "wifi_fast" };
+    ESP_ERROR_CHECK(esp_timer_create(&retry_args, &s_retry_timer));
+    ESP_ERROR_CHECK(esp_timer_create(&fast_args, &s_fast_timer));
+    s_use_cache = wifi_cache_load(&s_cache);
     esp_event_handler_instance_t instance_any;
     esp_event_handler_instance_t instance_got_ip;
     ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
                                                         &wifi_event, NULL, &instance_any));
     ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT, IP_EVENT_STA_GOT_IP,
                                                         &ip_event, NULL, &instance_got_ip));
-    s_got_ip = xSemaphoreCreateBinary();
-    if (s_got_ip == NULL) {
-        ESP_LOGE(TAG, "wifi: semaphore create failed");
-        return;
-    }
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_start());
-    wifi_scan_config_t scan_cfg = { .ssid = NULL, .bssid = NULL, .channel = 0, .show_hidden = true };
-    esp_err_t scan_ok = esp_wifi_scan_start(&scan_cfg, true);
-    if (scan_ok == ESP_OK) {
-        uint16_t n = 0;
-        esp_wifi_scan_get_ap_num(&n);
-        ESP_LOGI(TAG, "wifi: scan found %u APs", (unsigned)n);
-        if (n > 0 && n <= 64) {
-            wifi_ap_record_t *aps = (wifi_ap_record_t *)malloc(n * sizeof(wifi_ap_record_t));
-            if (aps && esp_wifi_scan_get_ap_records(&n, aps) == ESP_OK) {
-                for (uint16_t i = 0; i < n; i++) {
-                    size_t ssid_len = strlen(WB_WIFI_SSID);
-                    if (ssid_len <= 32 && memcmp(aps[i].ssid, WB_WIFI_SSID, ssid_len) == 0) {
-                        ESP_LOGI(TAG, "wifi: found SSID=%s auth=%u rssi=%d", (char *)aps[i].ssid, (unsigned)aps[i].authmode, (int)aps[i].rssi);
-                        break;
-                    }
-                }
-                free(aps);
-            }
-        }
-    } else {
-        ESP_LOGW(TAG, "wifi: scan failed %d", (int)scan_ok);
-    }
-    wifi_config_t wcfg = {0};
-    strncpy((char *)wcfg.sta.ssid, WB_WIFI_SSID, sizeof(wcfg.sta.ssid) - 1);
-    strncpy((char *)wcfg.sta.password, WB_WIFI_PASSWORD, sizeof(wcfg.sta.password) - 1);
-    wcfg.sta.threshold.authmode = WIFI_AUTH_WPA2_WPA3_PSK;
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wcfg));
-    ESP_ERROR_CHECK(esp_wifi_connect());
-    ESP_LOGI(TAG, "wifi: waiting for IP (%d s per try, up to %d tries)", WIFI_WAIT_IP_MS / 1000, WIFI_ATTEMPT_MAX);
-    for (int attempt = 0; attempt < WIFI_ATTEMPT_MAX; attempt++) {
-        if (xSemaphoreTake(s_got_ip, pdMS_TO_TICKS(WIFI_WAIT_IP_MS)) == pdTRUE) {
-            ESP_LOGI(TAG, "wifi: connected with IP");
-            vSemaphoreDelete(s_got_ip);
-            s_got_ip = NULL;
-            return;
-        }
-        if (attempt < WIFI_ATTEMPT_MAX - 1) {
-            esp_wifi_disconnect();
-            vTaskDelay(pdMS_TO_TICKS(WIFI_RETRY_DELAY_MS));
-            esp_wifi_connect();
-        }
-    }
-    ESP_LOGW(TAG, "wifi: no IP after %d tries (%d s each)", WIFI_ATTEMPT_MAX, WIFI_WAIT_IP_MS / 1000);
-    vSemaphoreDelete(s_got_ip);
-    s_got_ip = NULL;
+    ESP_ERROR_CHECK(esp_wifi_start());  // WIFI_EVENT_STA_START -> first connect
 }
@@ -0,0 +1,158 @@
+/*
+ * button_test.c - Host test of the switch state machine (main/button.c) against recorded edge traces:
+ * button_test TRACE... Built and run on every trace in tools/button_trace/ by `make button-test`.
+ *
+ * Trace lines (times in ms, # starts a comment):
+ *   cfg DEBOUNCE LONG DOUBLE REPEAT   btn_config_t for the trace
+ *   start LEVEL                       switch level at btn_init() (default 0); before any edge
+ *   T LEVEL                           raw switch level from T on (1 = pressed)
+ *   = T EVENT                         expected event at T (SHORT, LONG, DOUBLE, REPEAT)
+ *   end T                             run until T
+ * Between edges the clock jumps straight to each btn_next_ms() deadline, as enc_task's wait does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "button.h"
+
+#define MAX_EVENTS 64
+
+typedef struct {
+    uint32_t t;
+    char name[16];
+} ev_t;
+
+static ev_t s_got[MAX_EVENTS];
+static size_t s_ngot;
+
+static void record(uint32_t t, btn_event_t ev)
+{
+    if (s_ngot < MAX_EVENTS) {
+        s_got[s_ngot].t = t;
+        snprintf(s_got[s_ngot].name, sizeof(s_got[s_ngot].name), "%s", btn_event_name(ev));
+        s_ngot++;
+    }
+}
+
+static void feed(btn_t *b, bool level, uint32_t now)
+{
+    btn_event_t ev;
+    while ((ev = btn_update(b, level, now)) != BTN_NONE) {
+        record(now, ev);
+    }
+}
+
+/* Runs every deadline up to and including `until` at the current level. */
+static void run_until(btn_t *b, bool level, uint32_t *now, uint32_t until)
+{
+    for (;;) {
+        uint32_t in = btn_next_ms(b, *now);
+        if (in == BTN_IDLE || *now + in > until) {
+            break;
+        }
+        *now += in;
+        feed(b, level, *now);
+    }
+    *now = until;
+}
+
+static int run_trace(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        printf("FAIL %s: cannot open\n", path);
+        return 1;
+    }
+    btn_config_t cfg = { .debounce_ms = 20, .long_ms = 800 };
+    ev_t want[MAX_EVENTS];
+    size_t nwant = 0;
+    btn_t b;
+    bool started = false;
+    bool level = false;     // also the level at btn_init()
+    uint32_t now = 0;
+    char line[128];
+    int lineno = 0;
+    s_ngot = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') {
+            continue;
+        }
+        unsigned a, c, d, e;
+        char name[16];
+        if (sscanf(p, "cfg %u %u %u %u", &a, &c, &d, &e) == 4) {
+            cfg.debounce_ms = (uint16_t)a;
+            cfg.long_ms = (uint16_t)c;
+            cfg.double_ms = (uint16_t)d;
+            cfg.repeat_ms = (uint16_t)e;
+            continue;
+        }
+        if (!started && sscanf(p, "start %u", &a) == 1) {
+            level = a != 0;
+            continue;
+        }
+        if (!started) {
+            btn_init(&b, &cfg, level, 0);
+            started = true;
+        }
+        if (sscanf(p, "= %u %15s", &a, name) == 2) {
+            if (nwant < MAX_EVENTS) {
+                want[nwant].t = a;
+                snprintf(want[nwant].name, sizeof(want[nwant].name), "%s", name);
+                nwant++;
+            }
+        } else if (sscanf(p, "end %u", &a) == 1) {
+            run_until(&b, level, &now, a);
+        } else if (sscanf(p, "%u %u", &a, &c) == 2) {
+            if (a < now) {
+                printf("FAIL %s:%d: edge at %u before %u\n", path, lineno, a, (unsigned)now);
+                fclose(f);
+                return 1;
+            }
+            if (a > now) {
+                run_until(&b, level, &now, a - 1U);
+            }
+            now = a;
+            level = c != 0;
+            feed(&b, level, now);
+        } else {
+            printf("FAIL %s:%d: bad line\n", path, lineno);
+            fclose(f);
+            return 1;
+        }
+    }
+    fclose(f);
+    int bad = s_ngot != nwant;
+    for (size_t i = 0; !bad && i < nwant; i++) {
+        bad = s_got[i].t != want[i].t || strcmp(s_got[i].name, want[i].name) != 0;
+    }
+    if (bad) {
+        printf("FAIL %s\n  want:", path);
+        for (size_t i = 0; i < nwant; i++) {
+            printf(" %s@%u", want[i].name, (unsigned)want[i].t);
+        }
+        printf("\n  got: ");
+        for (size_t i = 0; i < s_ngot; i++) {
+            printf(" %s@%u", s_got[i].name, (unsigned)s_got[i].t);
+        }
+        printf("\n");
+        return 1;
+    }
+    printf("ok   %s (%u events)\n", path, (unsigned)nwant);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s TRACE...\n", argv[0]);
+        return 2;
+    }
+    int fail = 0;
+    for (int i = 1; i < argc; i++) {
+        fail += run_trace(argv[i]);
+    }
+    return fail != 0;
+}
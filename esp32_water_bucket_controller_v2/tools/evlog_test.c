@@ -0,0 +1,319 @@
+/*
+ * evlog_test.c - Host test of the event journal (main/evlog.c) on a file standing in for the "evlog"
+ * partition: evlog_test [FILE] (default build/evlog_test.bin). Built and run by `make evlog-test`.
+ *
+ * The fake behaves like NOR flash: erase sets a sector to 0xFF, a write can only clear bits, and a
+ * write can be cut off after a given number of bytes to stand in for a reset mid-write. Each check
+ * reopens the journal from the file, as a reboot would.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "evlog.h"
+
+#define SECTOR  4096
+#define NSECT   16
+#define REGION  (SECTOR * NSECT)
+
+typedef struct {
+    FILE *f;
+    long cut_after;       /* bytes the next writes may still program; -1 = no limit */
+    unsigned erases[NSECT];
+} fake_t;
+
+static fake_t s_fake;
+static int s_fail;
+
+#define CHECK(cond, ...)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            printf("FAIL %s:%d: ", __func__, __LINE__);    \
+            printf(__VA_ARGS__);                           \
+            printf("\n");                                  \
+            s_fail++;                                      \
+            return;                                        \
+        }                                                  \
+    } while (0)
+
+static int fake_read(void *ctx, uint32_t off, void *buf, size_t len)
+{
+    fake_t *fk = ctx;
+    if (off + len > REGION || fseek(fk->f, (long)off, SEEK_SET) != 0) {
+        return -1;
+    }
+    return fread(buf, 1, len, fk->f) == len ? 0 : -1;
+}
+
+static int fake_write(void *ctx, uint32_t off, const void *buf, size_t len)
+{
+    fake_t *fk = ctx;
+    uint8_t cur[SECTOR];
+    if (off + len > REGION || len > sizeof(cur) || fake_read(ctx, off, cur, len) != 0) {
+        return -1;
+    }
+    size_t n = len;
+    if (fk->cut_after >= 0 && (long)n > fk->cut_after) {
+        n = (size_t)fk->cut_after;
+    }
+    for (size_t i = 0; i < n; i++) {
+        cur[i] &= ((const uint8_t *)buf)[i];
+    }
+    if (fseek(fk->f, (long)off, SEEK_SET) != 0 || fwrite(cur, 1, n, fk->f) != n) {
+        return -1;
+    }
+    fflush(fk->f);
+    if (fk->cut_after >= 0) {
+        fk->cut_after -= (long)n;
+        if (n < len) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int fake_erase(void *ctx, uint32_t off, size_t len)
+{
+    fake_t *fk = ctx;
+    static uint8_t ff[SECTOR];
+    memset(ff, 0xFF, sizeof(ff));
+    if (off % SECTOR != 0 || len % SECTOR != 0 || off + len > REGION) {
+        return -1;
+    }
+    for (size_t s = 0; s < len / SECTOR; s++) {
+        if (fk->cut_after == 0) {
+            return -1;
+        }
+        if (fseek(fk->f, (long)(off + s * SECTOR), SEEK_SET) != 0 || fwrite(ff, 1, SECTOR, fk->f) != SECTOR) {
+            return -1;
+        }
+        fk->erases[off / SECTOR + s]++;
+    }
+    fflush(fk->f);
+    return 0;
+}
+
+static const evlog_flash_t s_flash = {
+    .read = fake_read,
+    .write = fake_write,
+    .erase = fake_erase,
+    .ctx = &s_fake,
+    .size = REGION,
+    .sector = SECTOR,
+};
+
+static void region_fill(uint8_t byte)
+{
+    static uint8_t buf[REGION];
+    memset(buf, byte, sizeof(buf));
+    fseek(s_fake.f, 0, SEEK_SET);
+    fwrite(buf, 1, sizeof(buf), s_fake.f);
+    fflush(s_fake.f);
+    memset(s_fake.erases, 0, sizeof(s_fake.erases));
+    s_fake.cut_after = -1;
+}
+
+/* Record i of a test sequence; the text length varies so records straddle batch and sector ends. */
+static evlog_rec_t rec_make(uint32_t i)
+{
+    evlog_rec_t r = {
+        .code = (uint8_t)(i % 9),
+        .up_s = i,
+        .wall = i % 3 == 0 ? 1760000000u + i : 0,
+        .a = (int32_t)i * 7,
+        .b = -(int32_t)i,
+    };
+    snprintf(r.text, sizeof(r.text), "%.*s", (int)(i % EVLOG_TEXT_MAX), "event text for record nr");
+    return r;
+}
+
+static int rec_same(const evlog_rec_t *x, const evlog_rec_t *y)
+{
+    return x->code == y->code && x->up_s == y->up_s && x->wall == y->wall && x->a == y->a && x->b == y->b &&
+           strcmp(x->text, y->text) == 0;
+}
+
+static evlog_status_t append_seq(evlog_t *ev, uint32_t first, uint32_t n, uint32_t batch)
+{
+    evlog_rec_t recs[64];
+    for (uint32_t i = 0; i < n; i += batch) {
+        uint32_t m = n - i < batch ? n - i : batch;
+        for (uint32_t j = 0; j < m; j++) {
+            recs[j] = rec_make(first + i + j);
+        }
+        evlog_status_t st = evlog_append(ev, recs, m);
+        if (st != EVLOG_OK) {
+            return st;
+        }
+    }
+    return EVLOG_OK;
+}
+
+/* The newest `count` records must be last-1, last-2, ... in order. */
+static int check_tail(evlog_t *ev, uint32_t last, uint32_t count)
+{
+    evlog_rec_t got[32];
+    uint32_t at = 0;
+    while (at < count) {
+        size_t n = evlog_read(ev, at, got, 32);
+        if (n == 0) {
+            printf("  read stopped at %u of %u\n", at, count);
+            return 0;
+        }
+        for (size_t i = 0; i < n && at < count; i++, at++) {
+            evlog_rec_t want = rec_make(last - 1 - at);
+            if (!rec_same(&got[i], &want)) {
+                printf("  record %u back: up_s %u, want %u\n", at, got[i].up_s, want.up_s);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void test_blank_and_reopen(void)
+{
+    evlog_t ev;
+    region_fill(0xFF);
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK, "open blank");
+    CHECK(evlog_count(&ev) == 0 && evlog_boot(&ev) == 1, "blank: %u records, boot %u", evlog_count(&ev),
+          evlog_boot(&ev));
+    CHECK(append_seq(&ev, 0, 40, 7) == EVLOG_OK, "append");
+    for (uint16_t boot = 2; boot < 5; boot++) {
+        CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK, "reopen");
+        CHECK(evlog_count(&ev) == 40, "reopen: %u records", evlog_count(&ev));
+        CHECK(evlog_boot(&ev) == 2, "boot %u after a boot that wrote nothing new", evlog_boot(&ev));
+    }
+    CHECK(append_seq(&ev, 40, 1, 1) == EVLOG_OK, "append");
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && evlog_boot(&ev) == 3, "boot %u", evlog_boot(&ev));
+    evlog_rec_t r;
+    CHECK(evlog_read(&ev, 0, &r, 1) == 1 && r.boot == 2, "newest record from boot %u", r.boot);
+    CHECK(check_tail(&ev, 41, 41), "contents after reopen");
+    printf("ok   blank region, append, reopen and boot numbers\n");
+}
+
+static void test_rotation_and_wear(void)
+{
+    evlog_t ev;
+    region_fill(0xFF);
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK, "open");
+    const uint32_t total = 20000;
+    CHECK(append_seq(&ev, 0, total, 13) == EVLOG_OK, "append");
+    uint32_t kept = evlog_count(&ev);
+    CHECK(kept > 0 && kept < total, "%u records kept", kept);
+    CHECK(check_tail(&ev, total, kept), "contents before reopen");
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && evlog_count(&ev) == kept, "reopen: %u records, had %u",
+          evlog_count(&ev), kept);
+    CHECK(check_tail(&ev, total, kept), "contents after reopen");
+    unsigned lo = s_fake.erases[0];
+    unsigned hi = lo;
+    for (int s = 1; s < NSECT; s++) {
+        lo = s_fake.erases[s] < lo ? s_fake.erases[s] : lo;
+        hi = s_fake.erases[s] > hi ? s_fake.erases[s] : hi;
+    }
+    CHECK(hi - lo <= 1, "erase counts %u..%u", lo, hi);
+    printf("ok   %u records through %d sectors: newest %u kept, erases per sector %u..%u\n", total, NSECT, kept,
+           lo, hi);
+}
+
+/* A write cut at every 3rd byte of a batch: what was whole survives, appends resume in a new sector. */
+static void test_torn_writes(void)
+{
+    for (long cut = 0; cut < 200; cut += 3) {
+        evlog_t ev;
+        region_fill(0xFF);
+        CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK, "open");
+        CHECK(append_seq(&ev, 0, 50, 10) == EVLOG_OK, "append");
+        s_fake.cut_after = cut;
+        (void)append_seq(&ev, 50, 8, 8);
+        s_fake.cut_after = -1;
+        CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK, "reopen after cut at %ld", cut);
+        uint32_t n = evlog_count(&ev);
+        CHECK(n >= 50 && n <= 58, "cut at %ld: %u records", cut, n);
+        CHECK(check_tail(&ev, n, n), "cut at %ld: contents", cut);
+        CHECK(append_seq(&ev, n, 20, 5) == EVLOG_OK, "append after cut at %ld", cut);
+        CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && evlog_count(&ev) == n + 20, "cut at %ld: %u records after",
+              cut, evlog_count(&ev));
+        CHECK(check_tail(&ev, n + 20, n + 20), "cut at %ld: contents after", cut);
+    }
+    printf("ok   writes cut short at every 3rd byte of a batch\n");
+}
+
+/* Reset while the next sector is being erased or its header written. */
+static void test_torn_rotate(void)
+{
+    evlog_t ev;
+    region_fill(0xFF);
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK, "open");
+    uint32_t n = 0;
+    while (ev.head == 0) {
+        CHECK(append_seq(&ev, n, 1, 1) == EVLOG_OK, "fill");
+        n++;
+    }
+    uint32_t in_first = n - 1;
+    region_fill(0xFF);
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && append_seq(&ev, 0, in_first, 16) == EVLOG_OK, "refill");
+    s_fake.cut_after = 5;                   /* erase goes through, header cut */
+    CHECK(append_seq(&ev, in_first, 1, 1) != EVLOG_OK, "rotate should fail");
+    s_fake.cut_after = -1;
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && evlog_count(&ev) == in_first, "reopen: %u records, want %u",
+          evlog_count(&ev), in_first);
+    CHECK(append_seq(&ev, in_first, 30, 4) == EVLOG_OK, "append after");
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && check_tail(&ev, in_first + 30, in_first + 30), "contents");
+    printf("ok   reset during sector rotation\n");
+}
+
+/* A flipped bit ends its sector's history there; the newer sectors still read. */
+static void test_corruption(void)
+{
+    evlog_t ev;
+    region_fill(0xFF);
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && append_seq(&ev, 0, 600, 32) == EVLOG_OK, "fill");
+    uint32_t before = evlog_count(&ev);
+    uint8_t b;
+    uint32_t off = SECTOR * 1 + 200;        /* second sector, well inside */
+    fake_read(&s_fake, off, &b, 1);
+    b ^= 0x10;
+    fseek(s_fake.f, (long)off, SEEK_SET);
+    fwrite(&b, 1, 1, s_fake.f);
+    fflush(s_fake.f);
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK, "reopen");
+    uint32_t after = evlog_count(&ev);
+    CHECK(after < before && after > before - 200, "%u records, had %u", after, before);
+    uint32_t newer = 0;
+    for (uint32_t k = 0; k < ev.chain && (ev.head + NSECT - k) % NSECT != 1; k++) {
+        newer += ev.counts[(ev.head + NSECT - k) % NSECT];
+    }
+    CHECK(check_tail(&ev, 600, newer), "records newer than the damaged sector");
+    evlog_rec_t r;
+    CHECK(evlog_read(&ev, newer, &r, 1) == 1 && r.up_s < 600 - newer - 1, "first record before the damage: %u",
+          r.up_s);
+
+    region_fill(0x5A);
+    CHECK(evlog_open(&ev, &s_flash) == EVLOG_OK && evlog_count(&ev) == 0, "foreign data: %u records",
+          evlog_count(&ev));
+    CHECK(append_seq(&ev, 0, 10, 10) == EVLOG_OK && evlog_open(&ev, &s_flash) == EVLOG_OK &&
+          check_tail(&ev, 10, 10), "foreign data: append");
+    printf("ok   bit flip inside a sector (%u of %u records still read), foreign data formatted\n", after, before);
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = argc > 1 ? argv[1] : "build/evlog_test.bin";
+    s_fake.f = fopen(path, "w+b");
+    if (s_fake.f == NULL) {
+        perror(path);
+        return 1;
+    }
+    test_blank_and_reopen();
+    test_rotation_and_wear();
+    test_torn_writes();
+    test_torn_rotate();
+    test_corruption();
+    fclose(s_fake.f);
+    if (s_fail > 0) {
+        printf("%d check(s) failed\n", s_fail);
+        return 1;
+    }
+    return 0;
+}
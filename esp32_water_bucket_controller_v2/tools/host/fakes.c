@@ -0,0 +1,345 @@
+/*
+ * fakes.c - Host stand-ins for the ESP-IDF and FreeRTOS calls the UI and log code makes, so tools
+ * under tools/ can build that code unchanged (include/ holds the matching headers).
+ *
+ * Time is virtual: esp_timer_get_time() starts at 0 and only moves with host_clock_advance_us(), and
+ * the wall clock (host_clock.h redirects time() and gettimeofday()) reads 0, "not synced", until
+ * host_clock_set_wall(). Frames built from a script are the same on every run.
+ *
+ * The flash event journal is the real evlog.c over a RAM region, written as soon as an entry is put.
+ */
+
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "esp_app_desc.h"
+#include "esp_heap_caps.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/semphr.h"
+#include "host_clock.h"
+#include "host_fakes.h"
+#include "nvs.h"
+#include "priv.h"
+
+#define HOST_NVS_KEYS 16
+#define HOST_NVS_VALUE_MAX 272   /* an OTA URL and its NUL */
+#define HOST_EVLOG_SECTORS 16
+#define HOST_EVLOG_SECTOR 4096
+
+struct host_sem {
+    int taken;
+};
+
+struct esp_netif_obj {
+    int unused;
+};
+
+int8_t host_wifi_rssi = -60;
+bool host_wifi_associated;
+uint32_t host_ip_addr;
+uint32_t host_heap_free = 180000;
+char host_fw_version[32] = "host";
+
+static int64_t s_uptime_us;
+static int64_t s_wall_us;       /* wall time at uptime 0; 0 while "not synced" */
+static bool s_wall_set;
+
+typedef struct {
+    struct {
+        char key[16];
+        uint8_t value[HOST_NVS_VALUE_MAX];
+        size_t len;
+    } e[HOST_NVS_KEYS];
+    size_t count;
+} host_nvs_t;
+
+static host_nvs_t s_nvs_ram;
+static host_nvs_t *s_nvs = &s_nvs_ram;
+
+void host_clock_advance_us(int64_t us)
+{
+    if (us > 0) {
+        s_uptime_us += us;
+    }
+}
+
+void host_clock_set_wall(time_t epoch)
+{
+    s_wall_set = epoch != 0;
+    s_wall_us = (int64_t)epoch * 1000000 - s_uptime_us;
+}
+
+int host_gettimeofday(struct timeval *tv, void *tz)
+{
+    (void)tz;
+    int64_t us = s_wall_set ? s_wall_us + s_uptime_us : s_uptime_us;
+    tv->tv_sec = (time_t)(us / 1000000);
+    tv->tv_usec = (suseconds_t)(us % 1000000);
+    return 0;
+}
+
+time_t host_time(time_t *out)
+{
+    struct timeval tv;
+    host_gettimeofday(&tv, NULL);
+    if (out != NULL) {
+        *out = tv.tv_sec;
+    }
+    return tv.tv_sec;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return s_uptime_us;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    static struct host_sem sems[16];
+    static int n;
+    return n < 16 ? &sems[n++] : NULL;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait)
+{
+    (void)wait;
+    if (s->taken) {
+        return pdFALSE;
+    }
+    s->taken = 1;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s)
+{
+    s->taken = 0;
+    return pdTRUE;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_ERR";
+}
+
+void ui_notify(ui_notify_t what)
+{
+    (void)what;
+}
+
+void host_nvs_share(void)
+{
+    host_nvs_t *m = mmap(NULL, sizeof(*m), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (m != MAP_FAILED) {
+        *m = *s_nvs;
+        s_nvs = m;
+    }
+}
+
+/* One namespace is enough for the host tools; keys are shared across handles and namespaces. Every
+ * value is a blob; u8 and strings (with their NUL) are blobs of their own length. */
+esp_err_t nvs_open(const char *ns, nvs_open_mode_t mode, nvs_handle_t *out)
+{
+    (void)ns;
+    (void)mode;
+    *out = 1;
+    return ESP_OK;
+}
+
+static int nvs_find(const char *key)
+{
+    for (size_t i = 0; i < s_nvs->count; i++) {
+        if (strcmp(s_nvs->e[i].key, key) == 0) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out, size_t *len)
+{
+    (void)h;
+    int i = nvs_find(key);
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    if (out == NULL) {
+        *len = s_nvs->e[i].len;
+        return ESP_OK;
+    }
+    if (*len < s_nvs->e[i].len) {
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, s_nvs->e[i].value, s_nvs->e[i].len);
+    *len = s_nvs->e[i].len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value, size_t len)
+{
+    (void)h;
+    int i = nvs_find(key);
+    if (i < 0) {
+        if (s_nvs->count == HOST_NVS_KEYS || strlen(key) >= sizeof(s_nvs->e[0].key)) {
+            return ESP_FAIL;
+        }
+        i = (int)s_nvs->count++;
+        strcpy(s_nvs->e[i].key, key);
+    }
+    if (len > sizeof(s_nvs->e[i].value)) {
+        return ESP_ERR_NVS_VALUE_TOO_LONG;
+    }
+    memcpy(s_nvs->e[i].value, value, len);
+    s_nvs->e[i].len = len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u8(nvs_handle_t h, const char *key, uint8_t *out)
+{
+    size_t len = 1;
+    int i = nvs_find(key);
+    return i >= 0 && s_nvs->e[i].len == 1 ? nvs_get_blob(h, key, out, &len) : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_set_u8(nvs_handle_t h, const char *key, uint8_t value)
+{
+    return nvs_set_blob(h, key, &value, 1);
+}
+
+esp_err_t nvs_get_str(nvs_handle_t h, const char *key, char *out, size_t *len)
+{
+    return nvs_get_blob(h, key, out, len);
+}
+
+esp_err_t nvs_set_str(nvs_handle_t h, const char *key, const char *value)
+{
+    return nvs_set_blob(h, key, value, strlen(value) + 1);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t h, const char *key)
+{
+    (void)h;
+    int i = nvs_find(key);
+    if (i < 0) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    s_nvs->e[i] = s_nvs->e[--s_nvs->count];
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_all(nvs_handle_t h)
+{
+    (void)h;
+    s_nvs->count = 0;
+    return ESP_OK;
+}
+
+esp_err_t nvs_commit(nvs_handle_t h)
+{
+    (void)h;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t h)
+{
+    (void)h;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (!host_wifi_associated) {
+        return ESP_FAIL;
+    }
+    memset(ap_info, 0, sizeof(*ap_info));
+    ap_info->rssi = host_wifi_rssi;
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key)
+{
+    static esp_netif_t sta;
+    return strcmp(if_key, "WIFI_STA_DEF") == 0 ? &sta : NULL;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info)
+{
+    (void)esp_netif;
+    memset(ip_info, 0, sizeof(*ip_info));
+    ip_info->ip.addr = host_ip_addr;
+    return ESP_OK;
+}
+
+size_t heap_caps_get_free_size(uint32_t caps)
+{
+    (void)caps;
+    return host_heap_free;
+}
+
+const esp_app_desc_t *esp_app_get_description(void)
+{
+    static esp_app_desc_t desc = { .project_name = "water_bucket_controller" };
+    memcpy(desc.version, host_fw_version, sizeof(desc.version));
+    return &desc;
+}
+
+static uint8_t s_evlog_mem[HOST_EVLOG_SECTORS * HOST_EVLOG_SECTOR];
+static evlog_t s_evlog;
+static bool s_evlog_open;
+
+static int evlog_mem_read(void *ctx, uint32_t off, void *buf, size_t len)
+{
+    (void)ctx;
+    memcpy(buf, s_evlog_mem + off, len);
+    return 0;
+}
+
+/* NOR flash: a write can only clear bits. */
+static int evlog_mem_write(void *ctx, uint32_t off, const void *buf, size_t len)
+{
+    (void)ctx;
+    const uint8_t *p = buf;
+    for (size_t i = 0; i < len; i++) {
+        s_evlog_mem[off + i] &= p[i];
+    }
+    return 0;
+}
+
+static int evlog_mem_erase(void *ctx, uint32_t off, size_t len)
+{
+    (void)ctx;
+    memset(s_evlog_mem + off, 0xFF, len);
+    return 0;
+}
+
+static evlog_t *host_evlog(void)
+{
+    if (!s_evlog_open) {
+        const evlog_flash_t fl = {
+            .read = evlog_mem_read,
+            .write = evlog_mem_write,
+            .erase = evlog_mem_erase,
+            .size = sizeof(s_evlog_mem),
+            .sector = HOST_EVLOG_SECTOR,
+        };
+        memset(s_evlog_mem, 0xFF, sizeof(s_evlog_mem));
+        (void)evlog_open(&s_evlog, &fl);
+        s_evlog_open = true;
+    }
+    return &s_evlog;
+}
+
+void evlog_put(const evlog_rec_t *rec)
+{
+    (void)evlog_append(host_evlog(), rec, 1);
+}
+
+size_t evlog_history(size_t from_newest, evlog_rec_t *out, size_t max)
+{
+    return evlog_read(host_evlog(), from_newest, out, max);
+}
+
+uint32_t evlog_total(void)
+{
+    return evlog_count(host_evlog());
+}
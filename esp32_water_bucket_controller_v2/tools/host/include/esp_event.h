@@ -0,0 +1,5 @@
+/* Host fake of the ESP-IDF header, enough for the UI and log code. */
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+typedef const char *esp_event_base_t;
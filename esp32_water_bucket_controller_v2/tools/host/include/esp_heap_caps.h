@@ -0,0 +1,6 @@
+/* Host fake of the ESP-IDF header, enough for the UI and log code. */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#define MALLOC_CAP_8BIT (1 << 2)
+size_t heap_caps_get_free_size(uint32_t caps);
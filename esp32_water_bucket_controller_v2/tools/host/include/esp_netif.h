@@ -0,0 +1,17 @@
+/* Host fake of the ESP-IDF header, enough for the UI and log code. */
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct esp_netif_obj esp_netif_t;
+typedef struct {
+    uint32_t addr;
+} esp_ip4_addr_t;
+typedef struct {
+    esp_ip4_addr_t ip;
+    esp_ip4_addr_t netmask;
+    esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+#define IP2STR(ipaddr) (unsigned)((ipaddr)->addr & 0xff), (unsigned)(((ipaddr)->addr >> 8) & 0xff), \
+    (unsigned)(((ipaddr)->addr >> 16) & 0xff), (unsigned)(((ipaddr)->addr >> 24) & 0xff)
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info);
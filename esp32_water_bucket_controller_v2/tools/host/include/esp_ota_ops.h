@@ -0,0 +1,17 @@
+/* Host fake of the ESP-IDF header: two app slots, ota_0 running (PENDING_VERIFY while
+ * host_ota_pending_verify) and ota_1 next. */
+#pragma once
+#include "esp_err.h"
+#include "esp_partition.h"
+typedef enum {
+    ESP_OTA_IMG_NEW,
+    ESP_OTA_IMG_PENDING_VERIFY,
+    ESP_OTA_IMG_VALID,
+    ESP_OTA_IMG_INVALID,
+    ESP_OTA_IMG_ABORTED,
+    ESP_OTA_IMG_UNDEFINED,
+} esp_ota_img_states_t;
+const esp_partition_t *esp_ota_get_running_partition(void);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *part, esp_ota_img_states_t *out);
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part);
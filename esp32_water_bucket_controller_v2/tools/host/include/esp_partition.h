@@ -0,0 +1,13 @@
+/* Host fake of the ESP-IDF header: RAM partitions with NOR flash rules (tools/host/ota_fakes.c). */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct {
+    uint32_t address;
+    uint32_t size;
+    char label[17];
+} esp_partition_t;
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t off, void *dst, size_t len);
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t off, const void *src, size_t len);
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t off, size_t len);
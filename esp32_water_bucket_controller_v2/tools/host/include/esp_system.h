@@ -0,0 +1,3 @@
+/* Host fake of the ESP-IDF header: esp_restart() ends the process with HOST_EXIT_RESTART. */
+#pragma once
+void esp_restart(void) __attribute__((noreturn));
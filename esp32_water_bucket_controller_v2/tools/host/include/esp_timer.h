@@ -0,0 +1,4 @@
+/* Host fake of the ESP-IDF header: microseconds since the first call. */
+#pragma once
+#include <stdint.h>
+int64_t esp_timer_get_time(void);
@@ -0,0 +1,11 @@
+/* Host fake of the ESP-IDF header, enough for the UI and log code. */
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+typedef struct {
+    uint8_t bssid[6];
+    uint8_t ssid[33];
+    uint8_t primary;
+    int8_t rssi;
+} wifi_ap_record_t;
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info);
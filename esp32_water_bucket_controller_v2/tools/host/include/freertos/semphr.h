@@ -0,0 +1,7 @@
+/* Host fake of the FreeRTOS header: mutexes that are always free. */
+#pragma once
+#include "freertos/FreeRTOS.h"
+typedef struct host_sem *SemaphoreHandle_t;
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t s, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t s);
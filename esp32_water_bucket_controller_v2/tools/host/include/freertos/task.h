@@ -0,0 +1,11 @@
+/* Host fake of the FreeRTOS header: xTaskCreate() runs the task to completion before returning and
+ * vTaskDelay() only moves the virtual clock. */
+#pragma once
+#include "FreeRTOS.h"
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+typedef unsigned UBaseType_t;
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *out);
+void vTaskDelay(TickType_t ticks);
+void vTaskDelete(TaskHandle_t task);
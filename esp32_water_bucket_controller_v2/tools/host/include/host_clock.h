@@ -0,0 +1,16 @@
+/*
+ * host_clock.h - Force-included (-include) into host builds so the code under test reads the fake
+ * clocks in tools/host/fakes.c: wall time stays at 0 ("not synced") until host_clock_set_wall().
+ */
+#pragma once
+#include <sys/time.h>
+#include <time.h>
+#include <stdint.h>
+
+time_t host_time(time_t *out);
+int host_gettimeofday(struct timeval *tv, void *tz);
+void host_clock_advance_us(int64_t us);
+void host_clock_set_wall(time_t epoch);
+
+#define time(t) host_time(t)
+#define gettimeofday(tv, tz) host_gettimeofday(tv, tz)
@@ -0,0 +1,42 @@
+/*
+ * host_fakes.h - Knobs for the values the fakes in tools/host/fakes.c report in place of the radio,
+ * heap and firmware getters. The clocks are in host_clock.h.
+ */
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+extern int8_t host_wifi_rssi;
+extern bool host_wifi_associated;   /* esp_wifi_sta_get_ap_info() fails while false */
+extern uint32_t host_ip_addr;       /* network order as in esp_ip4_addr_t; 0 = no netif address */
+extern uint32_t host_heap_free;
+extern char host_fw_version[32];
+
+/* Moves the NVS store into memory shared with fork()ed children, so a child can play one boot. */
+void host_nvs_share(void);
+
+/*
+ * OTA (tools/host/ota_fakes.c). The flash and these counters live in memory shared with fork()ed
+ * children, so each child can play one boot and the parent checks what it left behind.
+ */
+#define HOST_EXIT_RESTART   3   /* esp_restart() */
+#define HOST_EXIT_POWER_CUT 4   /* host_flash_power_cut ran out */
+#define HOST_OTA_SLOT_SIZE  (1024 * 1024)
+
+typedef struct {
+    uint32_t tasks;             /* xTaskCreate() calls */
+    uint32_t requests;          /* HTTP requests sent */
+    uint32_t ranged;            /* of which asked for "Range: bytes=N-" */
+    uint32_t short_bodies;      /* responses that closed before Content-Length */
+    int64_t boot_first_range;   /* Range start of the latest boot's first request (0: none) */
+    int64_t after_bad_range;    /* Range start of the request after a bad Content-Range (0: none); -1 not yet */
+    bool boot_set;              /* esp_ota_set_boot_partition() called on ota_1 */
+} host_ota_stats_t;
+
+extern host_ota_stats_t *host_ota;
+extern int32_t host_flash_power_cut;    /* partition bytes written before the power goes; -1 never */
+extern int host_http_bad_ranges;        /* 206 responses whose Content-Range is reported a sector late */
+extern bool host_ota_pending_verify;    /* the running slot is ESP_OTA_IMG_PENDING_VERIFY */
+
+void host_ota_reset(void);              /* both slots erased, counters zeroed */
+const uint8_t *host_ota_slot(int slot);
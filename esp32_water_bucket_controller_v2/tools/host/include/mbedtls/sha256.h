@@ -0,0 +1,14 @@
+/* Host fake of the mbedtls header: a plain SHA-256 (tools/host/ota_fakes.c); is224 must be 0. */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+typedef struct {
+    uint32_t state[8];
+    uint64_t total;
+    unsigned char buffer[64];
+} mbedtls_sha256_context;
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx);
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx);
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224);
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *in, size_t len);
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char out[32]);
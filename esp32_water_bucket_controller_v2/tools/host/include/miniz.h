@@ -0,0 +1,55 @@
+/* Host fake of the ROM miniz header: the tinfl calls ota.c makes, on top of zlib (link -lz). */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <zlib.h>
+typedef uint8_t mz_uint8;
+typedef uint32_t mz_uint32;
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_PARSE_ZLIB_HEADER 1
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+typedef enum {
+    TINFL_STATUS_FAILED_CANNOT_MAKE_PROGRESS = -4,
+    TINFL_STATUS_BAD_PARAM = -3,
+    TINFL_STATUS_ADLER32_MISMATCH = -2,
+    TINFL_STATUS_FAILED = -1,
+    TINFL_STATUS_DONE = 0,
+    TINFL_STATUS_NEEDS_MORE_INPUT = 1,
+    TINFL_STATUS_HAS_MORE_OUTPUT = 2,
+} tinfl_status;
+typedef struct {
+    z_stream z;
+    int init;
+} tinfl_decompressor;
+#define tinfl_init(r) do { (r)->init = 0; } while (0)
+
+static inline tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *in, size_t *in_size,
+                                            mz_uint8 *out_start, mz_uint8 *out_next, size_t *out_size,
+                                            mz_uint32 flags)
+{
+    (void)out_start;
+    (void)flags;
+    if (!r->init) {
+        memset(&r->z, 0, sizeof(r->z));
+        if (inflateInit(&r->z) != Z_OK) {
+            return TINFL_STATUS_FAILED;
+        }
+        r->init = 1;
+    }
+    r->z.next_in = (Bytef *)in;
+    r->z.avail_in = (uInt)*in_size;
+    r->z.next_out = out_next;
+    r->z.avail_out = (uInt)*out_size;
+    int rc = inflate(&r->z, Z_NO_FLUSH);
+    *in_size -= r->z.avail_in;
+    *out_size -= r->z.avail_out;
+    if (rc == Z_STREAM_END) {
+        inflateEnd(&r->z);
+        return TINFL_STATUS_DONE;
+    }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) {
+        return TINFL_STATUS_FAILED;
+    }
+    return r->z.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -0,0 +1,21 @@
+/* Host fake of the ESP-IDF header: an in-memory store of u8, string and blob keys. */
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include <stddef.h>
+#define ESP_ERR_NVS_NOT_FOUND        0x1102
+#define ESP_ERR_NVS_VALUE_TOO_LONG   0x110c
+#define ESP_ERR_NVS_INVALID_LENGTH   0x1117
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+esp_err_t nvs_open(const char *ns, nvs_open_mode_t mode, nvs_handle_t *out);
+esp_err_t nvs_get_u8(nvs_handle_t h, const char *key, uint8_t *out);
+esp_err_t nvs_set_u8(nvs_handle_t h, const char *key, uint8_t value);
+esp_err_t nvs_get_str(nvs_handle_t h, const char *key, char *out, size_t *len);
+esp_err_t nvs_set_str(nvs_handle_t h, const char *key, const char *value);
+esp_err_t nvs_get_blob(nvs_handle_t h, const char *key, void *out, size_t *len);
+esp_err_t nvs_set_blob(nvs_handle_t h, const char *key, const void *value, size_t len);
+esp_err_t nvs_erase_key(nvs_handle_t h, const char *key);
+esp_err_t nvs_erase_all(nvs_handle_t h);
+esp_err_t nvs_commit(nvs_handle_t h);
+void nvs_close(nvs_handle_t h);
@@ -0,0 +1,3 @@
+/* Host fake of the ESP-IDF header. */
+#pragma once
+#include "nvs.h"
@@ -0,0 +1,2 @@
+/* Host builds: no credentials, every WB_* option at its default. Shadows main/wb_config.h. */
+#pragma once
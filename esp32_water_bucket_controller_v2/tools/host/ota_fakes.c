@@ -0,0 +1,511 @@
+/*
+ * ota_fakes.c - Host stand-ins for the calls main/ota.c makes beyond tools/host/fakes.c: an http://
+ * client over POSIX sockets, two RAM app slots with NOR flash rules (erase to 0xff, writes only clear
+ * bits), the OTA slot getters, SHA-256, and tasks that run to completion inside xTaskCreate().
+ *
+ * The slots and host_ota counters are mapped shared on first use, so a fork()ed child that plays one
+ * boot leaves them for the parent; esp_restart() and a power cut end the child with HOST_EXIT_*.
+ */
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "freertos/task.h"
+#include "host_clock.h"
+#include "host_fakes.h"
+#include "mbedtls/sha256.h"
+#include "mqtt_client.h"
+
+#define HOST_HTTP_HDR_MAX 4096
+
+typedef struct {
+    host_ota_stats_t stats;
+    uint8_t flash[2][HOST_OTA_SLOT_SIZE];
+} host_ota_mem_t;
+
+static host_ota_mem_t *s_mem;
+static host_ota_stats_t s_stats_unmapped;
+static bool s_bad_range_sent;
+static pid_t s_requested_by;    /* the last process (boot) that sent a request */
+
+host_ota_stats_t *host_ota = &s_stats_unmapped;
+int32_t host_flash_power_cut = -1;
+int host_http_bad_ranges;
+bool host_ota_pending_verify;
+
+static const esp_partition_t s_slots[2] = {
+    { .address = 0x10000, .size = HOST_OTA_SLOT_SIZE, .label = "ota_0" },
+    { .address = 0x10000 + HOST_OTA_SLOT_SIZE, .size = HOST_OTA_SLOT_SIZE, .label = "ota_1" },
+};
+
+static host_ota_mem_t *mem(void)
+{
+    if (s_mem == NULL) {
+        s_mem = mmap(NULL, sizeof(*s_mem), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (s_mem == MAP_FAILED) {
+            perror("mmap");
+            exit(2);
+        }
+        host_ota = &s_mem->stats;
+        host_ota_reset();
+    }
+    return s_mem;
+}
+
+void host_ota_reset(void)
+{
+    host_ota_mem_t *m = mem();
+    memset(m->flash, 0xff, sizeof(m->flash));
+    memset(&m->stats, 0, sizeof(m->stats));
+    m->stats.after_bad_range = -1;
+}
+
+const uint8_t *host_ota_slot(int slot)
+{
+    return mem()->flash[slot];
+}
+
+static uint8_t *slot_bytes(const esp_partition_t *part, size_t off, size_t len)
+{
+    int i = part == &s_slots[1];
+    if (part != &s_slots[i] || off > part->size || len > part->size - off) {
+        return NULL;
+    }
+    return mem()->flash[i] + off;
+}
+
+/* ---- partitions and OTA slots ---- */
+
+esp_err_t esp_partition_read(const esp_partition_t *part, size_t off, void *dst, size_t len)
+{
+    uint8_t *p = slot_bytes(part, off, len);
+    if (p == NULL) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    memcpy(dst, p, len);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *part, size_t off, const void *src, size_t len)
+{
+    uint8_t *p = slot_bytes(part, off, len);
+    if (p == NULL) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    size_t n = len;
+    if (host_flash_power_cut >= 0 && n > (size_t)host_flash_power_cut) {
+        n = (size_t)host_flash_power_cut;   // the write in flight when the power goes lands in part
+    }
+    const uint8_t *s = src;
+    for (size_t i = 0; i < n; i++) {
+        p[i] &= s[i];
+    }
+    if (host_flash_power_cut >= 0) {
+        host_flash_power_cut -= (int32_t)n;
+        if (n < len || host_flash_power_cut == 0) {
+            fflush(NULL);
+            _exit(HOST_EXIT_POWER_CUT);
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *part, size_t off, size_t len)
+{
+    uint8_t *p = slot_bytes(part, off, len);
+    if (p == NULL || off % 4096 != 0 || len % 4096 != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(p, 0xff, len);
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &s_slots[0];
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *part, esp_ota_img_states_t *out)
+{
+    if (part == &s_slots[0]) {
+        *out = host_ota_pending_verify ? ESP_OTA_IMG_PENDING_VERIFY : ESP_OTA_IMG_VALID;
+        return ESP_OK;
+    }
+    *out = ESP_OTA_IMG_UNDEFINED;
+    return ESP_ERR_NOT_FOUND;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    (void)start_from;
+    return &s_slots[1];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *part)
+{
+    mem()->stats.boot_set = part == &s_slots[1];
+    return ESP_OK;
+}
+
+/* ---- system and tasks ---- */
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos,
+                            int retain)
+{
+    (void)client;
+    (void)topic;
+    (void)data;
+    (void)qos;
+    (void)retain;
+    return len;     // nobody listens on the host
+}
+
+void esp_restart(void)
+{
+    fflush(NULL);
+    _exit(HOST_EXIT_RESTART);
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *out)
+{
+    (void)name;
+    (void)stack;
+    (void)prio;
+    if (out != NULL) {
+        *out = NULL;
+    }
+    mem()->stats.tasks++;
+    fn(arg);
+    return pdPASS;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    host_clock_advance_us((int64_t)ticks * portTICK_PERIOD_MS * 1000);
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    (void)task;
+}
+
+/* ---- SHA-256 (FIPS 180-4) ---- */
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void sha256_block(uint32_t st[8], const unsigned char *p)
+{
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+    uint32_t a = st[0], b = st[1], c = st[2], d = st[3], e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + K256[i] + w[i];
+        uint32_t t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    st[0] += a;
+    st[1] += b;
+    st[2] += c;
+    st[3] += d;
+    st[4] += e;
+    st[5] += f;
+    st[6] += g;
+    st[7] += h;
+}
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224)
+{
+    static const uint32_t iv[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+    };
+    if (is224) {
+        return -1;
+    }
+    memcpy(ctx->state, iv, sizeof(iv));
+    ctx->total = 0;
+    return 0;
+}
+
+int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *in, size_t len)
+{
+    size_t have = (size_t)(ctx->total % 64);
+    ctx->total += len;
+    while (len > 0) {
+        size_t n = 64 - have < len ? 64 - have : len;
+        memcpy(ctx->buffer + have, in, n);
+        have += n;
+        in += n;
+        len -= n;
+        if (have == 64) {
+            sha256_block(ctx->state, ctx->buffer);
+            have = 0;
+        }
+    }
+    return 0;
+}
+
+int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char out[32])
+{
+    uint64_t bits = ctx->total * 8;
+    unsigned char pad[72] = { 0x80 };
+    size_t have = (size_t)(ctx->total % 64);
+    size_t n = (have < 56 ? 56 : 120) - have;
+    for (int i = 0; i < 8; i++) {
+        pad[n + i] = (unsigned char)(bits >> (56 - 8 * i));
+    }
+    mbedtls_sha256_update(ctx, pad, n + 8);
+    for (int i = 0; i < 8; i++) {
+        out[4 * i] = (unsigned char)(ctx->state[i] >> 24);
+        out[4 * i + 1] = (unsigned char)(ctx->state[i] >> 16);
+        out[4 * i + 2] = (unsigned char)(ctx->state[i] >> 8);
+        out[4 * i + 3] = (unsigned char)ctx->state[i];
+    }
+    return 0;
+}
+
+/* ---- HTTP client ---- */
+
+struct esp_http_client {
+    int fd;
+    char host[64];
+    char port[8];
+    char path[128];
+    char range[32];
+    int timeout_ms;
+    http_event_handle_cb handler;
+    void *user_data;
+    int status;
+    int64_t content_length;
+    int64_t remaining;          /* body bytes not yet returned */
+    char hdr[HOST_HTTP_HDR_MAX];
+    size_t hdr_len;
+    size_t body_at;             /* body bytes read along with the headers start here */
+};
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    const char *u = config->url;
+    if (strncmp(u, "http://", 7) != 0) {
+        return NULL;    // no TLS on the host
+    }
+    struct esp_http_client *c = calloc(1, sizeof(*c));
+    if (c == NULL) {
+        return NULL;
+    }
+    u += 7;
+    size_t hl = strcspn(u, ":/");
+    snprintf(c->host, sizeof(c->host), "%.*s", (int)hl, u);
+    u += hl;
+    snprintf(c->port, sizeof(c->port), "80");
+    if (*u == ':') {
+        size_t pl = strcspn(++u, "/");
+        snprintf(c->port, sizeof(c->port), "%.*s", (int)pl, u);
+        u += pl;
+    }
+    snprintf(c->path, sizeof(c->path), "%s", *u == '/' ? u : "/");
+    c->fd = -1;
+    c->timeout_ms = config->timeout_ms;
+    c->handler = config->event_handler;
+    c->user_data = config->user_data;
+    return c;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t c, const char *key, const char *value)
+{
+    if (strcasecmp(key, "Range") != 0) {
+        return ESP_OK;  // only Range matters to the server under test
+    }
+    snprintf(c->range, sizeof(c->range), "%s", value);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t c, int write_len)
+{
+    (void)write_len;
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM }, *ai;
+    if (getaddrinfo(c->host, c->port, &hints, &ai) != 0) {
+        return ESP_FAIL;
+    }
+    c->fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (c->fd >= 0 && connect(c->fd, ai->ai_addr, ai->ai_addrlen) != 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    freeaddrinfo(ai);
+    if (c->fd < 0) {
+        return ESP_FAIL;
+    }
+    struct timeval tv = { c->timeout_ms / 1000, (c->timeout_ms % 1000) * 1000 };
+    setsockopt(c->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    char req[512];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s:%s\r\n%s%s%sConnection: close\r\n\r\n",
+                     c->path, c->host, c->port, c->range[0] ? "Range: " : "", c->range, c->range[0] ? "\r\n" : "");
+    if (send(c->fd, req, (size_t)n, MSG_NOSIGNAL) != n) {
+        return ESP_FAIL;
+    }
+    host_ota_stats_t *st = &mem()->stats;
+    st->requests++;
+    int64_t start = c->range[0] ? strtoll(c->range + strlen("bytes="), NULL, 10) : 0;
+    st->ranged += c->range[0] != 0;
+    if (s_requested_by != getpid()) {
+        s_requested_by = getpid();
+        st->boot_first_range = start;
+    }
+    if (s_bad_range_sent && st->after_bad_range < 0) {
+        st->after_bad_range = start;
+    }
+    return ESP_OK;
+}
+
+static void header(esp_http_client_handle_t c, char *key, char *value)
+{
+    char skewed[64];
+    if (strcasecmp(key, "Content-Length") == 0) {
+        c->content_length = strtoll(value, NULL, 10);
+    } else if (strcasecmp(key, "Content-Range") == 0 && c->status == 206 && host_http_bad_ranges > 0) {
+        const char *dash = strchr(value, '-');
+        long long first = strtoll(value + strlen("bytes "), NULL, 10);
+        snprintf(skewed, sizeof(skewed), "bytes %lld%s", first + 4096, dash != NULL ? dash : "-");
+        value = skewed;
+        host_http_bad_ranges--;
+        s_bad_range_sent = true;
+    }
+    if (c->handler != NULL) {
+        esp_http_client_event_t ev = {
+            .event_id = HTTP_EVENT_ON_HEADER,
+            .client = c,
+            .user_data = c->user_data,
+            .header_key = key,
+            .header_value = value,
+        };
+        c->handler(&ev);
+    }
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t c)
+{
+    char *end = NULL;
+    while (end == NULL) {
+        if (c->hdr_len == sizeof(c->hdr) - 1) {
+            return -1;
+        }
+        ssize_t n = recv(c->fd, c->hdr + c->hdr_len, sizeof(c->hdr) - 1 - c->hdr_len, 0);
+        if (n <= 0) {
+            return -1;
+        }
+        c->hdr_len += (size_t)n;
+        c->hdr[c->hdr_len] = '\0';
+        end = strstr(c->hdr, "\r\n\r\n");
+    }
+    c->body_at = (size_t)(end - c->hdr) + 4;
+    *end = '\0';
+    char *save;
+    char *line = strtok_r(c->hdr, "\r\n", &save);
+    if (line == NULL || sscanf(line, "HTTP/%*s %d", &c->status) != 1) {
+        return -1;
+    }
+    c->content_length = -1;
+    while ((line = strtok_r(NULL, "\r\n", &save)) != NULL) {
+        char *colon = strchr(line, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            header(c, line, colon + 1 + strspn(colon + 1, " "));
+        }
+    }
+    c->remaining = c->content_length;
+    return c->content_length;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t c)
+{
+    return c->status;
+}
+
+int esp_http_client_read(esp_http_client_handle_t c, char *buffer, int len)
+{
+    if (c->remaining <= 0) {
+        return 0;
+    }
+    if (len > c->remaining) {
+        len = (int)c->remaining;
+    }
+    ssize_t n;
+    if (c->body_at < c->hdr_len) {
+        n = (ssize_t)(c->hdr_len - c->body_at) < len ? (ssize_t)(c->hdr_len - c->body_at) : len;
+        memcpy(buffer, c->hdr + c->body_at, (size_t)n);
+        c->body_at += (size_t)n;
+    } else {
+        do {
+            n = recv(c->fd, buffer, (size_t)len, 0);
+        } while (n < 0 && errno == EINTR);
+    }
+    if (n <= 0) {
+        mem()->stats.short_bodies++;
+        c->remaining = 0;
+        return n == 0 ? 0 : -1;
+    }
+    c->remaining -= n;
+    return (int)n;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t c)
+{
+    if (c->fd >= 0) {
+        close(c->fd);
+        c->fd = -1;
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t c)
+{
+    esp_http_client_close(c);
+    free(c);
+    return ESP_OK;
+}
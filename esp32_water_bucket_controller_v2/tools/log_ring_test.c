@@ -0,0 +1,244 @@
+/*
+ * log_ring_test.c - Host stress test of the lock-free log ring (main/log_ring.c): several producer threads
+ * write numbered lines as fast as they can while one consumer drains the ring and sleeps between bursts, so
+ * the ring is full most of the time. Built and run by `make log-ring-test`.
+ *
+ * Each line is "<producer><seq> <fill>\n" where the fill length and bytes follow from producer and seq, so
+ * the consumer can tell a torn or mixed record from a whole one. Checked: every line read is whole, each
+ * producer's lines arrive in increasing seq, every line is either read or was refused by log_ring_write(),
+ * and the ring's dropped byte count equals the bytes the producers were refused.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "log_ring.h"
+
+#define RING_CAP      2048u
+#define PRODUCERS     4
+#define LINES_EACH    40000u
+#define FILL_MAX      300u        /* some lines span the wrap point */
+#define CONSUMER_READ RING_CAP   /* a read can reach the record being written */
+
+static uint32_t s_words[RING_CAP / 4];
+static log_ring_t s_ring;
+static int s_fail;
+static int s_producers_done;
+
+typedef struct {
+    int id;
+    uint32_t refused_lines;
+    uint64_t refused_bytes;
+    uint64_t written_bytes;
+} producer_t;
+
+static producer_t s_prod[PRODUCERS];
+
+#define CHECK(cond, ...)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            printf("FAIL %s:%d: ", __func__, __LINE__);    \
+            printf(__VA_ARGS__);                           \
+            printf("\n");                                  \
+            s_fail++;                                      \
+            return;                                        \
+        }                                                  \
+    } while (0)
+
+static uint32_t fill_len(int id, uint32_t seq)
+{
+    return (seq * 2654435761u + (uint32_t)id * 40503u) % FILL_MAX;
+}
+
+static char fill_char(int id, uint32_t seq, uint32_t i)
+{
+    return (char)('a' + (seq + i * 7u + (uint32_t)id * 3u) % 26u);
+}
+
+static size_t make_line(char *buf, int id, uint32_t seq)
+{
+    size_t n = (size_t)sprintf(buf, "%c%u ", 'A' + id, (unsigned)seq);
+    uint32_t fl = fill_len(id, seq);
+    for (uint32_t i = 0; i < fl; i++) {
+        buf[n++] = fill_char(id, seq, i);
+    }
+    buf[n++] = '\n';
+    return n;
+}
+
+static void *producer(void *arg)
+{
+    producer_t *p = arg;
+    char line[FILL_MAX + 32];
+    for (uint32_t seq = 0; seq < LINES_EACH; seq++) {
+        size_t n = make_line(line, p->id, seq);
+        if (log_ring_write(&s_ring, line, n, NULL)) {
+            p->written_bytes += n;
+        } else {
+            p->refused_lines++;
+            p->refused_bytes += n;
+        }
+        if ((seq & 63u) == 0) {
+            sched_yield();
+        }
+    }
+    __atomic_fetch_add(&s_producers_done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+typedef struct {
+    uint32_t next_seq[PRODUCERS];   /* lowest seq the next line from each producer may have */
+    uint32_t got_lines[PRODUCERS];
+    uint64_t got_bytes;
+    uint64_t dropped_bytes;
+    uint32_t reads;
+} consumer_t;
+
+static consumer_t s_cons;
+
+/* Checks one whole line (without its '\n'); returns 0 when it is torn or out of order. */
+static int check_line(const char *s, size_t len)
+{
+    char want[FILL_MAX + 32];
+    if (len < 3 || s[0] < 'A' || s[0] >= 'A' + PRODUCERS) {
+        printf("FAIL check_line: bad producer in \"%.*s\"\n", (int)(len < 40 ? len : 40), s);
+        return 0;
+    }
+    int id = s[0] - 'A';
+    char *end;
+    unsigned long seq = strtoul(s + 1, &end, 10);
+    if (end == s + 1 || *end != ' ' || seq >= LINES_EACH) {
+        printf("FAIL check_line: bad seq in \"%.*s\"\n", (int)(len < 40 ? len : 40), s);
+        return 0;
+    }
+    size_t wl = make_line(want, id, (uint32_t)seq);
+    if (wl != len + 1 || memcmp(want, s, len) != 0) {
+        printf("FAIL check_line: torn record %c%lu (%u bytes, want %u)\n", s[0], seq, (unsigned)len + 1,
+               (unsigned)wl);
+        return 0;
+    }
+    if (seq < s_cons.next_seq[id]) {
+        printf("FAIL check_line: %c%lu after %c%u\n", s[0], seq, s[0], (unsigned)s_cons.next_seq[id] - 1);
+        return 0;
+    }
+    s_cons.next_seq[id] = (uint32_t)seq + 1;
+    s_cons.got_lines[id]++;
+    return 1;
+}
+
+/* One consumer pass; log_ring_read() only returns whole records, so buf ends on a line boundary. */
+static int drain(void)
+{
+    static char buf[CONSUMER_READ];
+    size_t n = log_ring_read(&s_ring, buf, sizeof(buf));
+    s_cons.reads++;
+    s_cons.got_bytes += n;
+    s_cons.dropped_bytes += log_ring_take_dropped(&s_ring);
+    size_t start = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (buf[i] == '\n') {
+            if (!check_line(buf + start, i - start)) {
+                return -1;
+            }
+            start = i + 1;
+        }
+    }
+    if (start != n) {
+        printf("FAIL drain: read of %u bytes ends inside a line\n", (unsigned)n);
+        return -1;
+    }
+    return (int)n;
+}
+
+static void test_slow_consumer(void)
+{
+    log_ring_init(&s_ring, s_words, RING_CAP);
+    pthread_t th[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        s_prod[i].id = i;
+        CHECK(pthread_create(&th[i], NULL, producer, &s_prod[i]) == 0, "pthread_create");
+    }
+    /* Sleep after each burst of reads: the ring fills and drops while the consumer is away, and the
+     * reads in a burst race producers that are mid-copy. */
+    const struct timespec nap = { 0, 50000 };
+    int bad = 0;
+    for (uint32_t pass = 0;; pass++) {
+        int done = __atomic_load_n(&s_producers_done, __ATOMIC_ACQUIRE) == PRODUCERS;
+        int n = drain();
+        if (n < 0) {
+            bad = 1;
+            break;
+        }
+        if (done && n == 0) {
+            break;
+        }
+        if (n == 0 || pass % 16u == 15u) {
+            nanosleep(&nap, NULL);
+        }
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_join(th[i], NULL);
+    }
+    CHECK(!bad, "stream check failed");
+    uint64_t refused = 0, written = 0;
+    uint32_t refused_lines = 0;
+    for (int i = 0; i < PRODUCERS; i++) {
+        CHECK(s_cons.got_lines[i] + s_prod[i].refused_lines == LINES_EACH, "producer %c: %u read + %u refused != %u",
+              'A' + i, (unsigned)s_cons.got_lines[i], (unsigned)s_prod[i].refused_lines, LINES_EACH);
+        refused += s_prod[i].refused_bytes;
+        written += s_prod[i].written_bytes;
+        refused_lines += s_prod[i].refused_lines;
+    }
+    CHECK(refused_lines > 0, "consumer never fell behind; nothing was dropped");
+    CHECK(s_cons.dropped_bytes == refused, "ring counted %llu dropped bytes, producers were refused %llu",
+          (unsigned long long)s_cons.dropped_bytes, (unsigned long long)refused);
+    CHECK(s_cons.got_bytes == written, "read %llu bytes, producers wrote %llu",
+          (unsigned long long)s_cons.got_bytes, (unsigned long long)written);
+    printf("ok   %d producers x %u lines through a %u byte ring: %u read in %u reads, %u dropped (%llu bytes)\n",
+           PRODUCERS, LINES_EACH, RING_CAP, (unsigned)(PRODUCERS * LINES_EACH - refused_lines),
+           (unsigned)s_cons.reads, (unsigned)refused_lines, (unsigned long long)refused);
+}
+
+static void test_oversize(void)
+{
+    static uint32_t words[RING_CAP / 4];
+    static char big[LOG_RING_REC_MAX + 1];
+    log_ring_t r;
+    log_ring_init(&r, words, RING_CAP);
+    memset(big, 'x', sizeof(big));
+    CHECK(!log_ring_write(&r, big, sizeof(big), NULL), "record over LOG_RING_REC_MAX accepted");
+    CHECK(log_ring_take_dropped(&r) == sizeof(big), "oversize record not counted as dropped");
+    bool was_empty = false;
+    CHECK(log_ring_write(&r, big, LOG_RING_REC_MAX, &was_empty) && was_empty, "LOG_RING_REC_MAX refused");
+    char out[LOG_RING_REC_MAX];
+    CHECK(log_ring_read(&r, out, sizeof(out) - 1) == 0, "partial record read");
+    CHECK(log_ring_read(&r, out, sizeof(out)) == LOG_RING_REC_MAX, "record not read whole");
+    CHECK(log_ring_take_dropped(&r) == 0, "dropped count not cleared");
+    printf("ok   oversize record refused and counted\n");
+}
+
+static void test_read_one(void)
+{
+    static uint32_t words[RING_CAP / 4];
+    log_ring_t r;
+    log_ring_init(&r, words, RING_CAP);
+    CHECK(log_ring_write(&r, "ab", 2, NULL) && log_ring_write(&r, "\x1e" "cde", 4, NULL) &&
+          log_ring_write(&r, "f", 1, NULL), "write");
+    char out[16];
+    CHECK(log_ring_read_one(&r, out, sizeof(out)) == 2 && memcmp(out, "ab", 2) == 0, "first record");
+    CHECK(log_ring_read_one(&r, out, 3) == 0, "record larger than max read");
+    CHECK(log_ring_read_one(&r, out, sizeof(out)) == 4 && memcmp(out, "\x1e" "cde", 4) == 0, "second record");
+    CHECK(log_ring_read(&r, out, sizeof(out)) == 1 && out[0] == 'f', "rest");
+    CHECK(log_ring_read_one(&r, out, sizeof(out)) == 0, "empty");
+    printf("ok   read_one stops at each record\n");
+}
+
+int main(void)
+{
+    test_oversize();
+    test_read_one();
+    test_slow_consumer();
+    return s_fail != 0;
+}
@@ -0,0 +1,107 @@
+/*
+ * mqtt_disc_test.c - Host test that the table-built discovery documents (main/mqtt_disc.c) are byte for byte
+ * what the snprintf version of publish_discovery() sent, topics included. Run by `make mqtt-disc-test`.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "mqtt_disc.h"
+
+static int s_fail;
+
+#define CHECK(cond, ...) do { \
+    if (!(cond)) { \
+        printf("FAIL %s:%d: ", __func__, __LINE__); \
+        printf(__VA_ARGS__); \
+        printf("\n"); \
+        s_fail++; \
+    } \
+} while (0)
+
+/* publish_discovery() before the tables, with esp_mqtt_client_publish() collecting into out[]. */
+typedef struct {
+    char topic[128];
+    char payload[DISC_MSG_MAX];
+    int len;
+} msg_t;
+
+static size_t reference(const char *device_id, msg_t *out)
+{
+    size_t n = 0;
+    char unique_id[48], state_topic[64], name[32];
+    for (int i = 1; i <= 3; i++) {
+        snprintf(unique_id, sizeof(unique_id), "water_bucket_level_%d", i);
+        snprintf(state_topic, sizeof(state_topic), "water_bucket/state/level_%d", i);
+        snprintf(name, sizeof(name), "Level %d", i);
+        snprintf(out[n].topic, sizeof(out[n].topic), "%s/binary_sensor/%s/config", DISCOVERY_PREFIX, unique_id);
+        out[n].len = snprintf(out[n].payload, sizeof(out[n].payload),
+            "{\"name\":\"%s\",\"state_topic\":\"%s\",\"payload_on\":\"1\",\"payload_off\":\"0\",\"unique_id\":\"%s\","
+            "\"availability_topic\":\"%s\",\"payload_available\":\"online\",\"payload_not_available\":\"offline\","
+            "\"device\":{\"identifiers\":[\"%s\"],\"name\":\"Water Bucket\",\"model\":\"Water Bucket Controller\","
+            "\"manufacturer\":\"DIY\"}}",
+            name, state_topic, unique_id, WB_TOPIC_STATUS, device_id);
+        n++;
+    }
+    for (int i = 0; i < 6; i++) {
+        char tmpl[64];
+        snprintf(unique_id, sizeof(unique_id), "water_bucket_pump_%d", i);
+        snprintf(name, sizeof(name), "Pump %d", i);
+        snprintf(tmpl, sizeof(tmpl), "{{ 'ON' if value == '%d' else 'OFF' }}", i);
+        snprintf(out[n].topic, sizeof(out[n].topic), "%s/switch/%s/config", DISCOVERY_PREFIX, unique_id);
+        out[n].len = snprintf(out[n].payload, sizeof(out[n].payload),
+            "{\"name\":\"%s\",\"command_topic\":\"water_bucket/cmd/pump\",\"state_topic\":\"water_bucket/state/pump\","
+            "\"payload_on\":\"%c\",\"payload_off\":\"off\",\"value_template\":\"%s\",\"state_on\":\"ON\","
+            "\"state_off\":\"OFF\",\"unique_id\":\"%s\",\"availability_topic\":\"%s\",\"payload_available\":\"online\","
+            "\"payload_not_available\":\"offline\",\"device\":{\"identifiers\":[\"%s\"],\"name\":\"Water Bucket\","
+            "\"model\":\"Water Bucket Controller\",\"manufacturer\":\"DIY\"}}",
+            name, '0' + i, tmpl, unique_id, WB_TOPIC_STATUS, device_id);
+        n++;
+    }
+    return n;
+}
+
+static void test_device(const unsigned char mac[6])
+{
+    char device_id[DEVICE_ID_LEN + 1];
+    snprintf(device_id, sizeof(device_id), "water_bucket_%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    CHECK(strlen(device_id) == DEVICE_ID_LEN, "device id length %zu", strlen(device_id));
+    static msg_t want[16];
+    size_t nwant = reference(device_id, want);
+    CHECK(mqtt_disc_count() == nwant, "%zu documents, snprintf sent %zu", mqtt_disc_count(), nwant);
+    for (size_t i = 0; i < nwant && i < mqtt_disc_count(); i++) {
+        /* Guard bytes after the document catch a write past the returned length. */
+        char buf[DISC_MSG_MAX + 16];
+        memset(buf, 0x5a, sizeof(buf));
+        const char *topic = NULL;
+        size_t len = mqtt_disc_build(i, device_id, buf, &topic);
+        CHECK(topic != NULL && strcmp(topic, want[i].topic) == 0, "%zu: topic %s, want %s", i,
+              topic ? topic : "(null)", want[i].topic);
+        CHECK(want[i].len > 0 && (size_t)want[i].len < sizeof(want[i].payload), "%zu: reference truncated", i);
+        CHECK(len == (size_t)want[i].len && memcmp(buf, want[i].payload, len) == 0,
+              "%zu: payload differs\n  got:  %.*s\n  want: %s", i, (int)len, buf, want[i].payload);
+        CHECK(len <= DISC_MSG_MAX, "%zu: %zu bytes over DISC_MSG_MAX", i, len);
+        size_t guard = 0;
+        while (len + guard < sizeof(buf) && buf[len + guard] == 0x5a) {
+            guard++;
+        }
+        CHECK(len + guard == sizeof(buf), "%zu: wrote past byte %zu", i, len);
+    }
+}
+
+int main(void)
+{
+    static const unsigned char macs[][6] = {
+        { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 },
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 },
+        { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff },
+    };
+    for (size_t i = 0; i < sizeof(macs) / sizeof(macs[0]); i++) {
+        test_device(macs[i]);
+    }
+    if (s_fail == 0) {
+        printf("ok   %zu discovery documents byte-identical to snprintf for %zu device ids\n",
+               mqtt_disc_count(), sizeof(macs) / sizeof(macs[0]));
+    }
+    return s_fail != 0;
+}
@@ -0,0 +1,289 @@
+/*
+ * ota_host.c - Host test of the resumable OTA download (main/ota.c) against tools/ota_serve.py --drop,
+ * which cuts responses short at random: ota_host URL IMAGE SHA256HEX. Built and run, with the server,
+ * by `make ota-drop-test`.
+ *
+ * Each boot of the device is a fork()ed child over the fakes in tools/host/ (NVS, flash slots and
+ * counters shared with the parent); it ends in esp_restart(), a power cut, or the task giving up. Checked:
+ *   - a SHA-256 that is not exactly 64 hex digits (sign, 0x, space inside, short, trailing junk) starts
+ *     nothing, and one followed by a line ending is accepted
+ *   - a download cut by power loss resumes from the NVS checkpoint on the next boot, or when the same
+ *     URL is sent again (also without a hash)
+ *   - a 206 whose Content-Range does not start at the requested offset restarts the image from 0
+ *   - every finished download leaves the slot equal to IMAGE and is activated; a wrong hash is not
+ *   - while the running image is PENDING_VERIFY a command touches no flash and is only saved; it runs
+ *     from ota_resume_pending() once the image is confirmed
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "esp_http_client.h"
+#include "host_fakes.h"
+#include "nvs.h"
+#include "priv.h"
+
+#define SERVER_WAIT_MS 5000
+
+bool s_wifi_connected_state = true;
+bool s_mqtt_connected_state;
+esp_mqtt_client_handle_t s_mqtt_client;
+
+static const char *s_url;
+static const char *s_sha;
+static uint8_t *s_image;
+static size_t s_image_len;
+static int s_fail;
+
+#define CHECK(cond, ...)                                   \
+    do {                                                   \
+        if (!(cond)) {                                     \
+            printf("FAIL %s:%d: ", __func__, __LINE__);    \
+            printf(__VA_ARGS__);                           \
+            printf("\n");                                  \
+            s_fail++;                                      \
+            return;                                        \
+        }                                                  \
+    } while (0)
+
+typedef void (*boot_fn_t)(const char *arg);
+
+/* Plays one boot in a child; returns its exit code (0: it returned, HOST_EXIT_*: restart or power cut). */
+static int boot(boot_fn_t fn, const char *arg)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0) {
+        fn(arg);
+        fflush(NULL);
+        _exit(0);
+    }
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+static void boot_start(const char *cmd)
+{
+    ota_start_from_url(cmd);
+}
+
+static void boot_cut_at(const char *cmd)
+{
+    host_flash_power_cut = (int32_t)(s_image_len * 2 / 5);
+    ota_start_from_url(cmd);
+}
+
+static void boot_unconfirmed(const char *cmd)
+{
+    host_ota_pending_verify = true;
+    ota_start_from_url(cmd);
+    ota_resume_pending();   // the boot-time call must not start it either
+}
+
+static void boot_resume(const char *arg)
+{
+    (void)arg;
+    ota_resume_pending();
+}
+
+static void boot_resume_bad_range(const char *arg)
+{
+    (void)arg;
+    host_http_bad_ranges = 1;
+    ota_resume_pending();
+}
+
+static void wipe(void)
+{
+    nvs_handle_t h;
+    nvs_open("wb_ota", NVS_READWRITE, &h);
+    nvs_erase_all(h);
+    nvs_close(h);
+    host_ota_reset();
+}
+
+static bool nvs_has(const char *key)
+{
+    nvs_handle_t h;
+    size_t len = 0;
+    nvs_open("wb_ota", NVS_READONLY, &h);
+    bool found = nvs_get_blob(h, key, NULL, &len) == ESP_OK;
+    nvs_close(h);
+    return found;
+}
+
+static uint32_t saved_offset(void)
+{
+    uint32_t rs[3] = { 0 };    // ota_resume_t: part_addr, size, off
+    size_t len = sizeof(rs);
+    nvs_handle_t h;
+    nvs_open("wb_ota", NVS_READONLY, &h);
+    nvs_get_blob(h, "rs", rs, &len);
+    nvs_close(h);
+    return rs[2];
+}
+
+static bool slot_is_image(void)
+{
+    return memcmp(host_ota_slot(1), s_image, s_image_len) == 0;
+}
+
+static void test_bad_sha(void)
+{
+    static const char *bad[] = {
+        "0x%.62s",          // prefix instead of two digits
+        "+%.64s",           // sign
+        "-%.64s",
+        "%.30s %.34s",      // space inside
+        "%.63s",            // short
+        "%.64s0",           // long
+        "%.64sz",           // trailing junk
+        "%.64s junk",
+    };
+    char cmd[512], hex[80];
+    wipe();
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (i == 3) {
+            snprintf(hex, sizeof(hex), bad[i], s_sha, s_sha + 30);
+        } else {
+            snprintf(hex, sizeof(hex), bad[i], s_sha);
+        }
+        snprintf(cmd, sizeof(cmd), "%s %s", s_url, hex);
+        ota_start_from_url(cmd);
+        CHECK(host_ota->tasks == 0, "\"%s\" accepted", hex);
+    }
+    snprintf(cmd, sizeof(cmd), "%s %s\r\n", s_url, s_sha);
+    int rc = boot(boot_start, cmd);
+    CHECK(host_ota->tasks == 1 && rc == HOST_EXIT_RESTART, "hash with a line ending: rc %d", rc);
+    CHECK(host_ota->boot_set && slot_is_image(), "image not written and activated");
+    CHECK(!nvs_has("url"), "resume state left in NVS");
+    printf("ok   %u malformed hashes refused; full download in %u requests (%u cut short)\n",
+           (unsigned)(sizeof(bad) / sizeof(bad[0])), (unsigned)host_ota->requests,
+           (unsigned)host_ota->short_bodies);
+}
+
+static void test_power_cut_resume(void)
+{
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "%s %s", s_url, s_sha);
+    wipe();
+    int rc = boot(boot_cut_at, cmd);
+    uint32_t off = saved_offset();
+    CHECK(rc == HOST_EXIT_POWER_CUT, "first boot: rc %d, want a power cut", rc);
+    CHECK(nvs_has("url") && off > 0 && off % 4096 == 0 && off <= s_image_len * 2 / 5,
+          "checkpoint at %u after cutting at %u", (unsigned)off, (unsigned)(s_image_len * 2 / 5));
+    uint32_t ranged = host_ota->ranged;
+    rc = boot(boot_resume_bad_range, NULL);
+    CHECK(rc == HOST_EXIT_RESTART, "resume boot: rc %d", rc);
+    CHECK(host_ota->ranged > ranged, "resume did not ask for a range");
+    CHECK(host_ota->after_bad_range == 0, "request after a bad Content-Range started at %lld, want 0",
+          (long long)host_ota->after_bad_range);
+    CHECK(host_ota->boot_set && slot_is_image(), "resumed image not written and activated");
+    CHECK(!nvs_has("url"), "resume state left in NVS");
+    printf("ok   power cut at %u, checkpoint %u, resumed; bad Content-Range restarted at 0 (%u requests, %u cut "
+           "short)\n", (unsigned)(s_image_len * 2 / 5), (unsigned)off, (unsigned)host_ota->requests,
+           (unsigned)host_ota->short_bodies);
+}
+
+static void test_resend_without_sha(void)
+{
+    wipe();
+    int rc = boot(boot_cut_at, s_url);
+    uint32_t off = saved_offset();
+    CHECK(rc == HOST_EXIT_POWER_CUT && off > 0, "first boot: rc %d, checkpoint %u", rc, (unsigned)off);
+    rc = boot(boot_start, s_url);
+    CHECK(rc == HOST_EXIT_RESTART && host_ota->boot_set && slot_is_image(), "second boot: rc %d", rc);
+    CHECK(host_ota->boot_first_range == off, "same URL without a hash started at %lld, not %u",
+          (long long)host_ota->boot_first_range, (unsigned)off);
+    printf("ok   same URL without a hash resumed at %u\n", (unsigned)off);
+}
+
+static void test_wrong_sha(void)
+{
+    char cmd[512], hex[65];
+    for (int i = 0; i < 64; i++) {
+        hex[i] = (char)(s_sha[i] >= 'a' ? s_sha[i] - 'a' + 'A' : s_sha[i]);   // upper case parses too
+    }
+    hex[0] = hex[0] == '0' ? '1' : '0';
+    hex[64] = '\0';
+    snprintf(cmd, sizeof(cmd), "%s %s", s_url, hex);
+    wipe();
+    int rc = boot(boot_start, cmd);
+    CHECK(rc == 0 && host_ota->tasks == 1, "rc %d, %u tasks", rc, (unsigned)host_ota->tasks);
+    CHECK(!host_ota->boot_set, "image with the wrong hash activated");
+    CHECK(!nvs_has("url"), "resume state left in NVS");
+    printf("ok   wrong hash: downloaded, not activated\n");
+}
+
+static void test_pending_verify(void)
+{
+    char cmd[512];
+    snprintf(cmd, sizeof(cmd), "%s %s", s_url, s_sha);
+    wipe();
+    int rc = boot(boot_unconfirmed, cmd);
+    static const uint8_t erased[4096] = { [0 ... 4095] = 0xff };
+    CHECK(rc == 0 && host_ota->tasks == 0 && host_ota->requests == 0, "rc %d, %u tasks, %u requests", rc,
+          (unsigned)host_ota->tasks, (unsigned)host_ota->requests);
+    CHECK(memcmp(host_ota_slot(1), erased, sizeof(erased)) == 0, "rollback slot written while PENDING_VERIFY");
+    CHECK(nvs_has("url"), "deferred command not saved");
+    rc = boot(boot_resume, NULL);
+    CHECK(rc == HOST_EXIT_RESTART && host_ota->boot_set && slot_is_image(), "deferred job after confirm: rc %d",
+          rc);
+    printf("ok   command while PENDING_VERIFY saved without touching flash, run once confirmed\n");
+}
+
+/* The server starts alongside us; poll until it answers. */
+static bool wait_server(void)
+{
+    esp_http_client_config_t cfg = { .url = s_url, .timeout_ms = 1000 };
+    for (int waited = 0; waited < SERVER_WAIT_MS; waited += 100) {
+        esp_http_client_handle_t c = esp_http_client_init(&cfg);
+        esp_err_t err = c != NULL ? esp_http_client_open(c, 0) : ESP_FAIL;
+        if (c != NULL) {
+            esp_http_client_cleanup(c);
+        }
+        if (err == ESP_OK) {
+            return true;
+        }
+        usleep(100 * 1000);
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 4 || strlen(argv[3]) != 64) {
+        fprintf(stderr, "usage: %s URL IMAGE SHA256HEX\n", argv[0]);
+        return 2;
+    }
+    s_url = argv[1];
+    s_sha = argv[3];
+    FILE *f = fopen(argv[2], "rb");
+    if (f == NULL) {
+        perror(argv[2]);
+        return 2;
+    }
+    s_image = malloc(HOST_OTA_SLOT_SIZE + 1);
+    s_image_len = s_image != NULL ? fread(s_image, 1, HOST_OTA_SLOT_SIZE + 1, f) : 0;
+    fclose(f);
+    if (s_image_len < 4 * 65536 || s_image_len > HOST_OTA_SLOT_SIZE) {
+        fprintf(stderr, "%s: image must be 256 KB .. %u bytes\n", argv[2], (unsigned)HOST_OTA_SLOT_SIZE);
+        return 2;
+    }
+    host_nvs_share();
+    if (!wait_server()) {
+        fprintf(stderr, "%s: no server\n", s_url);
+        return 2;
+    }
+    test_bad_sha();
+    test_power_cut_resume();
+    test_resend_without_sha();
+    test_wrong_sha();
+    test_pending_verify();
+    return s_fail != 0;
+}
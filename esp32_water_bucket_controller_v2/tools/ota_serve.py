@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""ota_serve.py - Local HTTP stand-in for OTA testing: serves one firmware image.
+
+    python3 tools/ota_serve.py build/water_bucket_controller.bin --port 8070 --kbps 200
+    python3 tools/ota_serve.py build/water_bucket_controller.bin --drop 0.3
+
+Then publish http://<this host>:8070/fw.bin (optionally followed by a space and the
+image's SHA-256, printed at startup) to water_bucket/cmd/ota and watch
+water_bucket/state/ota. --kbps throttles the transfer so progress, KB/s and ETA are
+visible; every request and its transfer rate are logged here for comparison.
+"Range: bytes=N-" is honoured (206). --drop P cuts each response at a random
+point with probability P, to exercise the device's resume path.
+"""
+
+import argparse
+import hashlib
+import http.server
+import os
+import random
+import re
+import sys
+import time
+
+
+def make_handler(image, kbps, chunk, drop):
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_GET(self):
+            first = 0
+            m = re.match(r"bytes=(\d+)-$", self.headers.get("Range", ""))
+            if m and int(m.group(1)) < len(image):
+                first = int(m.group(1))
+                self.send_response(206)
+                self.send_header("Content-Range", "bytes %d-%d/%d" % (first, len(image) - 1, len(image)))
+            else:
+                self.send_response(200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(len(image) - first))
+            self.end_headers()
+            cut = len(image)
+            if random.random() < drop:
+                cut = random.randint(first, len(image) - 1)
+            start = time.monotonic()
+            sent = first
+            try:
+                while sent < cut:
+                    part = image[sent:min(sent + chunk, cut)]
+                    self.wfile.write(part)
+                    sent += len(part)
+                    if kbps > 0:
+                        ahead = sent / (kbps * 1024.0) - (time.monotonic() - start)
+                        if ahead > 0:
+                            time.sleep(ahead)
+            except (BrokenPipeError, ConnectionResetError):
+                pass
+            took = time.monotonic() - start
+            rate = (sent - first) / 1024.0 / took if took > 0 else 0.0
+            self.log_message("sent %d-%d/%d bytes in %.1fs (%.1f KB/s)%s", first, sent, len(image), took, rate,
+                             " [dropped]" if sent < len(image) else "")
+            if sent < len(image):
+                self.close_connection = True
+
+    return Handler
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("image")
+    ap.add_argument("--port", type=int, default=8070)
+    ap.add_argument("--kbps", type=float, default=0, help="throttle to this rate (0 = unthrottled)")
+    ap.add_argument("--chunk", type=int, default=1024)
+    ap.add_argument("--drop", type=float, default=0, help="probability of cutting a response short")
+    opts = ap.parse_args()
+    with open(opts.image, "rb") as f:
+        image = f.read()
+    srv = http.server.ThreadingHTTPServer(("", opts.port), make_handler(image, opts.kbps, opts.chunk, opts.drop))
+    print("serving %s (%d bytes, sha256 %s) on :%d" % (os.path.basename(opts.image), len(image),
+                                                        hashlib.sha256(image).hexdigest(), opts.port), file=sys.stderr)
+    try:
+        srv.serve_forever()
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,397 @@
+/*
+ * ui_host.c - Headless host build of the OLED UI: main/ui/ui_pages.c, the page builders, ui_log.c and
+ * ui_tz.c against the fakes in tools/host/, with ui.c's task replaced by a script. Built by
+ * `make ui-host` (snapshot check) and `make ui-bench`.
+ *
+ *   ui_host [-p PREFIX] [SCRIPT]        run SCRIPT (default stdin); text frames on stdout, and with -p
+ *                                       each frame also as PREFIX-NNN.pbm (128x64, lcd_font glyphs)
+ *   ui_host --bench [ROUNDS] [--max-us US]
+ *                                       time ui_pages_build_frame() on every page with a full log;
+ *                                       exit 1 if a page takes more than US per frame
+ *
+ * Script lines (# starts a comment):
+ *   cw [N] | ccw [N] | press | long     encoder input, as ui_post_input() would deliver it
+ *   wait MS                             advance the fake uptime (and the wall clock, once set)
+ *   clock EPOCH | clock off             set the wall clock (UTC seconds) or go back to "not synced"
+ *   level N 0|1                         level sensor N (1..3), 1 = dry; all dry sets the dry lock
+ *   wifi 0|1 | mqtt 0|1                 link state as ui.c sees it
+ *   rssi DBM | ip A.B.C.D | heap BYTES | fw VERSION
+ *   pump N|off                          set_pump() as an MQTT command would call it
+ *   log TEXT                            ui_log_event(TEXT)
+ *   dump [LABEL]                        print the current frame
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_timer.h"
+#include "host_clock.h"
+#include "host_fakes.h"
+#include "lcd_font.h"
+#include "ui.h"
+#include "ui_tz.h"
+
+#define BENCH_ROUNDS 5000
+#define PBM_W (UI_COLS * 8)
+#define PBM_H (UI_ROWS * 8)
+
+uint8_t s_current_pump = WB_PUMP_OFF;
+int s_level[WB_NUM_LEVELS];
+bool s_pumps_disabled;
+bool s_ui_pump_enabled = true;
+bool s_wifi_connected_state;
+bool s_mqtt_connected_state;
+
+static const char *s_page_names[UI_PAGE_COUNT] = { "home", "pumps", "sensors", "logs", "settings" };
+
+/* ui.c's view of the runtime, updated by host_poll_runtime() the way ui_poll_runtime() does. */
+static bool s_wifi_connected;
+static bool s_mqtt_connected;
+static int64_t s_sensor_change_us[WB_NUM_LEVELS];
+static int s_prev_level[WB_NUM_LEVELS];
+static bool s_prev_disabled;
+static uint8_t s_prev_pump = WB_PUMP_OFF;
+static bool s_prev_ui_enabled = true;
+
+static ui_state_t s_state;
+static const char *s_pbm_prefix;
+static int s_dumps;
+
+void set_pump(uint8_t index)
+{
+    if (index < WB_NUM_PUMPS && (!s_ui_pump_enabled || s_pumps_disabled)) {
+        return;
+    }
+    s_current_pump = index < WB_NUM_PUMPS ? index : WB_PUMP_OFF;
+}
+
+void set_ui_pump_enabled(bool enabled)
+{
+    s_ui_pump_enabled = enabled;
+    if (!enabled) {
+        set_pump(WB_PUMP_OFF);
+    }
+}
+
+esp_err_t lcd_set_contrast(uint8_t contrast)
+{
+    (void)contrast;
+    return ESP_OK;
+}
+
+bool ui_runtime_wifi_connected(void)
+{
+    return s_wifi_connected;
+}
+
+bool ui_runtime_mqtt_connected(void)
+{
+    return s_mqtt_connected;
+}
+
+uint32_t ui_runtime_uptime_s(void)
+{
+    return (uint32_t)(esp_timer_get_time() / 1000000LL);
+}
+
+uint32_t ui_runtime_sensor_age_s(int idx)
+{
+    if (idx < 0 || idx >= WB_NUM_LEVELS) {
+        return 0;
+    }
+    int64_t dt = esp_timer_get_time() - s_sensor_change_us[idx];
+    return (uint32_t)((dt < 0 ? 0 : dt) / 1000000LL);
+}
+
+static uint32_t ms_to_next_second(int64_t elapsed_us)
+{
+    return (uint32_t)(1000 - (elapsed_us / 1000) % 1000);
+}
+
+uint32_t ui_runtime_uptime_next_ms(void)
+{
+    return ms_to_next_second(esp_timer_get_time());
+}
+
+uint32_t ui_runtime_sensor_age_next_ms(void)
+{
+    int64_t now = esp_timer_get_time();
+    uint32_t next = UI_NEVER;
+    for (int i = 0; i < WB_NUM_LEVELS; i++) {
+        uint32_t ms = ms_to_next_second(now - s_sensor_change_us[i]);
+        if (ms < next) {
+            next = ms;
+        }
+    }
+    return next;
+}
+
+static void host_poll_runtime(void)
+{
+    if (s_wifi_connected_state != s_wifi_connected) {
+        s_wifi_connected = s_wifi_connected_state;
+        ui_log_post(UI_LOG_WIFI, s_wifi_connected, 0);
+    }
+    if (s_mqtt_connected_state != s_mqtt_connected) {
+        s_mqtt_connected = s_mqtt_connected_state;
+        ui_log_post(UI_LOG_MQTT, s_mqtt_connected, 0);
+    }
+    for (int i = 0; i < WB_NUM_LEVELS; i++) {
+        if (s_prev_level[i] != s_level[i]) {
+            s_prev_level[i] = s_level[i];
+            s_sensor_change_us[i] = esp_timer_get_time();
+            ui_log_post(UI_LOG_LEVEL, i, s_level[i] != 0);
+        }
+    }
+    if (s_prev_disabled != s_pumps_disabled) {
+        s_prev_disabled = s_pumps_disabled;
+        ui_log_post(UI_LOG_SAFETY, s_pumps_disabled, 0);
+    }
+    if (s_prev_pump != s_current_pump) {
+        s_prev_pump = s_current_pump;
+        ui_log_post(UI_LOG_PUMP, s_current_pump, 0);
+    }
+    if (s_prev_ui_enabled != s_ui_pump_enabled) {
+        s_prev_ui_enabled = s_ui_pump_enabled;
+        ui_log_post(UI_LOG_UI_PUMP, s_ui_pump_enabled, 0);
+    }
+}
+
+/* The frame as the panel shows it, lit pixels black (PBM 1). */
+static int write_pbm(const ui_frame_t *f, const char *path)
+{
+    static uint8_t img[PBM_H][PBM_W / 8];
+    memset(img, 0, sizeof(img));
+    for (int r = 0; r < UI_ROWS; r++) {
+        for (int c = 0; c < UI_COLS; c++) {
+            const uint8_t *g = lcd_glyph(f->rows[r][c] != '\0' ? f->rows[r][c] : ' ');
+            for (int x = 0; x < 8; x++) {
+                uint8_t col = r == f->invert_row ? (uint8_t)~g[x] : g[x];
+                for (int y = 0; y < 8; y++) {
+                    if ((col >> y) & 1) {
+                        int px = c * 8 + x;
+                        img[r * 8 + y][px / 8] |= (uint8_t)(0x80 >> (px % 8));
+                    }
+                }
+            }
+        }
+    }
+    FILE *out = fopen(path, "wb");
+    if (out == NULL) {
+        perror(path);
+        return -1;
+    }
+    fprintf(out, "P4\n%d %d\n", PBM_W, PBM_H);
+    fwrite(img, 1, sizeof(img), out);
+    return fclose(out);
+}
+
+static int dump(const char *label)
+{
+    ui_frame_t f;
+    host_poll_runtime();
+    ui_pages_build_frame(&s_state, &f);
+    s_dumps++;
+    printf("--- %d %s [%s cursor=%u scroll=%u%s]\n", s_dumps, label, s_page_names[s_state.page],
+           (unsigned)s_state.cursor, (unsigned)s_state.scroll, s_state.menu_mode ? " menu" : "");
+    printf("+----------------+\n");
+    for (int r = 0; r < UI_ROWS; r++) {
+        printf("|%-16.16s|%s\n", f.rows[r], r == f.invert_row ? " <" : "");
+    }
+    printf("+----------------+\n");
+    if (s_pbm_prefix != NULL) {
+        char path[256];
+        snprintf(path, sizeof(path), "%s-%03d.pbm", s_pbm_prefix, s_dumps);
+        return write_pbm(&f, path);
+    }
+    return 0;
+}
+
+static void input(ui_input_event_t ev, int n)
+{
+    for (int i = 0; i < n; i++) {
+        host_poll_runtime();
+        ui_pages_handle_input(&s_state, ev);
+    }
+}
+
+static void update_dry_lock(void)
+{
+    s_pumps_disabled = s_level[0] != 0 && s_level[1] != 0 && s_level[2] != 0;
+    if (s_pumps_disabled) {
+        set_pump(WB_PUMP_OFF);
+    }
+}
+
+/* One script line; returns -1 (with a message) if it cannot be run. */
+static int run_line(char *line, int lineno)
+{
+    char *nl = strpbrk(line, "#\r\n");
+    if (nl != NULL) {
+        *nl = '\0';
+    }
+    char *cmd = strtok(line, " \t");
+    if (cmd == NULL) {
+        return 0;
+    }
+    char *arg = strtok(NULL, " \t");
+    char *arg2 = strtok(NULL, "");
+    int n = arg != NULL ? atoi(arg) : 1;
+
+    if (strcmp(cmd, "cw") == 0) {
+        input(UI_INPUT_ROTATE_CW, n);
+    } else if (strcmp(cmd, "ccw") == 0) {
+        input(UI_INPUT_ROTATE_CCW, n);
+    } else if (strcmp(cmd, "press") == 0) {
+        input(UI_INPUT_PRESS_SHORT, 1);
+    } else if (strcmp(cmd, "long") == 0) {
+        input(UI_INPUT_PRESS_LONG, 1);
+    } else if (strcmp(cmd, "wait") == 0 && arg != NULL) {
+        host_clock_advance_us((int64_t)atol(arg) * 1000);
+    } else if (strcmp(cmd, "clock") == 0 && arg != NULL) {
+        host_clock_set_wall(strcmp(arg, "off") == 0 ? 0 : (time_t)atoll(arg));
+    } else if (strcmp(cmd, "level") == 0 && arg != NULL && arg2 != NULL && n >= 1 && n <= WB_NUM_LEVELS) {
+        s_level[n - 1] = atoi(arg2) != 0;
+        update_dry_lock();
+    } else if (strcmp(cmd, "wifi") == 0 && arg != NULL) {
+        s_wifi_connected_state = n != 0;
+        host_wifi_associated = n != 0;
+    } else if (strcmp(cmd, "mqtt") == 0 && arg != NULL) {
+        s_mqtt_connected_state = n != 0;
+    } else if (strcmp(cmd, "rssi") == 0 && arg != NULL) {
+        host_wifi_rssi = (int8_t)n;
+    } else if (strcmp(cmd, "ip") == 0 && arg != NULL) {
+        unsigned a, b, c, d;
+        if (sscanf(arg, "%u.%u.%u.%u", &a, &b, &c, &d) != 4) {
+            fprintf(stderr, "line %d: bad address '%s'\n", lineno, arg);
+            return -1;
+        }
+        host_ip_addr = (a & 0xff) | (b & 0xff) << 8 | (c & 0xff) << 16 | (d & 0xffu) << 24;
+    } else if (strcmp(cmd, "heap") == 0 && arg != NULL) {
+        host_heap_free = (uint32_t)strtoul(arg, NULL, 10);
+    } else if (strcmp(cmd, "fw") == 0 && arg != NULL) {
+        snprintf(host_fw_version, sizeof(host_fw_version), "%s", arg);
+    } else if (strcmp(cmd, "pump") == 0 && arg != NULL) {
+        set_pump(strcmp(arg, "off") == 0 ? WB_PUMP_OFF : (uint8_t)n);
+    } else if (strcmp(cmd, "log") == 0 && arg != NULL) {
+        /* The log keeps the pointer; script lines are few, so the copies are never freed. */
+        char text[64];
+        snprintf(text, sizeof(text), "%s%s%s", arg, arg2 != NULL ? " " : "", arg2 != NULL ? arg2 : "");
+        ui_log_event(strdup(text));
+    } else if (strcmp(cmd, "dump") == 0) {
+        char label[64];
+        snprintf(label, sizeof(label), "%s%s%s", arg != NULL ? arg : "", arg2 != NULL ? " " : "",
+                 arg2 != NULL ? arg2 : "");
+        return dump(label);
+    } else {
+        fprintf(stderr, "line %d: cannot run '%s'\n", lineno, cmd);
+        return -1;
+    }
+    return 0;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+/* Every page with a full log, the wall clock set and everything connected, on its busiest view. */
+static int bench(int rounds, double max_us)
+{
+    host_clock_set_wall(1760000000);
+    s_wifi_connected_state = true;
+    host_wifi_associated = true;
+    s_mqtt_connected_state = true;
+    for (int i = 0; i < 120; i++) {
+        if (i % 3 == 0) {
+            ui_log_event("OTA download resumed at 655360 of 1179648 bytes");
+        } else {
+            ui_log_post(i % 3 == 1 ? UI_LOG_PUMP : UI_LOG_LEVEL, i % WB_NUM_PUMPS, i & 1);
+        }
+        (void)ui_log_count();
+        host_clock_advance_us(1000000);
+    }
+    host_poll_runtime();
+    int slow = 0;
+    volatile int sink = 0;
+    printf("%-10s %10s\n", "page", "us/frame");
+    for (int p = 0; p < UI_PAGE_COUNT; p++) {
+        ui_state_t st;
+        ui_pages_init(&st);
+        st.page = (ui_page_t)p;
+        st.menu_mode = p == UI_PAGE_HOME;
+        st.cursor = p == UI_PAGE_HOME ? 0 : 1;
+        if (p == UI_PAGE_LOGS) {
+            st.scroll = (uint16_t)(ui_log_seg_count() - 6);
+        }
+        ui_frame_t f;
+        ui_pages_build_frame(&st, &f);
+        double t0 = now_us();
+        for (int r = 0; r < rounds; r++) {
+            /* Let the uptime tick so the settings page re-reads its per-second lines. */
+            host_clock_advance_us(1000);
+            ui_pages_build_frame(&st, &f);
+            sink += f.rows[1][0];
+        }
+        double us = (now_us() - t0) / rounds;
+        bool over = max_us > 0 && us > max_us;
+        slow += over;
+        printf("%-10s %10.2f%s\n", s_page_names[p], us, over ? "  over limit" : "");
+    }
+    (void)sink;
+    if (slow > 0) {
+        printf("FAIL: %d page(s) over %.1f us per frame\n", slow, max_us);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *script = NULL;
+    bool do_bench = false;
+    int rounds = BENCH_ROUNDS;
+    double max_us = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+            s_pbm_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            do_bench = true;
+            if (i + 1 < argc && argv[i + 1][0] != '-') {
+                rounds = atoi(argv[++i]);
+            }
+        } else if (strcmp(argv[i], "--max-us") == 0 && i + 1 < argc) {
+            max_us = atof(argv[++i]);
+        } else if (argv[i][0] != '-' && script == NULL) {
+            script = argv[i];
+        } else {
+            fprintf(stderr, "usage: %s [-p PREFIX] [SCRIPT] | --bench [ROUNDS] [--max-us US]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    ui_log_init();
+    ui_tz_init();
+    ui_pages_init(&s_state);
+    if (do_bench) {
+        return bench(rounds > 0 ? rounds : BENCH_ROUNDS, max_us);
+    }
+
+    FILE *in = stdin;
+    if (script != NULL && (in = fopen(script, "r")) == NULL) {
+        perror(script);
+        return 1;
+    }
+    char line[256];
+    int lineno = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), in) != NULL) {
+        rc = run_line(line, ++lineno);
+    }
+    if (in != stdin) {
+        fclose(in);
+    }
+    return rc == 0 ? 0 : 1;
+}
@@ -0,0 +1,160 @@
+/*
+ * ui_log_bench.c - Host benchmark of the logs page word-wrap index (main/ui/ui_log.c), built by
+ * `make ui-log-bench`. Fills the log past capacity, checks every scroll position against a full
+ * re-wrap of the log, and times a page lookup both ways: the index, and the walk logs_page.c used to
+ * make (every entry copied and wrapped, once for the count and again for each of the six rows).
+ * Also times a post into the lock-free ring, and checks an overrun shows up as a "lost" entry.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ui.h"
+
+#define PAGE_ROWS 6
+#define ROUNDS 2000
+
+static const char *s_msgs[] = {
+    "WiFi connected",
+    "MQTT disconnected",
+    "L2 dry",
+    "Pump 3 active",
+    "Safety dry lock, all buckets read dry",
+    "UI contrast 192",
+    "OTA download resumed at 655360 of 1179648 bytes",
+    "x",
+    "averyveryverylongwordwithoutanyspacesatall that must be split",
+};
+
+/* The pre-index walk: segment `seg_index` found by wrapping every entry from the newest. */
+static size_t ref_walk(size_t seg_index, ui_log_seg_t *out)
+{
+    size_t walk = 0;
+    size_t n = ui_log_count();
+    for (size_t e = 0; e < n; e++) {
+        char b[64];
+        ui_log_get_recent(e, b, sizeof(b));
+        size_t L = strlen(b);
+        int label = (int)e + 1;
+        if (L == 0) {
+            if (out != NULL && walk == seg_index) {
+                out->num = label;
+                out->first = true;
+                strcpy(out->text, "-");
+            }
+            walk++;
+            continue;
+        }
+        size_t off = 0;
+        int first = 1;
+        while (off < L) {
+            char tmp[sizeof(out->text)];
+            size_t seg_off = off;
+            ui_log_wrap_step(b, L, &off, first ? ui_log_first_width(label) : 13, tmp, sizeof(tmp));
+            if (off == seg_off && tmp[0] == '\0') {
+                break;
+            }
+            if (out != NULL && walk == seg_index) {
+                out->num = label;
+                out->first = seg_off == 0;
+                snprintf(out->text, sizeof(out->text), "%s", tmp);
+                return walk;
+            }
+            walk++;
+            first = 0;
+        }
+    }
+    return walk;
+}
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int check(void)
+{
+    size_t total = ui_log_seg_count();
+    size_t ref_total = ref_walk((size_t)-1, NULL);
+    if (total != ref_total) {
+        printf("FAIL: %zu segments, re-wrap gives %zu\n", total, ref_total);
+        return 1;
+    }
+    for (size_t s = 0; s < total; s++) {
+        ui_log_seg_t a;
+        ui_log_seg_t b;
+        memset(&b, 0, sizeof(b));
+        if (ui_log_segs_get(s, &a, 1) != 1) {
+            printf("FAIL: no segment %zu of %zu\n", s, total);
+            return 1;
+        }
+        ref_walk(s, &b);
+        if (a.num != b.num || a.first != b.first || strcmp(a.text, b.text) != 0) {
+            printf("FAIL: segment %zu: %d/%d '%s', re-wrap %d/%d '%s'\n", s, a.num, a.first, a.text, b.num,
+                   b.first, b.text);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(void)
+{
+    ui_log_init();
+    size_t nmsg = sizeof(s_msgs) / sizeof(s_msgs[0]);
+    /* Check while filling (one-digit labels only, then a mix) and after wrapping around. */
+    for (size_t i = 0; i < 250; i++) {
+        ui_log_event(s_msgs[(i * 7) % nmsg]);
+        if ((i < 20 || i % 25 == 0) && check() != 0) {
+            return 1;
+        }
+    }
+    if (check() != 0) {
+        return 1;
+    }
+    size_t total = ui_log_seg_count();
+    printf("%zu entries, %zu segments: index matches a full re-wrap at every position\n", ui_log_count(), total);
+
+    volatile size_t sink = 0;
+    ui_log_seg_t page[PAGE_ROWS];
+    double t0 = now_us();
+    for (int r = 0; r < ROUNDS; r++) {
+        size_t scroll = (size_t)r % (total - PAGE_ROWS);
+        sink += ui_log_seg_count();
+        sink += ui_log_segs_get(scroll, page, PAGE_ROWS);
+    }
+    double t_index = (now_us() - t0) / ROUNDS;
+    t0 = now_us();
+    for (int r = 0; r < ROUNDS / 20; r++) {
+        size_t scroll = (size_t)r % (total - PAGE_ROWS);
+        sink += ref_walk((size_t)-1, NULL);
+        for (size_t i = 0; i < PAGE_ROWS; i++) {
+            sink += ref_walk(scroll + i, &page[i]);
+        }
+    }
+    double t_walk = (now_us() - t0) / (ROUNDS / 20);
+    t0 = now_us();
+    for (int r = 0; r < ROUNDS; r++) {
+        ui_log_post(UI_LOG_PUMP, r % WB_NUM_PUMPS, 0);
+    }
+    double t_post = (now_us() - t0) / ROUNDS;
+    /* That overran the ring: the newest entry must say how many records it had no room for. */
+    char lost[64];
+    ui_log_get_recent(0, lost, sizeof(lost));
+    if (strstr(lost, " log events lost") == NULL) {
+        printf("FAIL: ring overrun not reported (newest entry '%s')\n", lost);
+        return 1;
+    }
+    t0 = now_us();
+    for (int r = 0; r < ROUNDS; r++) {
+        ui_log_post(UI_LOG_PUMP, r % WB_NUM_PUMPS, 0);
+        sink += ui_log_count();
+    }
+    double t_append = (now_us() - t0) / ROUNDS;
+    (void)sink;
+    printf("page lookup: index %.2f us, full walk %.2f us (%.0fx)\n", t_index, t_walk, t_walk / t_index);
+    printf("post: %.3f us; post, drain and index update: %.2f us\n", t_post, t_append);
+    return 0;
+}
@@ -0,0 +1,156 @@
+#!/usr/bin/env python3
+"""wb_delta.py - Build a WBD1 delta patch between two app images for delta OTA.
+
+    python3 tools/wb_delta.py old.bin build/water_bucket_controller.bin -o build/update.wbd
+
+OLD must be the exact image running on the device (the .bin it was flashed or
+updated with); the device checks its SHA-256 before applying. Serve the patch like
+an image (make ota-serve FW=build/update.wbd) and publish its URL, optionally
+followed by the NEW image's SHA-256 (printed here), to water_bucket/cmd/ota.
+
+Format (see main/delta_apply.h): 80-byte header, then a zlib stream of ops. Matches
+are found through a hash of 16-byte source blocks, grown backwards over pending
+literals and forwards exactly ('C'), then approximately while most bytes still
+agree ('A': byte-wise differences, mostly zeros, which compress well where code
+moved and its addresses shifted). Everything else is inserted literally ('I').
+"""
+
+import argparse
+import hashlib
+import struct
+import sys
+import zlib
+
+BLOCK = 16
+STRIDE = 4
+APPROX_SLACK = 16  # stop growing an 'A' region this many net mismatches past its best point
+
+
+def varint(v):
+    out = bytearray()
+    while True:
+        b = v & 0x7F
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def index_source(old):
+    idx = {}
+    for p in range(0, len(old) - BLOCK + 1, STRIDE):
+        idx.setdefault(old[p:p + BLOCK], p)
+    return idx
+
+
+def exact_len(old, new, s, i):
+    n = 0
+    limit = min(len(old) - s, len(new) - i)
+    while n + 64 <= limit and old[s + n:s + n + 64] == new[i + n:i + n + 64]:
+        n += 64
+    while n < limit and old[s + n] == new[i + n]:
+        n += 1
+    return n
+
+
+def approx_len(old, new, s, i, start):
+    """Length from (s, i) up to which +1 per equal byte, -1 per different byte peaks."""
+    score = best = 0
+    best_j = j = start
+    limit = min(len(old) - s, len(new) - i)
+    while j < limit:
+        score += 1 if old[s + j] == new[i + j] else -1
+        j += 1
+        if score > best:
+            best, best_j = score, j
+        elif score < best - APPROX_SLACK:
+            break
+    return best_j
+
+
+class Ops:
+    def __init__(self):
+        self.buf = bytearray()
+        self.lit = bytearray()
+        self.counts = {"C": 0, "A": 0, "I": 0}
+
+    def flush_lit(self):
+        if self.lit:
+            self.buf += b"I" + varint(len(self.lit)) + self.lit
+            self.counts["I"] += len(self.lit)
+            self.lit = bytearray()
+
+    def copy(self, s, n):
+        self.flush_lit()
+        self.buf += b"C" + varint(s) + varint(n)
+        self.counts["C"] += n
+
+    def add(self, old, new, s, i, n):
+        self.flush_lit()
+        self.buf += b"A" + varint(s) + varint(n)
+        self.buf += bytes((new[i + k] - old[s + k]) & 0xFF for k in range(n))
+        self.counts["A"] += n
+
+
+def diff(old, new):
+    idx = index_source(old)
+    ops = Ops()
+    disp = 0  # source minus target offset of the last match; code that did not move keeps it
+    i = 0
+    while i < len(new):
+        best_s, best_n = -1, 0
+        for s in (i + disp, idx.get(new[i:i + BLOCK], -1)):
+            if 0 <= s < len(old):
+                n = exact_len(old, new, s, i)
+                if n > best_n:
+                    best_s, best_n = s, n
+        if best_n < BLOCK:
+            ops.lit.append(new[i])
+            i += 1
+            continue
+        s = best_s
+        back = 0
+        while back < len(ops.lit) and s - back > 0 and old[s - back - 1] == new[i - back - 1]:
+            back += 1
+        if back:
+            del ops.lit[len(ops.lit) - back:]
+            s -= back
+            i -= back
+            best_n += back
+        ops.copy(s, best_n)
+        n = approx_len(old, new, s + best_n, i + best_n, 0)
+        if n > 0:
+            ops.add(old, new, s + best_n, i + best_n, n)
+        disp = s - i
+        i += best_n + n
+    ops.flush_lit()
+    ops.buf += b"E"
+    return bytes(ops.buf), ops.counts
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("old", help="image running on the device")
+    ap.add_argument("new", help="image to install")
+    ap.add_argument("-o", "--output", required=True)
+    opts = ap.parse_args()
+    with open(opts.old, "rb") as f:
+        old = f.read()
+    with open(opts.new, "rb") as f:
+        new = f.read()
+    stream, counts = diff(old, new)
+    hdr = b"WBD1" + struct.pack("<II", len(old), len(new)) + bytes(4)
+    hdr += hashlib.sha256(old).digest() + hashlib.sha256(new).digest()
+    patch = hdr + zlib.compress(stream, 9)
+    with open(opts.output, "wb") as f:
+        f.write(patch)
+    print("%s: %d bytes (%.1f%% of %d), copy %d add %d insert %d" %
+          (opts.output, len(patch), 100.0 * len(patch) / max(len(new), 1), len(new),
+           counts["C"], counts["A"], counts["I"]), file=sys.stderr)
+    print("target sha256 %s" % hashlib.sha256(new).hexdigest(), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
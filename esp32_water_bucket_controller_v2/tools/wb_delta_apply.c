@@ -0,0 +1,116 @@
+/*
+ * wb_delta_apply.c - Host build of the device's delta applier (main/delta_apply.c), for checking a
+ * patch before it is served: wb_delta_apply OLD PATCH OUT. Inflates with zlib in small chunks so the
+ * applier sees the same arbitrary splits as on the device. Built by `make delta-tool`.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+#include "delta_apply.h"
+
+typedef struct {
+    const uint8_t *src;
+    size_t src_len;
+    FILE *out;
+} host_ctx_t;
+
+static int read_src(void *ctx, uint32_t off, void *buf, size_t len)
+{
+    host_ctx_t *h = (host_ctx_t *)ctx;
+    if (off > h->src_len || len > h->src_len - off) {
+        return -1;
+    }
+    memcpy(buf, h->src + off, len);
+    return 0;
+}
+
+static int write_dst(void *ctx, const void *buf, size_t len)
+{
+    host_ctx_t *h = (host_ctx_t *)ctx;
+    return fwrite(buf, 1, len, h->out) == len ? 0 : -1;
+}
+
+static uint8_t *load(const char *path, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        perror(path);
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t *buf = malloc(n > 0 ? (size_t)n : 1);
+    if (buf != NULL && fread(buf, 1, (size_t)n, f) != (size_t)n) {
+        free(buf);
+        buf = NULL;
+    }
+    fclose(f);
+    *len = (size_t)n;
+    return buf;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc != 4) {
+        fprintf(stderr, "usage: %s OLD PATCH OUT\n", argv[0]);
+        return 2;
+    }
+    host_ctx_t h = {0};
+    size_t patch_len;
+    h.src = load(argv[1], &h.src_len);
+    uint8_t *patch = load(argv[2], &patch_len);
+    if (h.src == NULL || patch == NULL) {
+        return 1;
+    }
+    delta_hdr_t hdr;
+    if (patch_len < DELTA_HDR_SIZE || !delta_hdr_parse(patch, &hdr)) {
+        fprintf(stderr, "%s: not a WBD1 patch\n", argv[2]);
+        return 1;
+    }
+    if (hdr.src_size != h.src_len) {
+        fprintf(stderr, "%s: made from a %u-byte image, %s is %zu bytes\n", argv[2], (unsigned)hdr.src_size,
+                argv[1], h.src_len);
+        return 1;
+    }
+    h.out = fopen(argv[3], "wb");
+    if (h.out == NULL) {
+        perror(argv[3]);
+        return 1;
+    }
+
+    static delta_t d;
+    delta_init(&d, &hdr, read_src, write_dst, &h);
+    z_stream z = {0};
+    inflateInit(&z);
+    uint8_t out[1000];  /* odd size: ops and payloads straddle feed calls */
+    size_t pos = DELTA_HDR_SIZE;
+    int zrc = Z_OK;
+    delta_status_t st = DELTA_OK;
+    while (zrc == Z_OK && st == DELTA_OK) {
+        if (z.avail_in == 0 && pos < patch_len) {
+            size_t n = patch_len - pos < 1500 ? patch_len - pos : 1500;
+            z.next_in = patch + pos;
+            z.avail_in = (uInt)n;
+            pos += n;
+        }
+        z.next_out = out;
+        z.avail_out = sizeof(out);
+        zrc = inflate(&z, Z_NO_FLUSH);
+        if (zrc == Z_BUF_ERROR && pos < patch_len) {
+            zrc = Z_OK;
+        }
+        st = delta_feed(&d, out, sizeof(out) - z.avail_out);
+    }
+    inflateEnd(&z);
+    fclose(h.out);
+    if (zrc != Z_STREAM_END || st != DELTA_OK || !delta_done(&d)) {
+        fprintf(stderr, "%s: apply failed (zlib %d, delta %d, %u of %u bytes)\n", argv[2], zrc, (int)st,
+                (unsigned)d.written, (unsigned)hdr.dst_size);
+        return 1;
+    }
+    printf("%s: %u bytes from %zu-byte patch\n", argv[3], (unsigned)d.written, patch_len);
+    return 0;
+}
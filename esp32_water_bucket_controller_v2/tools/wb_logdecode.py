@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""wb_logdecode.py - Decode the TCP log stream of a WB_LOG_BINARY_RAW=1 build.
+
+Text lines pass through unchanged. Each binary record is 0x1E followed by log_bin_rec_t
+(fmt, tag, ts_ms as u32; level, nargs as u8; u16 reserved; nargs u32 args, little endian).
+fmt, tag and %s arguments are flash addresses, resolved against the firmware ELF.
+
+    python3 tools/wb_logdecode.py build/water_bucket_controller.elf --host 192.168.1.50 --port 8080
+    python3 tools/wb_logdecode.py build/water_bucket_controller.elf < capture.bin
+
+Needs pyelftools (pip install pyelftools; it ships with ESP-IDF's Python env).
+"""
+
+import argparse
+import re
+import socket
+import struct
+import sys
+
+from elftools.elf.elffile import ELFFile
+
+FRAME = 0x1E
+HDR = struct.Struct("<IIIBBH")
+LEVELS = "NEWIDV"
+SPEC = re.compile(r"%([-+ #0]*\d*(?:\.\d+)?)(hh|h|ll|l|z|j|t)?([diuxXocsp%])")
+
+
+class Image:
+    """Maps addresses to C strings from the ELF's allocated, non-executable sections."""
+
+    def __init__(self, path):
+        self.sections = []
+        with open(path, "rb") as f:
+            elf = ELFFile(f)
+            for sec in elf.iter_sections():
+                flags = sec["sh_flags"]
+                if sec["sh_type"] == "SHT_PROGBITS" and flags & 0x2 and not flags & 0x4:
+                    self.sections.append((sec["sh_addr"], sec.data()))
+
+    def cstr(self, addr):
+        for base, data in self.sections:
+            if base <= addr < base + len(data):
+                off = addr - base
+                end = data.find(b"\0", off)
+                return data[off:end if end >= 0 else len(data)].decode("utf-8", "replace")
+        return "<0x%08x>" % addr
+
+
+def s32(v):
+    return v - (1 << 32) if v & 0x80000000 else v
+
+
+def format_msg(img, fmt, args):
+    it = iter(args)
+
+    def conv(m):
+        flags, _, c = m.groups()
+        if c == "%":
+            return "%"
+        a = next(it, 0)
+        if c == "s":
+            return ("%" + flags + "s") % img.cstr(a)
+        if c == "p":
+            return "0x%08x" % a
+        if c in "di":
+            return ("%" + flags + "d") % s32(a)
+        if c == "c":
+            return chr(a & 0xFF)
+        return ("%" + flags + c) % a
+
+    return SPEC.sub(conv, fmt)
+
+
+def decode(img, read, out):
+    buf = b""
+    while True:
+        chunk = read()
+        if not chunk:
+            break
+        buf += chunk
+        while buf:
+            i = buf.find(bytes([FRAME]))
+            if i < 0:
+                out.write(buf.decode("utf-8", "replace"))
+                buf = b""
+                break
+            if i > 0:
+                out.write(buf[:i].decode("utf-8", "replace"))
+                buf = buf[i:]
+            if len(buf) < 1 + HDR.size:
+                break
+            fmt, tag, ts, level, nargs, _ = HDR.unpack_from(buf, 1)
+            size = 1 + HDR.size + 4 * nargs
+            if nargs > 4:
+                buf = buf[1:]  # not a record; resync on the next frame byte
+                continue
+            if len(buf) < size:
+                break
+            args = struct.unpack_from("<%dI" % nargs, buf, 1 + HDR.size)
+            lv = LEVELS[level] if level < len(LEVELS) else "?"
+            out.write("%s (%u) %s: %s\n" % (lv, ts, img.cstr(tag), format_msg(img, img.cstr(fmt), args)))
+            buf = buf[size:]
+        out.flush()
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("elf")
+    ap.add_argument("--host", help="device IP; reads stdin if omitted")
+    ap.add_argument("--port", type=int, default=8080)
+    opts = ap.parse_args()
+    img = Image(opts.elf)
+    if opts.host:
+        sock = socket.create_connection((opts.host, opts.port))
+        decode(img, lambda: sock.recv(4096), sys.stdout)
+    else:
+        decode(img, lambda: sys.stdin.buffer.read1(4096), sys.stdout)
+
+
+if __name__ == "__main__":
+    main()